@@ -0,0 +1,88 @@
+#include "AtlasPacker.h"
+
+#include <algorithm>
+
+AtlasPacker::AtlasPacker(int width, int height) : width(width), height(height)
+{
+	reset();
+}
+
+void AtlasPacker::reset()
+{
+	skyline.clear();
+	Segment floor = { 0, 0, width };
+	skyline.push_back(floor);
+	usedArea = 0;
+}
+
+int AtlasPacker::fit(size_t segment, int rectWidth, int rectHeight) const
+{
+	if (skyline[segment].x + rectWidth > width)
+		return -1;
+	int y = 0;
+	for (int remaining = rectWidth; remaining > 0; segment++)
+	{
+		y = std::max(y, skyline[segment].y);
+		if (y + rectHeight > height)
+			return -1;
+		remaining -= skyline[segment].width;
+	}
+	return y;
+}
+
+bool AtlasPacker::pack(int rectWidth, int rectHeight, AtlasRect& out)
+{
+	if (rectWidth <= 0 || rectHeight <= 0)
+		return false;
+	size_t best = skyline.size();
+	int bestTop = height + 1, bestWidth = width + 1;
+	for (size_t s = 0; s < skyline.size(); s++)
+	{
+		int y = fit(s, rectWidth, rectHeight);
+		if (y < 0)
+			continue;
+		if (y + rectHeight < bestTop || (y + rectHeight == bestTop && skyline[s].width < bestWidth))
+		{
+			best = s;
+			bestTop = y + rectHeight;
+			bestWidth = skyline[s].width;
+		}
+	}
+	if (best == skyline.size())
+		return false;
+
+	out.x = skyline[best].x;
+	out.y = bestTop - rectHeight;
+	out.width = rectWidth;
+	out.height = rectHeight;
+	usedArea += (long long)rectWidth * rectHeight;
+
+	// the new segment covers the ones under the rectangle, the last of them may stick out
+	Segment top = { out.x, bestTop, rectWidth };
+	skyline.insert(skyline.begin() + best, top);
+	const int right = out.x + rectWidth;
+	size_t next = best + 1;
+	while (next < skyline.size() && skyline[next].x < right)
+	{
+		int overlap = right - skyline[next].x;
+		if (overlap < skyline[next].width)
+		{
+			skyline[next].x += overlap;
+			skyline[next].width -= overlap;
+			break;
+		}
+		skyline.erase(skyline.begin() + next);
+	}
+	// neighbours at the same height become one segment
+	for (size_t s = 0; s + 1 < skyline.size();)
+	{
+		if (skyline[s].y == skyline[s + 1].y)
+		{
+			skyline[s].width += skyline[s + 1].width;
+			skyline.erase(skyline.begin() + s + 1);
+		}
+		else
+			s++;
+	}
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct AtlasRect
+{
+	int x, y, width, height;
+};
+
+// Skyline rectangle packer. The top edge of everything packed so far is kept
+// as a list of horizontal segments; a rectangle goes where its top ends
+// lowest, ties to the narrowest segment, so it packs well in arrival order
+// and rectangles can keep coming after the first ones are in use.
+class AtlasPacker
+{
+public:
+	AtlasPacker(int width, int height);
+
+	// false when the rectangle does not fit anywhere
+	bool pack(int width, int height, AtlasRect& out);
+	void reset();
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	// packed area over the whole area
+	float occupancy() const { return (float)((double)usedArea / ((double)width * height)); }
+
+private:
+	struct Segment
+	{
+		int x, y, width;
+	};
+
+	// y where a rectangle starting at segment would rest, -1 when it does not fit
+	int fit(size_t segment, int rectWidth, int rectHeight) const;
+
+	int width, height;
+	std::vector<Segment> skyline;
+	long long usedArea;
+};
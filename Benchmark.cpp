@@ -0,0 +1,860 @@
+#include "Benchmark.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "ClusteredLights.h"
+#include "Cube.h"
+#include "CpuFeatures.h"
+#include "DepthRasterizer.h"
+#include "FrameArena.h"
+#include "Instrument.h"
+#include "Lod.h"
+#include "Log.h"
+#include "MeshAsset.h"
+#include "MipChain.h"
+#include "NormalMatrix.h"
+#include "RangeAllocator.h"
+#include "TextureAtlas.h"
+#include "UniformTable.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static float randomFloat(float min, float max)
+{
+	return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+// ------------------ DEPTH RASTERIZER ------------------
+static int benchmarkRasterizer()
+{
+	const int cubeCount = 4096;
+	const int frames = 50;
+	const int queries = 100000;
+
+	srand(1);
+	std::vector<glm::mat4> models(cubeCount);
+	for (glm::mat4& model : models)
+	{
+		model = glm::translate(glm::mat4(1.0f), glm::vec3(randomFloat(-20.0f, 20.0f), randomFloat(-15.0f, 15.0f), randomFloat(-60.0f, -5.0f)));
+		model = glm::rotate(model, randomFloat(0.0f, 6.28f), glm::vec3(0.5f, 1.0f, 0.0f));
+	}
+	std::vector<glm::vec3> boxes(queries);
+	for (glm::vec3& box : boxes)
+		box = glm::vec3(randomFloat(-25.0f, 25.0f), randomFloat(-20.0f, 20.0f), randomFloat(-90.0f, -5.0f));
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	unsigned int threadCounts[] = { 1, std::max(1u, std::thread::hardware_concurrency()) };
+	for (int run = 0; run < 4; run++)
+	{
+		// SSE then AVX2 with one thread, then with one per core
+		unsigned int threads = threadCounts[run / 2];
+		bool avx2 = run % 2 == 1;
+		if ((avx2 && !cpuHasAvx2()) || (run >= 2 && threads == 1))
+			continue;
+		DepthRasterizer rasterizer(256, 192, threads);
+		rasterizer.setAvx2(avx2);
+		double setupTime = 0.0, rasterTime = 0.0;
+		unsigned int triangles = 0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			Clock::time_point start = Clock::now();
+			rasterizer.beginFrame(projection * view);
+			for (const glm::mat4& model : models)
+				rasterizer.addMesh(Cube::positions, Cube::vertexCount, 3, model);
+			setupTime += secondsSince(start);
+
+			start = Clock::now();
+			rasterizer.rasterize();
+			rasterTime += secondsSince(start);
+			triangles += rasterizer.getTriangleCount();
+		}
+
+		Clock::time_point start = Clock::now();
+		unsigned int occluded = 0;
+		for (const glm::vec3& box : boxes)
+			occluded += rasterizer.isOccluded(box - glm::vec3(0.5f), box + glm::vec3(0.5f));
+		double queryTime = secondsSince(start);
+
+		std::cout << "raster " << (avx2 ? "avx2 " : "sse ") << threads << " thread(s): "
+			<< triangles / (setupTime + rasterTime) / 1e6 << " Mtri/s ("
+			<< setupTime / frames * 1e3 << " ms setup + " << rasterTime / frames * 1e3 << " ms raster per frame), "
+			<< queryTime / queries * 1e9 << " ns/query, " << occluded << "/" << queries << " occluded" << std::endl;
+	}
+	return 0;
+}
+
+// ------------------ MESH LOADING ------------------
+static int benchmarkMeshLoading()
+{
+	// 1582 x 1582 vertex grid, 2 * 1581 * 1581 = 4999122 triangles
+	const int gridSize = 1582;
+	const char* objPath = "bench_grid.obj";
+	const char* meshPath = "bench_grid.mesh";
+
+	FILE* file = fopen(objPath, "wb");
+	if (!file)
+		return -1;
+	for (int z = 0; z < gridSize; z++)
+		for (int x = 0; x < gridSize; x++)
+			fprintf(file, "v %f %f %f\nvt %f %f\n", x * 0.01f, sin(x * 0.05f) * cos(z * 0.05f), z * 0.01f,
+				x / (float)(gridSize - 1), z / (float)(gridSize - 1));
+	for (int z = 0; z + 1 < gridSize; z++)
+		for (int x = 0; x + 1 < gridSize; x++)
+		{
+			int a = z * gridSize + x + 1, b = a + 1, c = a + gridSize, d = c + 1;
+			fprintf(file, "f %d/%d %d/%d %d/%d\nf %d/%d %d/%d %d/%d\n", a, a, c, c, b, b, b, b, c, c, d, d);
+		}
+	long objSize = ftell(file);
+	fclose(file);
+
+	Clock::time_point start = Clock::now();
+	Mesh mesh;
+	if (!importObj(objPath, mesh))
+		return -1;
+	double importTime = secondsSince(start);
+
+	start = Clock::now();
+	if (!cookMesh(mesh, meshPath))
+		return -1;
+	double cookTime = secondsSince(start);
+
+	// the mapped blobs are what glBufferData gets, the copy stands in for the driver reading them
+	std::vector<float> vertices(mesh.vertices.size());
+	std::vector<unsigned int> indices(mesh.indices.size());
+	start = Clock::now();
+	MappedMesh mapped;
+	if (!mapped.open(meshPath))
+		return -1;
+	double mapTime = secondsSince(start);
+	memcpy(vertices.data(), mapped.vertices(), vertices.size() * sizeof(float));
+	memcpy(indices.data(), mapped.indices(), indices.size() * sizeof(unsigned int));
+	double loadTime = secondsSince(start);
+	bool identical = vertices == mesh.vertices && indices == mesh.indices;
+	uint64_t meshSize = mapped.header().fileSize;
+	mapped.close();
+
+	remove(objPath);
+	remove(meshPath);
+	std::cout << "meshload: " << mesh.indices.size() / 3 << " triangles, " << mesh.vertexCount() << " vertices" << std::endl
+		<< "  obj   " << objSize / 1e6 << " MB, import " << importTime * 1e3 << " ms" << std::endl
+		<< "  mesh  " << meshSize / 1e6 << " MB, cook " << cookTime * 1e3 << " ms, map " << mapTime * 1e3
+		<< " ms, map + read " << loadTime * 1e3 << " ms (" << importTime / loadTime << "x faster, page cache warm)" << std::endl;
+	if (!identical)
+		std::cout << "  ERROR: cooked data differs from the imported mesh" << std::endl;
+	return identical ? 0 : -1;
+}
+
+// ------------------ NORMAL MATRICES ------------------
+static int benchmarkNormalMatrices()
+{
+	const int count = 100000;
+	const int repeats = 20;
+
+	srand(1);
+	// rotated and uniformly scaled like the cubes, every fourth one squashed
+	std::vector<glm::mat4> models(count);
+	for (int i = 0; i < count; i++)
+	{
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(randomFloat(-20.0f, 20.0f), randomFloat(-20.0f, 20.0f), randomFloat(-20.0f, 20.0f)));
+		model = glm::rotate(model, randomFloat(0.0f, 6.28f), glm::normalize(glm::vec3(randomFloat(-1.0f, 1.0f), 1.0f, randomFloat(-1.0f, 1.0f))));
+		models[i] = i % 4 == 3 ? glm::scale(model, glm::vec3(1.0f, randomFloat(0.2f, 3.0f), 1.0f)) : glm::scale(model, glm::vec3(randomFloat(0.2f, 3.0f)));
+	}
+
+	std::vector<glm::mat3> reference(count), batched(count);
+	Clock::time_point start = Clock::now();
+	for (int r = 0; r < repeats; r++)
+		for (int i = 0; i < count; i++)
+			reference[i] = glm::mat3(glm::transpose(glm::inverse(models[i])));
+	double inverseTime = secondsSince(start);
+
+	start = Clock::now();
+	for (int r = 0; r < repeats; r++)
+		computeNormalMatrices(models.data(), batched.data(), count);
+	double batchedTime = secondsSince(start);
+
+	float maxError = 0.0f;
+	for (int i = 0; i < count; i++)
+		for (int c = 0; c < 3; c++)
+		{
+			glm::vec3 difference = glm::abs(reference[i][c] - batched[i][c]);
+			maxError = std::max(maxError, std::max(difference.x, std::max(difference.y, difference.z)) / glm::length(reference[i][c]));
+		}
+
+	std::cout << "normals: 4x4 inverse " << inverseTime / repeats / count * 1e9 << " ns/matrix, batched SSE "
+		<< batchedTime / repeats / count * 1e9 << " ns/matrix (" << inverseTime / batchedTime << "x), max relative error " << maxError << std::endl;
+	return maxError < 1e-3f ? 0 : -1;
+}
+
+// ------------------ CLUSTERED LIGHTS ------------------
+static int benchmarkLightAssignment()
+{
+	const int frames = 100;
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	unsigned int lightCounts[] = { 256, 1024, 4096, 16384, 65535 };
+	unsigned int threadCounts[] = { 1, std::max(1u, std::thread::hardware_concurrency()) };
+	for (unsigned int lightCount : lightCounts)
+	{
+		srand(1);
+		std::vector<PointLight> lights(lightCount);
+		for (PointLight& light : lights)
+		{
+			light.position = glm::vec3(randomFloat(-30.0f, 30.0f), randomFloat(-6.0f, 6.0f), randomFloat(-70.0f, 2.0f));
+			light.radius = randomFloat(2.0f, 4.0f);
+		}
+		for (unsigned int threads : threadCounts)
+		{
+			ClusteredLights clusters(projection, 0.1f, 100.0f, threads);
+			Clock::time_point start = Clock::now();
+			for (int frame = 0; frame < frames; frame++)
+				clusters.assign(lights, view);
+			double time = secondsSince(start);
+
+			const ClusterStats& stats = clusters.stats();
+			std::cout << "lights " << lightCount << ", " << threads << " thread(s): " << time / frames * 1e3 << " ms/frame, "
+				<< stats.lights << " in view, " << stats.indices << " cluster entries, "
+				<< stats.averagePerCluster << " avg / " << stats.maxPerCluster << " max per cluster" << std::endl;
+		}
+	}
+	return 0;
+}
+
+// ------------------ INSTRUMENTATION ------------------
+static int benchmarkInstrumentation()
+{
+	const int events = 1000000;
+	const int eventsPerFrame = 1024;
+
+	// the same loop without the scope, the counter keeps it from being optimized out
+	volatile int counter = 0;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < events; i++)
+		counter = counter + 1;
+	double emptyTime = secondsSince(start);
+
+	InstrumentCollector collector;
+	double recordTime = 0.0, collectTime = 0.0;
+	for (int frame = 0; frame < events / eventsPerFrame; frame++)
+	{
+		start = Clock::now();
+		for (int i = 0; i < eventsPerFrame; i++)
+		{
+			INSTRUMENT_SCOPE("benchmark");
+			counter = counter + 1;
+		}
+		recordTime += secondsSince(start);
+
+		start = Clock::now();
+		collector.collectFrame();
+		collectTime += secondsSince(start);
+	}
+	int recorded = events / eventsPerFrame * eventsPerFrame;
+
+	std::cout << "instrument: " << (recordTime - emptyTime * recorded / events) / recorded * 1e9 << " ns/event recorded, "
+		<< collectTime / recorded * 1e9 << " ns/event collected, " << collector.droppedEvents() << " dropped"
+		<< (GRAFIKA_INSTRUMENT ? "" : " (compiled out)") << std::endl;
+	return 0;
+}
+
+// ------------------ LOGGING ------------------
+static int benchmarkLogging()
+{
+	const int messagesPerThread = 200000;
+	const int frames = 200;
+	const int messagesPerFrame = 200;
+	const char* path = "log_benchmark.txt";
+	const char* synchronousPath = "log_benchmark_endl.txt";
+
+	// throughput, the writer thread goes to a file instead of the console.
+	// Every 100th message is an error, none of them may be lost.
+	std::ofstream file(path);
+	logSetOutput(&file);
+	unsigned int threadCounts[] = { 1, 4 };
+	unsigned long long errorsLogged = 0;
+	for (unsigned int threads : threadCounts)
+	{
+		unsigned long long droppedBefore = logDropped(), synchronousBefore = logSynchronous();
+		Clock::time_point start = Clock::now();
+		std::vector<std::thread> producers;
+		for (unsigned int t = 0; t < threads; t++)
+			producers.emplace_back([t]
+			{
+				for (int i = 0; i < messagesPerThread; i++)
+				{
+					if (i % 100 == 0)
+						LOG_ERROR("ERROR::BENCH::FLOOD " << i << " on thread " << t);
+					else
+						LOG_INFO("lights: " << i << "/1024 in view, " << t << " thread, " << i * 0.5f << " ms frame");
+				}
+			});
+		for (std::thread& producer : producers)
+			producer.join();
+		double pushTime = secondsSince(start);
+		logFlush();
+		double totalTime = secondsSince(start);
+
+		unsigned long long dropped = logDropped() - droppedBefore;
+		double messages = (double)threads * messagesPerThread;
+		errorsLogged += threads * ((messagesPerThread + 99) / 100);
+		std::ifstream written(path);
+		std::string line;
+		unsigned long long errorsWritten = 0;
+		while (std::getline(written, line))
+			errorsWritten += line.find("ERROR::BENCH::FLOOD") != std::string::npos;
+		std::cout << "log, " << threads << " thread(s): " << messages / pushTime / 1e6 << " M messages/s pushed, "
+			<< (messages - dropped) / totalTime / 1e6 << " M messages/s written, " << dropped << " dropped (queue full), "
+			<< errorsWritten << "/" << errorsLogged << " errors written, " << logSynchronous() - synchronousBefore << " of them synchronously" << std::endl;
+	}
+
+	// added frame latency, the same work with 200 messages per frame logged
+	// asynchronously or written with endl to a file on the frame thread
+	std::vector<glm::mat4> models(20000, glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(0.0f, 1.0f, 0.0f)));
+	std::vector<glm::mat3> normals(models.size());
+	double frameTimes[3];
+	for (int mode = 0; mode < 3; mode++)
+	{
+		std::ofstream synchronous;
+		if (mode == 2)
+			synchronous.open(synchronousPath);
+		double time = 0.0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			Clock::time_point start = Clock::now();
+			computeNormalMatrices(models.data(), normals.data(), models.size());
+			for (int i = 0; i < messagesPerFrame; i++)
+			{
+				if (mode == 1)
+					LOG_INFO("frame " << frame << ": " << i << " draws, " << normals[i][0][0] << " ms");
+				else if (mode == 2)
+					synchronous << "frame " << frame << ": " << i << " draws, " << normals[i][0][0] << " ms" << std::endl;
+			}
+			time += secondsSince(start);
+			// the rest of the frame, the writer catches up meanwhile
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		frameTimes[mode] = time / frames * 1e3;
+		logFlush();
+	}
+	logSetOutput(nullptr);
+	file.close();
+	remove(path);
+	remove(synchronousPath);
+
+	std::cout << "log frame latency: " << frameTimes[0] << " ms without logging, +" << frameTimes[1] - frameTimes[0] << " ms async, +"
+		<< frameTimes[2] - frameTimes[0] << " ms with endl, " << messagesPerFrame << " messages/frame" << std::endl;
+	return 0;
+}
+
+// ------------------ UNIFORM NAMES ------------------
+// the lookup a setter does before its glUniform call, the old signature built a
+// std::string from the literal and the driver hashed the name once more
+static int lookupByString(const std::string& name, const std::unordered_map<std::string, int>& locations)
+{
+	std::unordered_map<std::string, int>::const_iterator found = locations.find(name);
+	return found == locations.end() ? -1 : found->second;
+}
+
+static int lookupByName(UniformName name, const UniformTable& table)
+{
+	return table.find(name);
+}
+
+static int benchmarkUniformNames()
+{
+	const int calls = 1000000;
+	const int callsPerIteration = 8;
+	const char* names[] = { "model", "view", "projection", "normalMatrix", "eyePos", "mixer", "lodFade",
+		"lightData", "lightGrid", "lightIndices", "clusterScale", "sliceScale", "sliceBias",
+		"shadowMap", "shadowMatrices", "cascadeSplits", "shadowTexelSizes", "material.diffuse", "material.shininess" };
+
+	UniformTable table;
+	std::unordered_map<std::string, int> locations;
+	int location = 0;
+	for (const char* name : names)
+	{
+		table.insert(name, strlen(name), location);
+		locations[name] = location++;
+	}
+	// array elements the way UniformTable::build enters them
+	for (int k = 0; k < 64; k++)
+	{
+		std::string element = "pointLights[" + std::to_string(k) + "].position";
+		table.insert(element.c_str(), element.size(), location);
+		locations[element] = location++;
+	}
+
+	volatile int sink = 0;
+	unsigned long long allocationsBefore = heapAllocationCount();
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < calls / callsPerIteration; i++)
+	{
+		sink = sink + lookupByString("model", locations);
+		sink = sink + lookupByString("normalMatrix", locations);
+		sink = sink + lookupByString("eyePos", locations);
+		sink = sink + lookupByString("lodFade", locations);
+		sink = sink + lookupByString("shadowTexelSizes", locations);
+		sink = sink + lookupByString("material.shininess", locations);
+		sink = sink + lookupByString("pointLights[17].position", locations);
+		sink = sink + lookupByString("notInTheProgram", locations);
+	}
+	double stringTime = secondsSince(start);
+	unsigned long long stringAllocations = heapAllocationCount() - allocationsBefore;
+
+	allocationsBefore = heapAllocationCount();
+	start = Clock::now();
+	for (int i = 0; i < calls / callsPerIteration; i++)
+	{
+		sink = sink + lookupByName("model", table);
+		sink = sink + lookupByName("normalMatrix", table);
+		sink = sink + lookupByName("eyePos", table);
+		sink = sink + lookupByName("lodFade", table);
+		sink = sink + lookupByName("shadowTexelSizes", table);
+		sink = sink + lookupByName("material.shininess", table);
+		sink = sink + lookupByName("pointLights[17].position", table);
+		sink = sink + lookupByName("notInTheProgram", table);
+	}
+	double nameTime = secondsSince(start);
+	unsigned long long nameAllocations = heapAllocationCount() - allocationsBefore;
+
+	static constexpr UniformName model = "model", normalMatrix = "normalMatrix", eyePos = "eyePos", lodFade = "lodFade",
+		shadowTexelSizes = "shadowTexelSizes", shininess = "material.shininess", pointLight = "pointLights[17].position",
+		missing = "notInTheProgram";
+	allocationsBefore = heapAllocationCount();
+	start = Clock::now();
+	for (int i = 0; i < calls / callsPerIteration; i++)
+	{
+		sink = sink + lookupByName(model, table);
+		sink = sink + lookupByName(normalMatrix, table);
+		sink = sink + lookupByName(eyePos, table);
+		sink = sink + lookupByName(lodFade, table);
+		sink = sink + lookupByName(shadowTexelSizes, table);
+		sink = sink + lookupByName(shininess, table);
+		sink = sink + lookupByName(pointLight, table);
+		sink = sink + lookupByName(missing, table);
+	}
+	double constantTime = secondsSince(start);
+	nameAllocations += heapAllocationCount() - allocationsBefore;
+
+	std::cout << "uniform names, " << calls << " setter lookups: std::string " << stringTime / calls * 1e9 << " ns/call, "
+		<< stringAllocations << " heap allocations; UniformName " << nameTime / calls * 1e9 << " ns/call from a literal, "
+		<< constantTime / calls * 1e9 << " ns/call constexpr, " << nameAllocations << " heap allocations ("
+		<< table.size() << " names in the table)" << std::endl;
+	return nameAllocations == 0 ? 0 : 1;
+}
+
+// ------------------ GEOMETRY ALLOCATOR ------------------
+// the bookkeeping side of GeometryPool, pages the size main uses them at scale
+static int benchmarkGeometryAllocator()
+{
+	const unsigned int verticesPerPage = 1 << 20;
+	const unsigned int indicesPerPage = 1 << 22;
+	const int meshCount = 10000;
+	const int churnRounds = 10;
+	const size_t vertexBytes = Mesh::vertexSize * sizeof(float);
+
+	struct Placed
+	{
+		unsigned int page;
+		RangeAllocator::Range vertices, indices;
+	};
+	std::vector<RangeAllocator> vertexPages, indexPages;
+	std::vector<Placed> meshes;
+	double allocateSeconds = 0.0, freeSeconds = 0.0, maxAllocateSeconds = 0.0;
+	unsigned int allocations = 0, frees = 0;
+
+	srand(1);
+	auto addMesh = [&]()
+	{
+		// log uniform, a few dozen to some thousands of vertices
+		unsigned int vertexCount = (unsigned int)(24.0f * powf(2.0f, randomFloat(0.0f, 9.0f)));
+		unsigned int indexCount = (unsigned int)(vertexCount * randomFloat(1.5f, 6.0f)) / 3 * 3;
+		Placed placed;
+		for (placed.page = 0; ; placed.page++)
+		{
+			if (placed.page == vertexPages.size())
+			{
+				vertexPages.push_back(RangeAllocator(verticesPerPage));
+				indexPages.push_back(RangeAllocator(indicesPerPage));
+			}
+			Clock::time_point start = Clock::now();
+			placed.vertices = vertexPages[placed.page].allocate(vertexCount);
+			placed.indices = indexPages[placed.page].allocate(indexCount);
+			double seconds = secondsSince(start);
+			allocateSeconds += seconds;
+			maxAllocateSeconds = std::max(maxAllocateSeconds, seconds);
+			allocations += 2;
+			if (placed.vertices.offset != RangeAllocator::Invalid && placed.indices.offset != RangeAllocator::Invalid)
+				break;
+			vertexPages[placed.page].free(placed.vertices);
+			indexPages[placed.page].free(placed.indices);
+		}
+		meshes.push_back(placed);
+	};
+	// free space outside the largest free range of its page, in percent of the capacity,
+	// and the number of free ranges. Full pages score high on RangeAllocator::fragmentation
+	// with only crumbs left, this says how much memory the holes actually hold.
+	auto holes = [&](unsigned int& ranges)
+	{
+		double holeBytes = 0.0, capacityBytes = 0.0;
+		ranges = 0;
+		for (size_t p = 0; p < vertexPages.size(); p++)
+		{
+			const RangeAllocator* sides[2] = { &vertexPages[p], &indexPages[p] };
+			const size_t unitBytes[2] = { vertexBytes, sizeof(unsigned int) };
+			for (int k = 0; k < 2; k++)
+			{
+				holeBytes += (double)(sides[k]->capacity() - sides[k]->used() - sides[k]->largestFree()) * unitBytes[k];
+				capacityBytes += (double)sides[k]->capacity() * unitBytes[k];
+				ranges += sides[k]->freeRangeCount();
+			}
+		}
+		return (float)(holeBytes / capacityBytes * 100.0);
+	};
+
+	for (int i = 0; i < meshCount; i++)
+		addMesh();
+	unsigned int pagesAfterLoad = (unsigned int)vertexPages.size();
+
+	// streaming: a third of the meshes replaced per round
+	for (int round = 0; round < churnRounds; round++)
+	{
+		for (int i = 0; i < meshCount / 3; i++)
+		{
+			size_t victim = rand() % meshes.size();
+			Clock::time_point start = Clock::now();
+			vertexPages[meshes[victim].page].free(meshes[victim].vertices);
+			indexPages[meshes[victim].page].free(meshes[victim].indices);
+			freeSeconds += secondsSince(start);
+			frees += 2;
+			meshes[victim] = meshes.back();
+			meshes.pop_back();
+		}
+		for (int i = 0; i < meshCount / 3; i++)
+			addMesh();
+	}
+	unsigned int rangesBefore, rangesAfter;
+	float holesBefore = holes(rangesBefore);
+
+	// what GeometryPool::defragment would copy with glCopyBufferSubData, no budget.
+	// The vertex and index sides are compacted on their own, highest range first.
+	size_t movedBytes = 0;
+	Clock::time_point start = Clock::now();
+	std::sort(meshes.begin(), meshes.end(), [](const Placed& a, const Placed& b)
+		{ return a.page != b.page ? a.page < b.page : a.vertices.offset > b.vertices.offset; });
+	for (Placed& placed : meshes)
+	{
+		RangeAllocator::Range vertices = vertexPages[placed.page].relocate(placed.vertices);
+		if (vertices.offset != placed.vertices.offset)
+			movedBytes += vertices.size * vertexBytes;
+		placed.vertices = vertices;
+	}
+	std::sort(meshes.begin(), meshes.end(), [](const Placed& a, const Placed& b)
+		{ return a.page != b.page ? a.page < b.page : a.indices.offset > b.indices.offset; });
+	for (Placed& placed : meshes)
+	{
+		RangeAllocator::Range indices = indexPages[placed.page].relocate(placed.indices);
+		if (indices.offset != placed.indices.offset)
+			movedBytes += indices.size * sizeof(unsigned int);
+		placed.indices = indices;
+	}
+	double compactSeconds = secondsSince(start);
+
+	std::cout << "geometry allocator: " << allocateSeconds / allocations * 1e9 << " ns/allocate (max "
+		<< maxAllocateSeconds * 1e6 << " us per mesh), " << freeSeconds / frees * 1e9 << " ns/free" << std::endl;
+	std::cout << "geometry allocator: " << meshes.size() << " meshes in " << vertexPages.size() * 2 << " GL buffers ("
+		<< pagesAfterLoad * 2 << " after the first load) instead of " << meshes.size() * 2 << " with a buffer pair per mesh" << std::endl;
+	float holesAfter = holes(rangesAfter);
+	std::cout << "geometry allocator: after " << churnRounds << " rounds of churn " << holesBefore << "% of the memory in "
+		<< rangesBefore << " holes, compacted " << holesAfter << "% in " << rangesAfter << ", " << movedBytes / (1024.0 * 1024.0)
+		<< " MB moved, " << compactSeconds * 1e3 << " ms of bookkeeping" << std::endl;
+	return 0;
+}
+
+// ------------------ TEXTURE ATLAS ------------------
+static int benchmarkTextureAtlas()
+{
+	const int imageCount = 4000;
+	const int atlasSize = 1024;
+
+	// icons and glyphs, 4 to 64 texels a side
+	struct Image
+	{
+		int width, height;
+		int atlas, entry;
+	};
+	std::vector<Image> images(imageCount);
+	srand(1);
+	for (Image& image : images)
+	{
+		image.width = (int)(4.0f * powf(2.0f, randomFloat(0.0f, 4.0f)));
+		image.height = (int)(4.0f * powf(2.0f, randomFloat(0.0f, 4.0f)));
+	}
+	std::vector<unsigned char> pixels(64 * 64 * 4, 255);
+
+	// every image goes into the first atlas with room, a new one when none has
+	auto build = [&](const std::vector<Image*>& order, int maxMipLevel, std::vector<std::unique_ptr<TextureAtlas>>& atlases)
+	{
+		Clock::time_point start = Clock::now();
+		for (Image* image : order)
+		{
+			image->entry = -1;
+			for (image->atlas = 0; image->entry < 0; image->atlas++)
+			{
+				if (image->atlas == (int)atlases.size())
+					atlases.emplace_back(new TextureAtlas(atlasSize, atlasSize, maxMipLevel));
+				image->entry = atlases[image->atlas]->add(pixels.data(), image->width, image->height);
+			}
+			image->atlas--;
+		}
+		return secondsSince(start);
+	};
+	// the last atlas is partly empty, the occupancy is that of the full ones
+	auto report = [&](const char* label, const std::vector<std::unique_ptr<TextureAtlas>>& atlases, double seconds)
+	{
+		float occupancy = 0.0f, packed = 0.0f;
+		size_t full = std::max(atlases.size() - 1, (size_t)1);
+		for (size_t k = 0; k < full; k++)
+		{
+			occupancy += atlases[k]->stats().occupancy;
+			packed += atlases[k]->stats().packed;
+		}
+		std::cout << "texture atlas: " << label << ", " << atlases.size() << " atlases of " << atlasSize << "x" << atlasSize
+			<< ", " << occupancy / full * 100.0f << "% images, " << packed / full * 100.0f << "% with borders, "
+			<< seconds / imageCount * 1e6 << " us per image" << std::endl;
+	};
+
+	// streamed content arrives in any order, a load time build sorts by height first
+	std::vector<Image*> order;
+	for (Image& image : images)
+		order.push_back(&image);
+	std::vector<std::unique_ptr<TextureAtlas>> incremental, unfiltered, sorted;
+	report("mip level 2 safe, arrival order", incremental, build(order, 2, incremental));
+	std::stable_sort(order.begin(), order.end(), [](const Image* a, const Image* b) { return a->height > b->height; });
+	report("no mipmaps, sorted by height", unfiltered, build(order, 0, unfiltered));
+	report("mip level 2 safe, sorted by height", sorted, build(order, 2, sorted));
+
+	// draw every image once in a random order: a texture per image binds before each
+	// draw, with atlases only when the atlas changes and not at all sorted by atlas
+	unsigned int atlasBinds = 0;
+	int boundAtlas = -1;
+	for (int i = 0; i < imageCount; i++)
+	{
+		const Image& image = images[rand() % imageCount];
+		atlasBinds += image.atlas != boundAtlas;
+		boundAtlas = image.atlas;
+	}
+	std::cout << "texture atlas: " << imageCount << " texture binds without atlases, " << atlasBinds << " in draw order, "
+		<< sorted.size() << " sorted by atlas" << std::endl;
+
+	// a cube's texture coordinates moved into its image, they must stay inside it
+	Mesh cube = Mesh::fromTriangleList(Cube::vertices, Cube::vertexCount);
+	const Image& first = images[0];
+	const AtlasEntry& entry = sorted[first.atlas]->entry(first.entry);
+	sorted[first.atlas]->remapUVs(cube, first.entry);
+	bool inside = true;
+	for (unsigned int v = 0; v < cube.vertexCount(); v++)
+	{
+		glm::vec2 uv = (glm::vec2(cube.vertices[v * Mesh::vertexSize + 3], cube.vertices[v * Mesh::vertexSize + 4]) - entry.offset) / entry.scale;
+		inside = inside && uv.x >= -1e-4f && uv.x <= 1.0001f && uv.y >= -1e-4f && uv.y <= 1.0001f;
+	}
+	std::cout << "texture atlas: remapped cube UVs " << (inside ? "inside" : "OUTSIDE") << " their image" << std::endl;
+	return inside ? 0 : 1;
+}
+
+// ------------------ LOD CROSSFADE ------------------
+static int benchmarkLodFade()
+{
+	// the two dithered draws of a fading sphere, every pixel of the 4x4 pattern by exactly one of them
+	auto covered = [](float fade)
+	{
+		for (int y = 0; y < 4; y++)
+			for (int x = 0; x < 4; x++)
+				if (lodFadeDraws(x, y, fade, false) == lodFadeDraws(x, y, fade, true))
+					return false;
+		return true;
+	};
+	bool complete = covered(0.0f) && covered(-0.0f);
+	for (int step = 0; step < 1024; step++)
+		complete = complete && covered(step / 1024.0f);
+
+	// a sphere moved back and forth across its switching distances at 60 Hz
+	std::vector<MeshLod> lods = { { 0, 0, 0.0f }, { 0, 0, 0.01f }, { 0, 0, 0.04f }, { 0, 0, 0.16f } };
+	LodSelector selector(720.0f, glm::radians(45.0f));
+	LodState state = { 0, 0, 1.0f };
+	const float deltaTime = 1.0f / 60.0f;
+	int switches = 0, fadeFrames = 0;
+	for (int frame = 0; frame < 6000; frame++)
+	{
+		float distance = 1.0f + 200.0f * (0.5f - 0.5f * std::cos(frame * 0.005f));
+		unsigned int before = state.lod;
+		selector.update(state, lods, distance, deltaTime);
+		switches += state.lod != before;
+		if (state.fade < 1.0f)
+		{
+			fadeFrames++;
+			// the switching frame already draws part of the new level
+			complete = complete && covered(state.fade) && (state.lod == before || state.fade > 0.0f);
+		}
+	}
+
+	std::cout << "lod: " << switches << " switches, " << fadeFrames << " crossfade frames, dither masks "
+		<< (complete ? "cover every pixel once" : "LEAVE GAPS OR OVERLAP") << std::endl;
+	return complete ? 0 : 1;
+}
+
+// ------------------ MIP GENERATION ------------------
+static int benchmarkMipGeneration()
+{
+	const int size = 2048;
+	const int repeats = 5;
+
+	// noise over smooth gradients, the Kaiser filter has something to keep
+	std::vector<unsigned char> pixels((size_t)size * size * 4);
+	srand(1);
+	for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++)
+		{
+			unsigned char* texel = &pixels[((size_t)y * size + x) * 4];
+			texel[0] = (unsigned char)(x * 255 / size);
+			texel[1] = (unsigned char)(y * 255 / size);
+			texel[2] = (unsigned char)(rand() & 255);
+			texel[3] = (unsigned char)(((x / 32 + y / 32) & 1) * 255);
+		}
+	const double megatexels = (double)size * size / 1e6;
+
+	const MipFilter filters[] = { MipBox, MipKaiser };
+	const char* filterNames[] = { "box", "kaiser" };
+	const MipKernel kernels[] = { MipKernelScalar, MipKernelSSE, MipKernelAVX2 };
+	const char* kernelNames[] = { "scalar", "sse", "avx2" };
+	const unsigned int threadCounts[] = { 1, std::max(1u, std::thread::hardware_concurrency()) };
+	bool identical = true;
+	for (int f = 0; f < 2; f++)
+	{
+		MipChain reference;
+		for (int k = 0; k < 3; k++)
+		{
+			if (!mipKernelSupported(kernels[k]))
+			{
+				std::cout << "mips: " << kernelNames[k] << " not supported by this CPU" << std::endl;
+				continue;
+			}
+			for (int t = 0; t < 2; t++)
+			{
+				// one core, nothing to compare
+				if (t && threadCounts[1] == 1)
+					continue;
+				const unsigned int threads = threadCounts[t];
+				MipOptions options(filters[f], true);
+				options.kernel = kernels[k];
+				options.threads = threads;
+				MipChain chain;
+				double best = 1e9;
+				for (int r = 0; r < repeats; r++)
+				{
+					chain.generate(pixels.data(), size, size, options);
+					best = std::min(best, chain.milliseconds());
+				}
+				// the SIMD kernels do the scalar arithmetic in the same order
+				if (!reference.levelCount())
+					reference.generate(pixels.data(), size, size, options);
+				bool same = memcmp(chain.level(1), reference.level(1), chain.bytes() - (size_t)size * size * 4) == 0;
+				identical = identical && same;
+				std::cout << "mips: " << filterNames[f] << " " << kernelNames[k] << " " << threads << " thread(s): " << best << " ms per "
+					<< size << "^2 chain, " << megatexels / best * 1e3 << " Mtexel/s" << (same ? "" : ", DIFFERS from scalar") << std::endl;
+			}
+		}
+	}
+
+	// the driver's filter on a hidden window's context, glFinish waits for the work
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "mips", NULL, NULL);
+	if (window)
+	{
+		glfwMakeContextCurrent(window);
+		gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		const GLenum formats[] = { GL_RGBA8, GL_SRGB8_ALPHA8 };
+		const char* formatNames[] = { "RGBA8", "SRGB8_ALPHA8" };
+		for (int format = 0; format < 2; format++)
+		{
+			double best = 1e9;
+			for (int r = 0; r < repeats; r++)
+			{
+				glTexImage2D(GL_TEXTURE_2D, 0, formats[format], size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+				glFinish();
+				Clock::time_point start = Clock::now();
+				glGenerateMipmap(GL_TEXTURE_2D);
+				glFinish();
+				best = std::min(best, secondsSince(start) * 1e3);
+			}
+			std::cout << "mips: glGenerateMipmap " << formatNames[format] << " on " << (const char*)glGetString(GL_RENDERER) << ": "
+				<< best << " ms per " << size << "^2 chain, " << megatexels / best * 1e3 << " Mtexel/s" << std::endl;
+		}
+		glDeleteTextures(1, &texture);
+		glfwDestroyWindow(window);
+	}
+	else
+		std::cout << "mips: no GL context, glGenerateMipmap skipped" << std::endl;
+	glfwTerminate();
+	return identical ? 0 : 1;
+}
+
+int runBenchmark(const std::string& name)
+{
+	if (name == "raster")
+		return benchmarkRasterizer();
+	if (name == "meshload")
+		return benchmarkMeshLoading();
+	if (name == "normals")
+		return benchmarkNormalMatrices();
+	if (name == "lights")
+		return benchmarkLightAssignment();
+	if (name == "instrument")
+		return benchmarkInstrumentation();
+	if (name == "log")
+		return benchmarkLogging();
+	if (name == "uniforms")
+		return benchmarkUniformNames();
+	if (name == "geometry")
+		return benchmarkGeometryAllocator();
+	if (name == "atlas")
+		return benchmarkTextureAtlas();
+	if (name == "mips")
+		return benchmarkMipGeneration();
+	if (name == "lod")
+		return benchmarkLodFade();
+
+	std::cout << "Unknown benchmark: " << name << std::endl;
+	return -1;
+}
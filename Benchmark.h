@@ -0,0 +1,6 @@
+#pragma once
+
+#include <string>
+
+// Offline benchmarks, run with "grafika-projekt --bench <name>" before any window is created.
+int runBenchmark(const std::string& name);
@@ -0,0 +1,253 @@
+#include "CascadedShadows.h"
+#include "Instrument.h"
+#include "Log.h"
+#include "Occlusion.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+namespace
+{
+	// weight of the logarithmic split scheme against the uniform one
+	const float splitLambda = 0.75f;
+}
+
+CascadedShadows::CascadedShadows(int cascadeCount, int resolution, float shadowDistance)
+	: cascadeCount(std::max(1, std::min(cascadeCount, (int)MaxCascades))), resolution(resolution),
+	shadowDistance(shadowDistance), lightDirection(0.0f), lightView(1.0f), frame(0)
+{
+	for (Cascade& cascade : cascades)
+	{
+		cascade = Cascade();
+		cascade.staticValid = cascade.hasDynamic = cascade.staticRendered = false;
+		cascade.queries[0] = cascade.queries[1] = 0;
+		cascade.queryPending[0] = cascade.queryPending[1] = false;
+	}
+}
+
+void CascadedShadows::createTargets()
+{
+	shadowMap = TextureHandle::create();
+	staticMap = TextureHandle::create();
+	const TextureHandle* textures[2] = { &shadowMap, &staticMap };
+	for (const TextureHandle* texture : textures)
+	{
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture->get());
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, cascadeCount, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+		// DEPTH24 is stored in four bytes
+		texture->setBytes((size_t)resolution * resolution * cascadeCount * 4);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	// bilinear compare, every tap of the 3x3 kernel is already a 2x2 PCF. Outside the map is lit.
+	const float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.get());
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	FramebufferHandle::create(framebuffers, 2);
+	for (int k = 0; k < 2; k++)
+	{
+		attachLayer(framebuffers[k].get(), k == 0 ? shadowMap.get() : staticMap.get(), 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			LOG_ERROR("ERROR::SHADOWS::FRAMEBUFFER_INCOMPLETE");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	for (int c = 0; c < cascadeCount; c++)
+	{
+		glGenQueries(2, cascades[c].queries);
+		cascades[c].staticValid = false;
+	}
+}
+
+void CascadedShadows::release()
+{
+	if (!shadowMap)
+		return;
+	shadowMap.reset();
+	staticMap.reset();
+	framebuffers[0].reset();
+	framebuffers[1].reset();
+	for (int c = 0; c < cascadeCount; c++)
+	{
+		glDeleteQueries(2, cascades[c].queries);
+		cascades[c].queries[0] = cascades[c].queries[1] = 0;
+		cascades[c].queryPending[0] = cascades[c].queryPending[1] = false;
+	}
+}
+
+void CascadedShadows::attachLayer(unsigned int framebuffer, unsigned int texture, int layer)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+}
+
+void CascadedShadows::update(const glm::mat4& view, float fovY, float aspect, float zNear, const glm::vec3& lightDir)
+{
+	INSTRUMENT_SCOPE("shadow cascades");
+	frame++;
+	glm::vec3 direction = glm::normalize(lightDir);
+	if (direction != lightDirection)
+	{
+		lightDirection = direction;
+		glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+		for (Cascade& cascade : cascades)
+			cascade.staticValid = false;
+	}
+
+	glm::mat4 cameraToWorld = glm::inverse(view);
+	float tanY = std::tan(fovY * 0.5f), tanX = tanY * aspect;
+	float diagonal2 = tanX * tanX + tanY * tanY; // squared half diagonal per unit of depth
+	float splitNear = zNear;
+	for (int c = 0; c < cascadeCount; c++)
+	{
+		Cascade& cascade = cascades[c];
+		float p = (c + 1) / (float)cascadeCount;
+		float logarithmic = zNear * std::pow(shadowDistance / zNear, p);
+		float uniform = zNear + (shadowDistance - zNear) * p;
+		cascade.splitFar = uniform + (logarithmic - uniform) * splitLambda;
+
+		// smallest sphere around the slice, its center is on the view axis where the
+		// near and far corners are equally far. Depends only on the splits and the
+		// projection, so the cascade size never changes.
+		float n = splitNear, f = cascade.splitFar;
+		float nearRadius2 = n * n * diagonal2, farRadius2 = f * f * diagonal2;
+		float centerDepth = std::min(f, (farRadius2 - nearRadius2 + f * f - n * n) / (2.0f * (f - n)));
+		float radius = std::sqrt(farRadius2 + (f - centerDepth) * (f - centerDepth));
+		splitNear = f;
+
+		// whole texels in light space, z included so an unmoved cascade compares equal
+		float texel = 2.0f * radius / resolution;
+		glm::vec3 center = glm::vec3(lightView * cameraToWorld * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+		center = glm::floor(center / texel) * texel;
+		cascade.center = center;
+		cascade.radius = radius;
+		cascade.projection = glm::ortho(center.x - radius, center.x + radius, center.y - radius, center.y + radius,
+			-(center.z + radius), -(center.z - radius));
+		if (center != cascade.renderedCenter || radius != cascade.renderedRadius)
+			cascade.staticValid = false;
+	}
+}
+
+bool CascadedShadows::casterVisible(int cascade, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	const Cascade& box = cascades[cascade];
+	glm::vec3 lightMin, lightMax;
+	OcclusionCuller::transformAabb(lightView, boundsMin, boundsMax, lightMin, lightMax);
+	return lightMax.x >= box.center.x - box.radius && lightMin.x <= box.center.x + box.radius
+		&& lightMax.y >= box.center.y - box.radius && lightMin.y <= box.center.y + box.radius
+		&& lightMax.z >= box.center.z - box.radius;
+}
+
+void CascadedShadows::beginCascade(int cascade)
+{
+	Cascade& current = cascades[cascade];
+	// the query of two frames ago has long finished
+	int slot = frame & 1;
+	if (current.queryPending[slot])
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(current.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(current.queries[slot], GL_QUERY_RESULT, &nanoseconds);
+			current.stats.gpuMilliseconds = nanoseconds / 1e6f;
+		}
+	}
+	glBeginQuery(GL_TIME_ELAPSED, current.queries[slot]);
+	current.queryPending[slot] = true;
+
+	current.stats.drawCalls = 0;
+	current.stats.staticCached = true;
+	current.stats.skipped = false;
+	current.staticRendered = false;
+
+	glViewport(0, 0, resolution, resolution);
+	// casters in front of the cascade box are flattened onto its near plane
+	glEnable(GL_DEPTH_CLAMP);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+}
+
+bool CascadedShadows::beginStatic(int cascade)
+{
+	Cascade& current = cascades[cascade];
+	if (current.staticValid)
+		return false;
+	attachLayer(framebuffers[0].get(), staticMap.get(), cascade);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	current.staticValid = true;
+	current.staticRendered = true;
+	current.renderedCenter = current.center;
+	current.renderedRadius = current.radius;
+	current.stats.staticCached = false;
+	return true;
+}
+
+bool CascadedShadows::beginDynamic(int cascade, bool hasDynamicCasters)
+{
+	Cascade& current = cascades[cascade];
+	if (!current.staticRendered && !current.hasDynamic && !hasDynamicCasters)
+	{
+		current.stats.skipped = true;
+		return false;
+	}
+	attachLayer(framebuffers[1].get(), staticMap.get(), cascade);
+	attachLayer(framebuffers[0].get(), shadowMap.get(), cascade);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[1].get());
+	glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[0].get());
+	current.hasDynamic = hasDynamicCasters;
+	return hasDynamicCasters;
+}
+
+void CascadedShadows::endCascade(int cascade, unsigned int drawCalls)
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	cascades[cascade].stats.drawCalls = drawCalls;
+}
+
+void CascadedShadows::endShadowPass()
+{
+	glDisable(GL_DEPTH_CLAMP);
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CascadedShadows::bind(const Shader& shader, int unit) const
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.get());
+	glActiveTexture(GL_TEXTURE0);
+	shader.setInt("shadowMap", unit);
+	shader.setInt("cascadeCount", cascadeCount);
+
+	// the matrices go up as one array, no per element uniform names
+	glm::vec4 splits(0.0f), texelSizes(0.0f);
+	glm::mat4 matrices[MaxCascades];
+	for (int c = 0; c < cascadeCount; c++)
+	{
+		splits[c] = cascades[c].splitFar;
+		texelSizes[c] = 2.0f * cascades[c].radius / resolution;
+		matrices[c] = cascades[c].projection * lightView;
+	}
+	glUniformMatrix4fv(shader.location("shadowMatrices"), cascadeCount, GL_FALSE, &matrices[0][0][0]);
+	shader.setVec4("cascadeSplits", splits);
+	shader.setVec4("shadowTexelSizes", texelSizes);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "GpuResources.h"
+#include "Shader.h"
+
+#include <glm/glm.hpp>
+
+struct CascadeStats
+{
+	unsigned int drawCalls;
+	float gpuMilliseconds; // from the previous frame the timer query was read back
+	bool staticCached;     // static casters reused from an earlier frame
+	bool skipped;          // nothing rendered, the whole layer was still valid
+};
+
+// Cascaded shadow maps of the directional light. The view frustum up to
+// shadowDistance is split into 1-4 cascades, each bounded by a sphere so its
+// size does not change with the camera rotation, and its origin is snapped to
+// whole texels so the shadows do not shimmer when the camera moves.
+//
+// Every cascade has two depth layers: the static casters alone, rendered again
+// only when the cascade moved, and the shadow map proper, a copy of the static
+// layer with the dynamic casters on top. Sampled with hardware compare and a
+// 3x3 PCF kernel.
+class CascadedShadows
+{
+public:
+	static const int MaxCascades = 4;
+
+	CascadedShadows(int cascadeCount, int resolution, float shadowDistance);
+
+	// GL side, needs a context
+	void createTargets();
+	void release();
+
+	void update(const glm::mat4& view, float fovY, float aspect, float zNear, const glm::vec3& lightDir);
+
+	int getCascadeCount() const { return cascadeCount; }
+	const glm::mat4& getProjection(int cascade) const { return cascades[cascade].projection; }
+	const glm::mat4& getLightView() const { return lightView; }
+
+	// world space AABB against the cascade box, casters between the light and the
+	// box are kept, depth clamping flattens them onto the near plane
+	bool casterVisible(int cascade, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+	// Per cascade, between beginCascade and endCascade: beginStatic returns true
+	// when the static casters have to be drawn, beginDynamic the same for the
+	// dynamic ones. Sets up the framebuffer, viewport and depth state.
+	void beginCascade(int cascade);
+	bool beginStatic(int cascade);
+	bool beginDynamic(int cascade, bool hasDynamicCasters);
+	void endCascade(int cascade, unsigned int drawCalls);
+	// restores the depth state, the caller binds its framebuffer again
+	void endShadowPass();
+
+	// the shadow map array to unit, splits and matrices for lighting.glsl
+	void bind(const Shader& shader, int unit) const;
+
+	const CascadeStats& stats(int cascade) const { return cascades[cascade].stats; }
+
+private:
+	struct Cascade
+	{
+		float splitFar;
+		float radius;
+		glm::vec3 center;          // light space, snapped to texels
+		glm::mat4 projection;
+
+		glm::vec3 renderedCenter;  // of the static layer
+		float renderedRadius;
+		bool staticValid;
+		bool hasDynamic;           // the shadow map layer holds dynamic casters
+		bool staticRendered;       // this frame
+
+		unsigned int queries[2];
+		bool queryPending[2];
+		CascadeStats stats;
+	};
+
+	void attachLayer(unsigned int framebuffer, unsigned int texture, int layer);
+
+	int cascadeCount, resolution;
+	float shadowDistance;
+	glm::vec3 lightDirection;
+	glm::mat4 lightView;
+	Cascade cascades[MaxCascades];
+	unsigned int frame;
+
+	TextureHandle shadowMap, staticMap;
+	FramebufferHandle framebuffers[2]; // draw, read for copying the static layer
+};
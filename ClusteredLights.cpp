@@ -0,0 +1,291 @@
+#include "ClusteredLights.h"
+#include "Instrument.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+
+ClusteredLights::ClusteredLights(const glm::mat4& projection, float zNear, float zFar, unsigned int threadCount)
+	: sliceIndices(ClustersZ), grid(ClusterCount * 2, 0), generation(0), busy(0), quit(false), nextSlice(0)
+{
+	setProjection(projection, zNear, zFar);
+	clusterStats = ClusterStats{ 0, 0, 0, 0.0f };
+
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	// the calling thread fills slices too
+	for (unsigned int i = 1; i < threadCount; i++)
+		workers.push_back(std::thread(&ClusteredLights::workerLoop, this));
+}
+
+ClusteredLights::~ClusteredLights()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void ClusteredLights::setProjection(const glm::mat4& projection, float zNear, float zFar)
+{
+	projectionX = projection[0][0];
+	projectionY = projection[1][1];
+	this->zNear = zNear;
+	this->zFar = zFar;
+	// slice = floor(log(depth / near) / log(far / near) * ClustersZ)
+	sliceScale = ClustersZ / std::log(zFar / zNear);
+	sliceBias = -std::log(zNear) * sliceScale;
+}
+
+int ClusteredLights::depthSlice(float depth) const
+{
+	return std::min(ClustersZ - 1, std::max(0, (int)(std::log(depth) * sliceScale + sliceBias)));
+}
+
+void ClusteredLights::assign(const std::vector<PointLight>& lights, const glm::mat4& view)
+{
+	boundLights(lights, view);
+
+	nextSlice = 0;
+	if (!workers.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy = (unsigned int)workers.size();
+			generation++;
+		}
+		wake.notify_all();
+	}
+
+	runSlices();
+
+	if (!workers.empty())
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return busy == 0; });
+	}
+
+	// slice lists were filled with slice relative offsets
+	indices.clear();
+	clusterStats = ClusterStats{ 0, 0, 0, 0.0f };
+	unsigned int usedClusters = 0;
+	for (int z = 0; z < ClustersZ; z++)
+	{
+		unsigned int base = (unsigned int)indices.size();
+		indices.insert(indices.end(), sliceIndices[z].begin(), sliceIndices[z].end());
+		for (int cluster = z * ClustersX * ClustersY; cluster < (z + 1) * ClustersX * ClustersY; cluster++)
+		{
+			grid[cluster * 2] += base;
+			unsigned int count = grid[cluster * 2 + 1];
+			clusterStats.maxPerCluster = std::max(clusterStats.maxPerCluster, count);
+			usedClusters += count > 0;
+		}
+	}
+	for (const LightBounds& light : bounds)
+		clusterStats.lights += light.minZ <= light.maxZ;
+	clusterStats.indices = (unsigned int)indices.size();
+	clusterStats.averagePerCluster = usedClusters ? indices.size() / (float)usedClusters : 0.0f;
+}
+
+void ClusteredLights::boundLights(const std::vector<PointLight>& lights, const glm::mat4& view)
+{
+	INSTRUMENT_SCOPE("light bounds");
+	// light indices are 16 bit in the shader
+	size_t count = std::min(lights.size(), (size_t)65535);
+	bounds.resize(count);
+
+	const __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f);
+	const __m128 nearPlane = _mm_set1_ps(zNear), farPlane = _mm_set1_ps(zFar);
+	const __m128 tilesX = _mm_set1_ps((float)ClustersX), tilesY = _mm_set1_ps((float)ClustersY);
+	const __m128 lastX = _mm_set1_ps(ClustersX - 1.0f), lastY = _mm_set1_ps(ClustersY - 1.0f);
+	const __m128 scaleX = _mm_set1_ps(projectionX), scaleY = _mm_set1_ps(projectionY);
+	auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+	auto tile = [&](__m128 ndc, __m128 tiles, __m128 last) {
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(ndc, half), half), tiles);
+		return _mm_cvttps_epi32(_mm_max_ps(zero, _mm_min_ps(last, t)));
+	};
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		// four lights as x, y, z, radius lanes, the tail repeats the last light
+		float px[4], py[4], pz[4], pr[4];
+		for (int k = 0; k < 4; k++)
+		{
+			const PointLight& light = lights[std::min(i + k, count - 1)];
+			px[k] = light.position.x;
+			py[k] = light.position.y;
+			pz[k] = light.position.z;
+			pr[k] = light.radius;
+		}
+		__m128 x = _mm_loadu_ps(px), y = _mm_loadu_ps(py), z = _mm_loadu_ps(pz), r = _mm_loadu_ps(pr);
+
+		__m128 vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(view[0][0])), _mm_mul_ps(y, _mm_set1_ps(view[1][0]))),
+			_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(view[2][0])), _mm_set1_ps(view[3][0])));
+		__m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(view[0][1])), _mm_mul_ps(y, _mm_set1_ps(view[1][1]))),
+			_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(view[2][1])), _mm_set1_ps(view[3][1])));
+		__m128 vz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(view[0][2])), _mm_mul_ps(y, _mm_set1_ps(view[1][2]))),
+			_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(view[2][2])), _mm_set1_ps(view[3][2])));
+
+		// depth range of the sphere, clipped to the near plane
+		__m128 depth = _mm_sub_ps(zero, vz);
+		__m128 nearest = _mm_max_ps(_mm_sub_ps(depth, r), nearPlane);
+		__m128 farthest = _mm_add_ps(depth, r);
+
+		// conservative screen bounds of the view space box around the sphere:
+		// negative edges are widest at the nearest depth, positive ones at the farthest
+		__m128 invNearest = _mm_div_ps(one, nearest), invFarthest = _mm_div_ps(one, farthest);
+		__m128 left = _mm_sub_ps(vx, r), right = _mm_add_ps(vx, r);
+		__m128 bottom = _mm_sub_ps(vy, r), top = _mm_add_ps(vy, r);
+		__m128 minX = _mm_mul_ps(scaleX, _mm_mul_ps(left, select(_mm_cmplt_ps(left, zero), invNearest, invFarthest)));
+		__m128 maxX = _mm_mul_ps(scaleX, _mm_mul_ps(right, select(_mm_cmpgt_ps(right, zero), invNearest, invFarthest)));
+		__m128 minY = _mm_mul_ps(scaleY, _mm_mul_ps(bottom, select(_mm_cmplt_ps(bottom, zero), invNearest, invFarthest)));
+		__m128 maxY = _mm_mul_ps(scaleY, _mm_mul_ps(top, select(_mm_cmpgt_ps(top, zero), invNearest, invFarthest)));
+
+		__m128 visible = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(farthest, nearPlane), _mm_cmplt_ps(_mm_sub_ps(depth, r), farPlane)),
+			_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(maxX, minusOne), _mm_cmple_ps(minX, one)),
+				_mm_and_ps(_mm_cmpge_ps(maxY, minusOne), _mm_cmple_ps(minY, one))));
+
+		int tileMinX[4], tileMaxX[4], tileMinY[4], tileMaxY[4];
+		float nearDepth[4], farDepth[4];
+		_mm_storeu_si128((__m128i*)tileMinX, tile(minX, tilesX, lastX));
+		_mm_storeu_si128((__m128i*)tileMaxX, tile(maxX, tilesX, lastX));
+		_mm_storeu_si128((__m128i*)tileMinY, tile(minY, tilesY, lastY));
+		_mm_storeu_si128((__m128i*)tileMaxY, tile(maxY, tilesY, lastY));
+		_mm_storeu_ps(nearDepth, nearest);
+		_mm_storeu_ps(farDepth, _mm_min_ps(farthest, farPlane));
+		int visibleMask = _mm_movemask_ps(visible);
+
+		for (int k = 0; k < 4 && i + k < count; k++)
+		{
+			LightBounds& b = bounds[i + k];
+			if (visibleMask & (1 << k))
+				b = LightBounds{ tileMinX[k], tileMinY[k], depthSlice(nearDepth[k]), tileMaxX[k], tileMaxY[k], depthSlice(farDepth[k]) };
+			else
+				b = LightBounds{ 0, 0, 1, 0, 0, 0 };
+		}
+	}
+}
+
+void ClusteredLights::fillSlice(int slice)
+{
+	const int clustersPerSlice = ClustersX * ClustersY;
+	unsigned int* sliceGrid = &grid[slice * clustersPerSlice * 2];
+	unsigned int counts[ClustersX * ClustersY] = {};
+	std::vector<unsigned short>& list = sliceIndices[slice];
+
+	for (const LightBounds& b : bounds)
+		if (b.minZ <= slice && slice <= b.maxZ)
+			for (int y = b.minY; y <= b.maxY; y++)
+				for (int x = b.minX; x <= b.maxX; x++)
+					counts[y * ClustersX + x]++;
+
+	unsigned int offset = 0;
+	for (int cluster = 0; cluster < clustersPerSlice; cluster++)
+	{
+		sliceGrid[cluster * 2] = offset;
+		sliceGrid[cluster * 2 + 1] = counts[cluster];
+		offset += counts[cluster];
+		counts[cluster] = sliceGrid[cluster * 2];
+	}
+
+	list.resize(offset);
+	for (size_t light = 0; light < bounds.size(); light++)
+	{
+		const LightBounds& b = bounds[light];
+		if (b.minZ <= slice && slice <= b.maxZ)
+			for (int y = b.minY; y <= b.maxY; y++)
+				for (int x = b.minX; x <= b.maxX; x++)
+					list[counts[y * ClustersX + x]++] = (unsigned short)light;
+	}
+}
+
+void ClusteredLights::runSlices()
+{
+	INSTRUMENT_SCOPE("light slices");
+	int slice;
+	while ((slice = nextSlice++) < ClustersZ)
+		fillSlice(slice);
+}
+
+void ClusteredLights::workerLoop()
+{
+	INSTRUMENT_THREAD("light worker");
+	unsigned int seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quit || generation != seen; });
+			if (quit)
+				return;
+			seen = generation;
+		}
+		runSlices();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0)
+			done.notify_one();
+	}
+}
+
+void ClusteredLights::createBuffers()
+{
+	const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+	BufferHandle::create(buffers, 3);
+	TextureHandle::create(textures, 3);
+	for (int k = 0; k < 3; k++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[k].get());
+		glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+		buffers[k].setBytes(16);
+		// a view of the buffer, its memory is counted there
+		glBindTexture(GL_TEXTURE_BUFFER, textures[k].get());
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[k], buffers[k].get());
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::deleteBuffers()
+{
+	for (int k = 0; k < 3; k++)
+	{
+		textures[k].reset();
+		buffers[k].reset();
+	}
+}
+
+void ClusteredLights::upload(const std::vector<PointLight>& lights)
+{
+	// the data store is re-specified every frame so the driver can orphan the old one
+	const void* data[3] = { lights.data(), grid.data(), indices.data() };
+	size_t sizes[3] = { lights.size() * sizeof(PointLight), grid.size() * sizeof(unsigned int), indices.size() * sizeof(unsigned short) };
+	for (int k = 0; k < 3; k++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[k].get());
+		glBufferData(GL_TEXTURE_BUFFER, std::max(sizes[k], (size_t)16), nullptr, GL_STREAM_DRAW);
+		buffers[k].setBytes(std::max(sizes[k], (size_t)16));
+		if (sizes[k])
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[k], data[k]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::bind(const Shader& shader, int firstUnit, int screenWidth, int screenHeight) const
+{
+	const UniformName names[3] = { "lightData", "lightGrid", "lightIndices" };
+	for (int k = 0; k < 3; k++)
+	{
+		glActiveTexture(GL_TEXTURE0 + firstUnit + k);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[k].get());
+		shader.setInt(names[k], firstUnit + k);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	shader.setVec2("clusterScale", ClustersX / (float)screenWidth, ClustersY / (float)screenHeight);
+	shader.setFloat("sliceScale", sliceScale);
+	shader.setFloat("sliceBias", sliceBias);
+}
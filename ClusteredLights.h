@@ -0,0 +1,95 @@
+#pragma once
+
+#include "GpuResources.h"
+#include "Shader.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// two RGBA32F texels in the light buffer
+struct PointLight
+{
+	glm::vec3 position; // world space
+	float radius;       // the light has no effect past this distance
+	glm::vec3 color;
+	float intensity;
+};
+
+struct ClusterStats
+{
+	unsigned int lights;       // lights touching at least one cluster
+	unsigned int indices;      // entries in the light index list
+	unsigned int maxPerCluster;
+	float averagePerCluster;   // over the clusters with at least one light
+};
+
+// Clustered forward lighting. The view frustum is split into a ClustersX x
+// ClustersY screen grid and ClustersZ exponential depth slices. Every frame the
+// lights are bounded in view space four at a time with SSE, then the depth
+// slices are filled in parallel. The result goes to three buffer textures:
+// light data, a per-cluster (offset, count) grid and the light index list.
+class ClusteredLights
+{
+public:
+	static const int ClustersX = 16;
+	static const int ClustersY = 9;
+	static const int ClustersZ = 24;
+	static const int ClusterCount = ClustersX * ClustersY * ClustersZ;
+
+	// threadCount 0 picks one per core
+	ClusteredLights(const glm::mat4& projection, float zNear, float zFar, unsigned int threadCount = 0);
+	~ClusteredLights();
+
+	void setProjection(const glm::mat4& projection, float zNear, float zFar);
+	void assign(const std::vector<PointLight>& lights, const glm::mat4& view);
+
+	// GL side, needs a context. The textures are bound to firstUnit .. firstUnit + 2.
+	void createBuffers();
+	void deleteBuffers();
+	void upload(const std::vector<PointLight>& lights);
+	void bind(const Shader& shader, int firstUnit, int screenWidth, int screenHeight) const;
+
+	const std::vector<unsigned int>& getGrid() const { return grid; }
+	const std::vector<unsigned short>& getIndices() const { return indices; }
+	const ClusterStats& stats() const { return clusterStats; }
+
+private:
+	// cluster range of one light, empty when minZ > maxZ
+	struct LightBounds
+	{
+		int minX, minY, minZ, maxX, maxY, maxZ;
+	};
+
+	int depthSlice(float depth) const;
+	void boundLights(const std::vector<PointLight>& lights, const glm::mat4& view);
+	void fillSlice(int slice);
+	void runSlices();
+	void workerLoop();
+
+	float projectionX, projectionY;
+	float zNear, zFar;
+	float sliceScale, sliceBias;
+
+	std::vector<LightBounds> bounds;
+	// per depth slice light lists, concatenated into indices after the parallel part
+	std::vector<std::vector<unsigned short>> sliceIndices;
+	std::vector<unsigned int> grid;
+	std::vector<unsigned short> indices;
+	ClusterStats clusterStats;
+
+	BufferHandle buffers[3];
+	TextureHandle textures[3];
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	unsigned int generation;
+	unsigned int busy;
+	bool quit;
+	std::atomic<int> nextSlice;
+};
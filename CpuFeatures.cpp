@@ -0,0 +1,33 @@
+#include "CpuFeatures.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	bool detectAvx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		bool osSupport = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return osSupport && (info[1] & (1 << 5));
+#elif defined(__GNUC__)
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#else
+		return false;
+#endif
+	}
+}
+
+bool cpuHasAvx2()
+{
+	static const bool avx2 = detectAvx2();
+	return avx2;
+}
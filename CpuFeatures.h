@@ -0,0 +1,12 @@
+#pragma once
+
+// Functions marked AVX2_TARGET are compiled for AVX2 whatever the rest of the
+// build targets, they may only be called once cpuHasAvx2() said yes.
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+// checked on the first call, the OS has to save the ymm registers too
+bool cpuHasAvx2();
@@ -5,7 +5,14 @@
 class Cube
 {
 public:
-	float vertices[];
+	static const unsigned int vertexCount = 36;
+
+	// position (3), texture coords (2), normal (3) per vertex
+	static const unsigned int vertexSize = 8;
+	static const float vertices[vertexCount * vertexSize];
+
+	// position only
+	static const float positions[vertexCount * 3];
+
 	Cube();
 };
-
@@ -0,0 +1,397 @@
+#include "DepthRasterizer.h"
+#include "CpuFeatures.h"
+#include "Instrument.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// one triangle's rows y0..y1 of the pixels x0..x1, a pixel keeps the nearer depth.
+	// Rows are walked in aligned blocks of the vector width, the buffer width is a multiple of 8.
+	void rasterizeSse(const float* edgeA, const float* edgeB, const float* edgeC, float depthA, float depthB, float depthC,
+		float* depth, int width, int x0, int x1, int y0, int y1)
+	{
+		x0 &= ~3;
+		__m128 stepA[3], stepB[3], stepC[3], edgeStep[3];
+		for (int i = 0; i < 3; i++)
+		{
+			stepA[i] = _mm_set1_ps(edgeA[i]);
+			stepB[i] = _mm_set1_ps(edgeB[i]);
+			stepC[i] = _mm_set1_ps(edgeC[i]);
+			edgeStep[i] = _mm_set1_ps(edgeA[i] * 4.0f);
+		}
+		__m128 planeA = _mm_set1_ps(depthA);
+		__m128 planeB = _mm_set1_ps(depthB);
+		__m128 planeC = _mm_set1_ps(depthC);
+		__m128 depthStep = _mm_set1_ps(depthA * 4.0f);
+		__m128 px = _mm_add_ps(_mm_set1_ps((float)x0), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+
+		for (int y = y0; y <= y1; y++)
+		{
+			__m128 py = _mm_set1_ps(y + 0.5f);
+			__m128 w0 = _mm_add_ps(_mm_mul_ps(stepA[0], px), _mm_add_ps(_mm_mul_ps(stepB[0], py), stepC[0]));
+			__m128 w1 = _mm_add_ps(_mm_mul_ps(stepA[1], px), _mm_add_ps(_mm_mul_ps(stepB[1], py), stepC[1]));
+			__m128 w2 = _mm_add_ps(_mm_mul_ps(stepA[2], px), _mm_add_ps(_mm_mul_ps(stepB[2], py), stepC[2]));
+			__m128 z = _mm_add_ps(_mm_mul_ps(planeA, px), _mm_add_ps(_mm_mul_ps(planeB, py), planeC));
+
+			float* row = depth + y * width;
+			for (int x = x0; x <= x1; x += 4)
+			{
+				// sign bit set in a lane if any of its edge values is negative
+				__m128 outside = _mm_or_ps(_mm_or_ps(w0, w1), w2);
+				if (_mm_movemask_ps(outside) != 0xF)
+				{
+					__m128 outsideMask = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(outside), 31));
+					__m128 old = _mm_loadu_ps(row + x);
+					__m128 closer = _mm_min_ps(old, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(outsideMask, old), _mm_andnot_ps(outsideMask, closer)));
+				}
+				w0 = _mm_add_ps(w0, edgeStep[0]);
+				w1 = _mm_add_ps(w1, edgeStep[1]);
+				w2 = _mm_add_ps(w2, edgeStep[2]);
+				z = _mm_add_ps(z, depthStep);
+			}
+		}
+	}
+
+	// the same 8 pixels at a time, blendv picks the old depth where the sign says outside
+	AVX2_TARGET void rasterizeAvx2(const float* edgeA, const float* edgeB, const float* edgeC, float depthA, float depthB, float depthC,
+		float* depth, int width, int x0, int x1, int y0, int y1)
+	{
+		x0 &= ~7;
+		__m256 stepA[3], stepB[3], stepC[3], edgeStep[3];
+		for (int i = 0; i < 3; i++)
+		{
+			stepA[i] = _mm256_set1_ps(edgeA[i]);
+			stepB[i] = _mm256_set1_ps(edgeB[i]);
+			stepC[i] = _mm256_set1_ps(edgeC[i]);
+			edgeStep[i] = _mm256_set1_ps(edgeA[i] * 8.0f);
+		}
+		__m256 planeA = _mm256_set1_ps(depthA);
+		__m256 planeB = _mm256_set1_ps(depthB);
+		__m256 planeC = _mm256_set1_ps(depthC);
+		__m256 depthStep = _mm256_set1_ps(depthA * 8.0f);
+		__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x0), _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f));
+
+		for (int y = y0; y <= y1; y++)
+		{
+			// the same operations as the SSE kernel, no fused multiply-add, so both give the same depths
+			__m256 py = _mm256_set1_ps(y + 0.5f);
+			__m256 w0 = _mm256_add_ps(_mm256_mul_ps(stepA[0], px), _mm256_add_ps(_mm256_mul_ps(stepB[0], py), stepC[0]));
+			__m256 w1 = _mm256_add_ps(_mm256_mul_ps(stepA[1], px), _mm256_add_ps(_mm256_mul_ps(stepB[1], py), stepC[1]));
+			__m256 w2 = _mm256_add_ps(_mm256_mul_ps(stepA[2], px), _mm256_add_ps(_mm256_mul_ps(stepB[2], py), stepC[2]));
+			__m256 z = _mm256_add_ps(_mm256_mul_ps(planeA, px), _mm256_add_ps(_mm256_mul_ps(planeB, py), planeC));
+
+			float* row = depth + y * width;
+			for (int x = x0; x <= x1; x += 8)
+			{
+				__m256 outside = _mm256_or_ps(_mm256_or_ps(w0, w1), w2);
+				if (_mm256_movemask_ps(outside) != 0xFF)
+				{
+					__m256 old = _mm256_loadu_ps(row + x);
+					_mm256_storeu_ps(row + x, _mm256_blendv_ps(_mm256_min_ps(old, z), old, outside));
+				}
+				w0 = _mm256_add_ps(w0, edgeStep[0]);
+				w1 = _mm256_add_ps(w1, edgeStep[1]);
+				w2 = _mm256_add_ps(w2, edgeStep[2]);
+				z = _mm256_add_ps(z, depthStep);
+			}
+		}
+	}
+}
+
+DepthRasterizer::DepthRasterizer(int width, int height, unsigned int threadCount)
+	: width((width + 7) & ~7), height(height), avx2(cpuHasAvx2()), viewProjection(1.0f), generation(0), busy(0), quit(false), nextTile(0)
+{
+	tilesX = (this->width + TileSize - 1) / TileSize;
+	tilesY = (this->height + TileSize - 1) / TileSize;
+	bins.resize(tilesX * tilesY);
+	rowFarthest.resize(this->width * this->height);
+
+	int w = this->width, h = this->height;
+	while (true)
+	{
+		mipWidth.push_back(w);
+		mipHeight.push_back(h);
+		hiz.push_back(std::vector<float>(w * h, 1.0f));
+		if (w == 1 && h == 1)
+			break;
+		w = std::max(1, (w + 1) / 2);
+		h = std::max(1, (h + 1) / 2);
+	}
+
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	// the calling thread rasterizes tiles too
+	for (unsigned int i = 1; i < threadCount; i++)
+		workers.push_back(std::thread(&DepthRasterizer::workerLoop, this));
+}
+
+DepthRasterizer::~DepthRasterizer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void DepthRasterizer::beginFrame(const glm::mat4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+	triangles.clear();
+	for (std::vector<unsigned int>& bin : bins)
+		bin.clear();
+	std::fill(hiz[0].begin(), hiz[0].end(), 1.0f);
+}
+
+void DepthRasterizer::addMesh(const float* vertices, unsigned int vertexCount, unsigned int stride, const glm::mat4& model)
+{
+	glm::mat4 mvp = viewProjection * model;
+	for (unsigned int t = 0; t + 2 < vertexCount; t += 3)
+	{
+		glm::vec3 screen[3];
+		bool clipped = false;
+		for (int v = 0; v < 3; v++)
+		{
+			const float* p = vertices + (t + v) * stride;
+			glm::vec4 clip = mvp * glm::vec4(p[0], p[1], p[2], 1.0f);
+			// dropping a triangle only makes the occluder smaller, so this stays conservative
+			if (clip.z < -clip.w)
+			{
+				clipped = true;
+				break;
+			}
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			screen[v] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+		}
+		if (!clipped)
+			setupTriangle(screen[0], screen[1], screen[2]);
+	}
+}
+
+void DepthRasterizer::setupTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+{
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	if (area == 0.0f)
+		return;
+	// mesh data is not consistently wound, accept both orientations
+	const glm::vec3& a = v0;
+	const glm::vec3& b = area > 0.0f ? v1 : v2;
+	const glm::vec3& c = area > 0.0f ? v2 : v1;
+	area = std::fabs(area);
+
+	Triangle tri;
+	tri.minX = std::max(0, (int)std::floor(std::min({ a.x, b.x, c.x })));
+	tri.maxX = std::min(width - 1, (int)std::ceil(std::max({ a.x, b.x, c.x })));
+	tri.minY = std::max(0, (int)std::floor(std::min({ a.y, b.y, c.y })));
+	tri.maxY = std::min(height - 1, (int)std::ceil(std::max({ a.y, b.y, c.y })));
+	if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+		return;
+
+	// edge i is A*x + B*y + C, positive inside and equal to the area at the opposite vertex
+	const glm::vec3* from[3] = { &b, &c, &a };
+	const glm::vec3* to[3] = { &c, &a, &b };
+	for (int i = 0; i < 3; i++)
+	{
+		tri.edgeA[i] = from[i]->y - to[i]->y;
+		tri.edgeB[i] = to[i]->x - from[i]->x;
+		tri.edgeC[i] = from[i]->x * to[i]->y - from[i]->y * to[i]->x;
+	}
+	// depth plane from the barycentric weights
+	tri.depthA = (tri.edgeA[0] * a.z + tri.edgeA[1] * b.z + tri.edgeA[2] * c.z) / area;
+	tri.depthB = (tri.edgeB[0] * a.z + tri.edgeB[1] * b.z + tri.edgeB[2] * c.z) / area;
+	tri.depthC = (tri.edgeC[0] * a.z + tri.edgeC[1] * b.z + tri.edgeC[2] * c.z) / area;
+
+	unsigned int index = (unsigned int)triangles.size();
+	triangles.push_back(tri);
+	for (int ty = tri.minY / TileSize; ty <= tri.maxY / TileSize; ty++)
+		for (int tx = tri.minX / TileSize; tx <= tri.maxX / TileSize; tx++)
+			bins[ty * tilesX + tx].push_back(index);
+}
+
+void DepthRasterizer::rasterizeTile(int tile)
+{
+	int tileX0 = (tile % tilesX) * TileSize;
+	int tileY0 = (tile / tilesX) * TileSize;
+	int tileX1 = std::min(tileX0 + TileSize, width) - 1;
+	int tileY1 = std::min(tileY0 + TileSize, height) - 1;
+
+	float* depth = hiz[0].data();
+	for (unsigned int index : bins[tile])
+	{
+		const Triangle& tri = triangles[index];
+		int x0 = std::max(tri.minX, tileX0);
+		int x1 = std::min(tri.maxX, tileX1);
+		int y0 = std::max(tri.minY, tileY0);
+		int y1 = std::min(tri.maxY, tileY1);
+		if (avx2)
+			rasterizeAvx2(tri.edgeA, tri.edgeB, tri.edgeC, tri.depthA, tri.depthB, tri.depthC, depth, width, x0, x1, y0, y1);
+		else
+			rasterizeSse(tri.edgeA, tri.edgeB, tri.edgeC, tri.depthA, tri.depthB, tri.depthC, depth, width, x0, x1, y0, y1);
+	}
+}
+
+void DepthRasterizer::setAvx2(bool enabled)
+{
+	avx2 = enabled && cpuHasAvx2();
+}
+
+void DepthRasterizer::runTiles()
+{
+	INSTRUMENT_SCOPE("raster tiles");
+	int tileCount = tilesX * tilesY;
+	int tile;
+	while ((tile = nextTile++) < tileCount)
+		rasterizeTile(tile);
+}
+
+void DepthRasterizer::workerLoop()
+{
+	INSTRUMENT_THREAD("raster worker");
+	unsigned int seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quit || generation != seen; });
+			if (quit)
+				return;
+			seen = generation;
+		}
+		runTiles();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0)
+			done.notify_one();
+	}
+}
+
+void DepthRasterizer::rasterize()
+{
+	nextTile = 0;
+	if (!workers.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy = (unsigned int)workers.size();
+			generation++;
+		}
+		wake.notify_all();
+	}
+
+	runTiles();
+
+	if (!workers.empty())
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return busy == 0; });
+	}
+
+	buildHiZ();
+}
+
+void DepthRasterizer::buildHiZ()
+{
+	INSTRUMENT_SCOPE("hi-z");
+	// a texel only partly covered by an occluder took its depth at the pixel centre, so something
+	// peeking out at the silhouette could be culled. Every texel keeps the farthest depth of its
+	// 3x3 neighbourhood, which shrinks the occluders by a texel at their edges.
+	std::vector<float>& depth = hiz[0];
+	for (int y = 0; y < height; y++)
+	{
+		const float* row = &depth[y * width];
+		float* dst = &rowFarthest[y * width];
+		for (int x = 0; x < width; x++)
+			dst[x] = std::max(row[x], std::max(row[std::max(x - 1, 0)], row[std::min(x + 1, width - 1)]));
+	}
+	for (int y = 0; y < height; y++)
+	{
+		const float* above = &rowFarthest[std::max(y - 1, 0) * width];
+		const float* row = &rowFarthest[y * width];
+		const float* below = &rowFarthest[std::min(y + 1, height - 1) * width];
+		float* dst = &depth[y * width];
+		for (int x = 0; x < width; x++)
+			dst[x] = std::max(row[x], std::max(above[x], below[x]));
+	}
+
+	for (size_t level = 1; level < hiz.size(); level++)
+	{
+		const std::vector<float>& src = hiz[level - 1];
+		std::vector<float>& dst = hiz[level];
+		int sw = mipWidth[level - 1], sh = mipHeight[level - 1];
+		for (int y = 0; y < mipHeight[level]; y++)
+		{
+			int sy0 = y * 2, sy1 = std::min(y * 2 + 1, sh - 1);
+			for (int x = 0; x < mipWidth[level]; x++)
+			{
+				int sx0 = x * 2, sx1 = std::min(x * 2 + 1, sw - 1);
+				dst[y * mipWidth[level] + x] = std::max(
+					std::max(src[sy0 * sw + sx0], src[sy0 * sw + sx1]),
+					std::max(src[sy1 * sw + sx0], src[sy1 * sw + sx1]));
+			}
+		}
+	}
+}
+
+bool DepthRasterizer::projectAabb(const glm::vec3& aabbMin, const glm::vec3& aabbMax, ScreenRect& rect) const
+{
+	rect.minX = rect.minY = INFINITY;
+	rect.maxX = rect.maxY = -INFINITY;
+	// not clamped to the far plane, the culler rejects boxes wholly behind it
+	rect.nearestDepth = INFINITY;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 clip = viewProjection * glm::vec4((i & 1) ? aabbMax.x : aabbMin.x,
+			(i & 2) ? aabbMax.y : aabbMin.y, (i & 4) ? aabbMax.z : aabbMin.z, 1.0f);
+		if (clip.z < -clip.w)
+			return false;
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		float x = (ndc.x * 0.5f + 0.5f) * width;
+		float y = (ndc.y * 0.5f + 0.5f) * height;
+		rect.minX = std::min(rect.minX, x);
+		rect.maxX = std::max(rect.maxX, x);
+		rect.minY = std::min(rect.minY, y);
+		rect.maxY = std::max(rect.maxY, y);
+		rect.nearestDepth = std::min(rect.nearestDepth, ndc.z * 0.5f + 0.5f);
+	}
+	return true;
+}
+
+bool DepthRasterizer::isOccluded(const ScreenRect& rect) const
+{
+	// every texel the rect touches, rounded outward
+	int x0 = std::max(0, (int)std::floor(rect.minX));
+	int x1 = std::min(width - 1, (int)std::floor(rect.maxX));
+	int y0 = std::max(0, (int)std::floor(rect.minY));
+	int y1 = std::min(height - 1, (int)std::floor(rect.maxY));
+	if (x0 > x1 || y0 > y1 || rect.maxX < 0.0f || rect.maxY < 0.0f)
+		return false;
+
+	// go up the pyramid until the box covers at most 4x4 texels
+	size_t level = 0;
+	while (level + 1 < hiz.size() && ((x1 >> level) - (x0 >> level) >= 4 || (y1 >> level) - (y0 >> level) >= 4))
+		level++;
+
+	const std::vector<float>& mip = hiz[level];
+	int mw = mipWidth[level];
+	float farthest = 0.0f;
+	for (int y = y0 >> level; y <= (y1 >> level); y++)
+		for (int x = x0 >> level; x <= (x1 >> level); x++)
+			farthest = std::max(farthest, mip[y * mw + x]);
+
+	return rect.nearestDepth > farthest;
+}
+
+bool DepthRasterizer::isOccluded(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const
+{
+	ScreenRect rect;
+	if (!projectAabb(aabbMin, aabbMax, rect))
+		return false;
+	return isOccluded(rect);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Low resolution software depth buffer for CPU occlusion queries.
+// Triangles are set up and binned into 32x32 tiles as meshes are added, the
+// tiles are then rasterized in parallel with 8-wide AVX2 edge functions, or
+// 4-wide SSE ones on a CPU without AVX2, and a max-depth pyramid (Hi-Z) is
+// built for the queries.
+class DepthRasterizer
+{
+public:
+	struct ScreenRect
+	{
+		float minX, minY, maxX, maxY;
+		float nearestDepth;
+	};
+
+	static const int TileSize = 32;
+
+	// width is rounded up to a multiple of 8, threadCount 0 picks one per core
+	DepthRasterizer(int width, int height, unsigned int threadCount = 0);
+	~DepthRasterizer();
+
+	void beginFrame(const glm::mat4& viewProjection);
+	// vertices is a triangle list with the position in the first three floats of every vertex
+	void addMesh(const float* vertices, unsigned int vertexCount, unsigned int stride, const glm::mat4& model);
+	void rasterize();
+
+	// false if the box crosses the near plane and can't be bounded on screen,
+	// nearestDepth is above 1 when the whole box is beyond the far plane
+	bool projectAabb(const glm::vec3& aabbMin, const glm::vec3& aabbMax, ScreenRect& rect) const;
+	bool isOccluded(const ScreenRect& rect) const;
+	bool isOccluded(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const;
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	unsigned int getTriangleCount() const { return (unsigned int)triangles.size(); }
+	// false keeps to the SSE kernel, ignored without AVX2
+	void setAvx2(bool enabled);
+	bool usesAvx2() const { return avx2; }
+
+private:
+	struct Triangle
+	{
+		float edgeA[3], edgeB[3], edgeC[3];
+		float depthA, depthB, depthC;
+		int minX, minY, maxX, maxY;
+	};
+
+	void setupTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+	void rasterizeTile(int tile);
+	void runTiles();
+	void buildHiZ();
+	void workerLoop();
+
+	int width, height;
+	int tilesX, tilesY;
+	bool avx2;
+	glm::mat4 viewProjection;
+
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<unsigned int>> bins;
+
+	// hiz[0] is the rasterized depth buffer with every texel the farthest of its 3x3 neighbourhood,
+	// every next level keeps the farthest depth of a 2x2 block
+	std::vector<std::vector<float>> hiz;
+	std::vector<float> rowFarthest;
+	std::vector<int> mipWidth, mipHeight;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	unsigned int generation;
+	unsigned int busy;
+	bool quit;
+	std::atomic<int> nextTile;
+};
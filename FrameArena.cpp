@@ -0,0 +1,115 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	std::atomic<unsigned long long> allocations(0);
+
+	void* countedAllocation(size_t size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		if (void* memory = malloc(size ? size : 1))
+			return memory;
+		throw std::bad_alloc();
+	}
+}
+
+void* operator new(size_t size) { return countedAllocation(size); }
+void* operator new[](size_t size) { return countedAllocation(size); }
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+
+unsigned long long heapAllocationCount()
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+FrameArena::FrameArena(size_t bytesPerFrame) : blockSize(bytesPerFrame), current(0), peakUsed(0)
+{
+	for (Block& block : blocks)
+	{
+		block.memory = static_cast<char*>(malloc(blockSize));
+		block.used = 0;
+		block.overflow.reserve(64);
+	}
+}
+
+FrameArena::~FrameArena()
+{
+	for (Block& block : blocks)
+	{
+		reset(block);
+		free(block.memory);
+	}
+}
+
+void FrameArena::reset(Block& block)
+{
+	for (void* memory : block.overflow)
+		free(memory);
+	block.overflow.clear();
+	block.used = 0;
+}
+
+void FrameArena::beginFrame()
+{
+	peakUsed = std::max(peakUsed, blocks[current].used);
+	current ^= 1;
+	reset(blocks[current]);
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+	Block& block = blocks[current];
+	size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+	if (offset + bytes <= blockSize)
+	{
+		block.used = offset + bytes;
+		return block.memory + offset;
+	}
+	// malloc is aligned for any fundamental type
+	void* memory = malloc(bytes ? bytes : 1);
+	block.overflow.push_back(memory);
+	return memory;
+}
+
+const char* FrameArena::format(const char* format, ...)
+{
+	va_list arguments, retry;
+	va_start(arguments, format);
+	va_copy(retry, arguments);
+	Block& block = blocks[current];
+	size_t room = blockSize - block.used;
+	int length = vsnprintf(block.memory + block.used, room, format, arguments);
+	const char* text = "";
+	if (length >= 0 && (size_t)length < room)
+	{
+		text = block.memory + block.used;
+		block.used += length + 1;
+	}
+	else if (length >= 0)
+	{
+		char* overflow = static_cast<char*>(allocate(length + 1, 1));
+		vsnprintf(overflow, length + 1, format, retry);
+		text = overflow;
+	}
+	va_end(retry);
+	va_end(arguments);
+	return text;
+}
+
+const char* FrameArena::copy(const char* text, size_t length)
+{
+	char* copied = static_cast<char*>(allocate(length + 1, 1));
+	memcpy(copied, text, length);
+	copied[length] = '\0';
+	return copied;
+}
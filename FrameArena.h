@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Every global operator new of the program, FrameArena.cpp replaces them.
+// The difference between two frames is the heap traffic of that frame.
+unsigned long long heapAllocationCount();
+
+// Fixed capacity array in arena memory, push_back past the capacity is ignored
+// and counted in dropped(). Elements are never destroyed, so only trivially
+// destructible types.
+template <typename T>
+class ArenaArray
+{
+	static_assert(std::is_trivially_destructible<T>::value, "arena memory is reset, not destroyed");
+
+public:
+	ArenaArray() : items(nullptr), count(0), room(0), lost(0) {}
+	ArenaArray(T* items, size_t capacity) : items(items), count(0), room(capacity), lost(0) {}
+
+	bool push_back(const T& value)
+	{
+		if (count == room)
+		{
+			lost++;
+			return false;
+		}
+		new (items + count++) T(value);
+		return true;
+	}
+
+	T& operator[](size_t k) { return items[k]; }
+	const T& operator[](size_t k) const { return items[k]; }
+	T* begin() { return items; }
+	T* end() { return items + count; }
+	const T* begin() const { return items; }
+	const T* end() const { return items + count; }
+	T* data() { return items; }
+	size_t size() const { return count; }
+	size_t capacity() const { return room; }
+	bool empty() const { return count == 0; }
+	size_t dropped() const { return lost; }
+
+private:
+	T* items;
+	size_t count, room;
+	size_t lost;
+};
+
+// Linear allocator for data that lives one frame. Two blocks take turns:
+// beginFrame resets the older one, so what the previous frame allocated is
+// still valid while the current one is built. Allocations past the block go
+// to the heap and are freed with the block, overflows() counts them, the
+// block should be grown until it stays zero.
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t bytesPerFrame);
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void beginFrame();
+
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	template <typename T>
+	T* allocateArray(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "arena memory is reset, not destroyed");
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	template <typename T>
+	ArenaArray<T> array(size_t capacity)
+	{
+		return ArenaArray<T>(allocateArray<T>(capacity), capacity);
+	}
+
+	// printf into arena memory, valid until the block is reset
+	const char* format(const char* format, ...);
+	const char* copy(const char* text, size_t length);
+
+	size_t used() const { return blocks[current].used; }
+	size_t peak() const { return peakUsed; }
+	size_t capacity() const { return blockSize; }
+	// heap fallbacks of the current frame
+	unsigned int overflows() const { return (unsigned int)blocks[current].overflow.size(); }
+
+private:
+	struct Block
+	{
+		char* memory;
+		size_t used;
+		std::vector<void*> overflow;
+	};
+
+	void reset(Block& block);
+
+	size_t blockSize;
+	Block blocks[2];
+	int current;
+	size_t peakUsed;
+};
@@ -0,0 +1,115 @@
+#include "GBuffer.h"
+#include "Log.h"
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+GBuffer::GBuffer() : width(0), height(0), frame(0), samples(0)
+{
+	for (int k = 0; k < QueryCount; k++)
+	{
+		queries[k] = 0;
+		queryPending[k] = false;
+	}
+}
+
+void GBuffer::resize(int width, int height)
+{
+	if (framebuffer && width == this->width && height == this->height)
+		return;
+	releaseTargets();
+	this->width = width;
+	this->height = height;
+
+	const GLenum internalFormats[3] = { GL_RGBA8, GL_RG16, GL_DEPTH_COMPONENT24 };
+	const GLenum formats[3] = { GL_RGBA, GL_RG, GL_DEPTH_COMPONENT };
+	const GLenum types[3] = { GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT };
+	const size_t texelBytes[3] = { 4, 4, 4 };
+	const GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_DEPTH_ATTACHMENT };
+
+	framebuffer = FramebufferHandle::create();
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+	TextureHandle::create(textures, 3);
+	for (int k = 0; k < 3; k++)
+	{
+		glBindTexture(GL_TEXTURE_2D, textures[k].get());
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[k], width, height, 0, formats[k], types[k], nullptr);
+		textures[k].setBytes((size_t)width * height * texelBytes[k]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[k], GL_TEXTURE_2D, textures[k].get(), 0);
+	}
+	const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		LOG_ERROR("ERROR::GBUFFER::FRAMEBUFFER_INCOMPLETE");
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GBuffer::releaseTargets()
+{
+	for (TextureHandle& texture : textures)
+		texture.reset();
+	framebuffer.reset();
+	width = height = 0;
+}
+
+void GBuffer::release()
+{
+	releaseTargets();
+	if (!queries[0])
+		return;
+	glDeleteQueries(QueryCount, queries);
+	for (int k = 0; k < QueryCount; k++)
+	{
+		queries[k] = 0;
+		queryPending[k] = false;
+	}
+}
+
+void GBuffer::bindForWriting() const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.get());
+	glViewport(0, 0, width, height);
+}
+
+void GBuffer::bindTextures(int firstUnit) const
+{
+	for (int k = 0; k < 3; k++)
+	{
+		glActiveTexture(GL_TEXTURE0 + firstUnit + k);
+		glBindTexture(GL_TEXTURE_2D, textures[k].get());
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void GBuffer::beginQuery()
+{
+	// the query of QueryCount - 1 frames ago, its result is skipped if it has not finished yet
+	if (!queries[0])
+		glGenQueries(QueryCount, queries);
+	int slot = frame++ % QueryCount;
+	if (queryPending[slot])
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint result = 0;
+			glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT, &result);
+			samples = result;
+		}
+	}
+	glBeginQuery(GL_SAMPLES_PASSED, queries[slot]);
+	queryPending[slot] = true;
+}
+
+void GBuffer::endQuery()
+{
+	glEndQuery(GL_SAMPLES_PASSED);
+}
+
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "GpuResources.h"
+
+// Render targets of the deferred path, 12 bytes per pixel:
+//   0: RGBA8 albedo + shininess / 256
+//   1: RG16  octahedral world space normal
+//   depth: DEPTH24, positions are reconstructed from it
+class GBuffer
+{
+public:
+	static const unsigned int bytesPerPixel = 4 + 4 + 4;
+
+	GBuffer();
+
+	// (re)creates the targets when the size changed, needs a context. Only the
+	// deferred path calls it, the forward one leaves them released.
+	void resize(int width, int height);
+	void releaseTargets();
+	// the targets and the queries
+	void release();
+
+	void bindForWriting() const;
+	// albedo, normal and depth to firstUnit .. firstUnit + 2
+	void bindTextures(int firstUnit) const;
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	static const int QueryCount = 3;
+
+	// GL_SAMPLES_PASSED around the shaded geometry of either path, after the depth
+	// pre-pass. In the deferred one every sample writes all three targets. The
+	// queries are created on the first beginQuery() and need no targets.
+	void beginQuery();
+	void endQuery();
+	// from the newest query that had finished when its slot came round again,
+	// QueryCount - 1 frames back, so reading it never waits on the GPU
+	unsigned int writtenSamples() const { return samples; }
+
+private:
+	int width, height;
+	FramebufferHandle framebuffer;
+	TextureHandle textures[3];
+	unsigned int queries[QueryCount];
+	bool queryPending[QueryCount];
+	unsigned int frame;
+	unsigned int samples;
+};
@@ -0,0 +1,209 @@
+#include "GeometryPool.h"
+
+#include "Log.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const size_t VertexBytes = Mesh::vertexSize * sizeof(float);
+	const size_t IndexBytes = sizeof(unsigned int);
+}
+
+GeometryPool::Page::Page(unsigned int vertexCapacity, unsigned int indexCapacity)
+	: vao(VertexArrayHandle::create()), vertexBuffer(BufferHandle::create()), indexBuffer(BufferHandle::create()),
+	vertexRanges(vertexCapacity), indexRanges(indexCapacity)
+{
+	glBindVertexArray(vao.get());
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.get());
+	glBufferData(GL_ARRAY_BUFFER, vertexCapacity * VertexBytes, nullptr, GL_STATIC_DRAW);
+	vertexBuffer.setBytes(vertexCapacity * VertexBytes);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.get());
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * IndexBytes, nullptr, GL_STATIC_DRAW);
+	indexBuffer.setBytes(indexCapacity * IndexBytes);
+
+	// the Mesh layout: position, texture coords, normal
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei)VertexBytes, (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, (GLsizei)VertexBytes, (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, (GLsizei)VertexBytes, (void*)(5 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glBindVertexArray(0);
+}
+
+GeometryPool::GeometryPool(unsigned int verticesPerPage, unsigned int indicesPerPage)
+	: verticesPerPage(verticesPerPage), indicesPerPage(indicesPerPage), liveMeshes(0), allocations(0),
+	allocationSeconds(0.0), maxAllocationSeconds(0.0), movedBytes(0), holes(false)
+{
+}
+
+bool GeometryPool::place(Page& page, unsigned int vertexCount, unsigned int indexCount, Entry& entry)
+{
+	Clock::time_point start = Clock::now();
+	entry.vertices = page.vertexRanges.allocate(vertexCount);
+	entry.indices = page.indexRanges.allocate(indexCount);
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	allocations++;
+	allocationSeconds += seconds;
+	maxAllocationSeconds = std::max(maxAllocationSeconds, seconds);
+
+	if (entry.vertices.offset != RangeAllocator::Invalid && entry.indices.offset != RangeAllocator::Invalid)
+		return true;
+	page.vertexRanges.free(entry.vertices);
+	page.indexRanges.free(entry.indices);
+	return false;
+}
+
+unsigned int GeometryPool::add(const float* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount)
+{
+	Entry entry;
+	entry.live = true;
+	entry.page = RangeAllocator::Invalid;
+	for (unsigned int p = 0; p < pages.size() && entry.page == RangeAllocator::Invalid; p++)
+		if (place(*pages[p], vertexCount, indexCount, entry))
+			entry.page = p;
+	if (entry.page == RangeAllocator::Invalid)
+	{
+		pages.emplace_back(new Page(std::max(verticesPerPage, vertexCount), std::max(indicesPerPage, indexCount)));
+		entry.page = (unsigned int)pages.size() - 1;
+		if (!place(*pages.back(), vertexCount, indexCount, entry))
+			LOG_ERROR("ERROR::GEOMETRY_POOL::ALLOCATION_FAILED " << vertexCount << " vertices, " << indexCount << " indices");
+	}
+
+	const Page& page = *pages[entry.page];
+	glBindBuffer(GL_ARRAY_BUFFER, page.vertexBuffer.get());
+	glBufferSubData(GL_ARRAY_BUFFER, entry.vertices.offset * VertexBytes, vertexCount * VertexBytes, vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// the element binding is VAO state, upload through the copy target instead
+	glBindBuffer(GL_COPY_WRITE_BUFFER, page.indexBuffer.get());
+	glBufferSubData(GL_COPY_WRITE_BUFFER, entry.indices.offset * IndexBytes, indexCount * IndexBytes, indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	unsigned int mesh;
+	if (freeEntries.empty())
+	{
+		mesh = (unsigned int)entries.size();
+		entries.push_back(entry);
+	}
+	else
+	{
+		mesh = freeEntries.back();
+		freeEntries.pop_back();
+		entries[mesh] = entry;
+	}
+	liveMeshes++;
+	return mesh;
+}
+
+void GeometryPool::remove(unsigned int mesh)
+{
+	Entry& entry = entries[mesh];
+	if (!entry.live)
+		return;
+	Page& page = *pages[entry.page];
+	page.vertexRanges.free(entry.vertices);
+	page.indexRanges.free(entry.indices);
+	entry.live = false;
+	freeEntries.push_back(mesh);
+	holes = true;
+	liveMeshes--;
+}
+
+void GeometryPool::bind(unsigned int mesh) const
+{
+	glBindVertexArray(pages[entries[mesh].page]->vao.get());
+}
+
+void GeometryPool::draw(unsigned int mesh, const MeshLod& lod) const
+{
+	const Entry& entry = entries[mesh];
+	glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT,
+		(void*)((entry.indices.offset + lod.indexOffset) * IndexBytes), (GLint)entry.vertices.offset);
+}
+
+void GeometryPool::copyRange(unsigned int buffer, size_t from, size_t to, size_t bytes)
+{
+	// relocate only moves below the old range, source and target never overlap
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, to, bytes);
+}
+
+size_t GeometryPool::defragment(size_t byteBudget)
+{
+	if (!holes)
+		return 0;
+	order.clear();
+	for (unsigned int mesh = 0; mesh < entries.size(); mesh++)
+		if (entries[mesh].live)
+			order.push_back(mesh);
+
+	// highest ranges first: they drop into the lowest holes and the free space
+	// gathers at the end of the page. Vertices and indices move independently.
+	size_t moved = 0;
+	for (int side = 0; side < 2 && moved < byteBudget; side++)
+	{
+		const size_t unitBytes = side ? IndexBytes : VertexBytes;
+		std::sort(order.begin(), order.end(), [this, side](unsigned int a, unsigned int b)
+		{
+			const Entry& x = entries[a];
+			const Entry& y = entries[b];
+			if (x.page != y.page)
+				return x.page < y.page;
+			return side ? x.indices.offset > y.indices.offset : x.vertices.offset > y.vertices.offset;
+		});
+		for (unsigned int mesh : order)
+		{
+			if (moved >= byteBudget)
+				break;
+			Entry& entry = entries[mesh];
+			Page& page = *pages[entry.page];
+			RangeAllocator& ranges = side ? page.indexRanges : page.vertexRanges;
+			// a page without holes has nothing to gain
+			if (ranges.freeRangeCount() <= 1)
+				continue;
+			RangeAllocator::Range& range = side ? entry.indices : entry.vertices;
+			RangeAllocator::Range target = ranges.relocate(range);
+			if (target.offset == range.offset)
+				continue;
+			copyRange(side ? page.indexBuffer.get() : page.vertexBuffer.get(), range.offset * unitBytes, target.offset * unitBytes, target.size * unitBytes);
+			moved += target.size * unitBytes;
+			range = target;
+		}
+	}
+	if (moved)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	// holes smaller than every range above them stay, the next remove() looks again
+	if (moved < byteBudget)
+		holes = false;
+	movedBytes += moved;
+	return moved;
+}
+
+GeometryPoolStats GeometryPool::stats() const
+{
+	GeometryPoolStats result = GeometryPoolStats();
+	result.meshes = liveMeshes;
+	result.buffers = (unsigned int)pages.size() * 2;
+	result.buffersPerMesh = liveMeshes * 2;
+	for (const std::unique_ptr<Page>& page : pages)
+	{
+		result.vertexBytes += page->vertexRanges.used() * VertexBytes;
+		result.indexBytes += page->indexRanges.used() * IndexBytes;
+		result.capacityBytes += page->vertexRanges.capacity() * VertexBytes + page->indexRanges.capacity() * IndexBytes;
+		result.fragmentation = std::max(result.fragmentation, std::max(page->vertexRanges.fragmentation(), page->indexRanges.fragmentation()));
+	}
+	result.allocationMicroseconds = allocations ? allocationSeconds / allocations * 1e6 : 0.0;
+	result.maxAllocationMicroseconds = maxAllocationSeconds * 1e6;
+	result.movedBytes = movedBytes;
+	return result;
+}
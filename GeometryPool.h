@@ -0,0 +1,82 @@
+#pragma once
+
+#include "GpuResources.h"
+#include "Mesh.h"
+#include "RangeAllocator.h"
+
+#include <memory>
+#include <vector>
+
+struct GeometryPoolStats
+{
+	unsigned int meshes;
+	unsigned int buffers;            // GL buffer objects of the pool
+	unsigned int buffersPerMesh;     // what one vertex and one index buffer per mesh would take
+	size_t vertexBytes, indexBytes;  // in use
+	size_t capacityBytes;
+	float fragmentation;             // worst page, vertex or index side
+	double allocationMicroseconds;   // mean of add(), allocator only
+	double maxAllocationMicroseconds;
+	size_t movedBytes;               // by defragment, in total
+};
+
+// Vertex and index data of many meshes in the Mesh layout sub-allocated from a
+// few large GL buffers. A page is one vertex buffer, one index buffer and the
+// VAO over both; ranges inside are handed out by RangeAllocator and a mesh is
+// drawn with glDrawElementsBaseVertex, so the indices stay relative to the
+// mesh. Meshes are referred to by id, their ranges may move in defragment().
+class GeometryPool
+{
+public:
+	// the capacity of one page, a mesh bigger than that gets a page of its own
+	GeometryPool(unsigned int verticesPerPage, unsigned int indicesPerPage);
+
+	GeometryPool(const GeometryPool&) = delete;
+	GeometryPool& operator=(const GeometryPool&) = delete;
+
+	unsigned int add(const float* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount);
+	void remove(unsigned int mesh);
+
+	// binds the VAO of the page holding mesh
+	void bind(unsigned int mesh) const;
+	// lod ranges are relative to the mesh's own indices
+	void draw(unsigned int mesh, const MeshLod& lod) const;
+
+	// moves meshes down into free ranges until byteBudget is copied, with
+	// glCopyBufferSubData inside the page's buffers. Returns the bytes moved,
+	// nothing is looked at until a mesh has been removed.
+	size_t defragment(size_t byteBudget);
+
+	GeometryPoolStats stats() const;
+
+private:
+	struct Page
+	{
+		Page(unsigned int vertexCapacity, unsigned int indexCapacity);
+
+		VertexArrayHandle vao;
+		BufferHandle vertexBuffer, indexBuffer;
+		RangeAllocator vertexRanges, indexRanges;
+	};
+
+	struct Entry
+	{
+		unsigned int page;
+		RangeAllocator::Range vertices, indices;
+		bool live;
+	};
+
+	bool place(Page& page, unsigned int vertexCount, unsigned int indexCount, Entry& entry);
+	static void copyRange(unsigned int buffer, size_t from, size_t to, size_t bytes);
+
+	unsigned int verticesPerPage, indicesPerPage;
+	std::vector<std::unique_ptr<Page>> pages;
+	std::vector<Entry> entries;
+	std::vector<unsigned int> freeEntries;
+	unsigned int liveMeshes;
+	unsigned int allocations;
+	double allocationSeconds, maxAllocationSeconds;
+	size_t movedBytes;
+	bool holes;
+	std::vector<unsigned int> order;  // defragment, kept for its capacity
+};
@@ -0,0 +1,196 @@
+#include "GpuResources.h"
+
+#include "Log.h"
+
+#include <algorithm>
+
+GpuResources::GpuResources() : pending(0), staleLookups(0), down(false)
+{
+	released.fence = nullptr;
+	std::fill(live, live + GpuResourceTypeCount, 0u);
+	std::fill(bytes, bytes + GpuResourceTypeCount, (size_t)0);
+}
+
+GpuResources::Id GpuResources::allocateSlot(GpuResourceType type, unsigned int name)
+{
+	unsigned int index;
+	if (freeSlots.empty())
+	{
+		index = (unsigned int)slots.size();
+		Slot slot = { 0, 1, type, 0 };
+		slots.push_back(slot);
+	}
+	else
+	{
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	Slot& slot = slots[index];
+	slot.name = name;
+	slot.type = type;
+	slot.bytes = 0;
+	live[type]++;
+	Id id = { index, slot.generation };
+	return id;
+}
+
+void GpuResources::create(GpuResourceType type, unsigned int count, Id* ids)
+{
+	std::vector<unsigned int> names(count);
+	switch (type)
+	{
+	case GpuBuffer: glGenBuffers(count, names.data()); break;
+	case GpuVertexArray: glGenVertexArrays(count, names.data()); break;
+	case GpuTexture: glGenTextures(count, names.data()); break;
+	case GpuFramebuffer: glGenFramebuffers(count, names.data()); break;
+	case GpuProgram:
+		for (unsigned int& name : names)
+			name = glCreateProgram();
+		break;
+	default: break;
+	}
+	for (unsigned int k = 0; k < count; k++)
+		ids[k] = allocateSlot(type, names[k]);
+}
+
+GpuResources::Id GpuResources::adopt(GpuResourceType type, unsigned int name)
+{
+	return allocateSlot(type, name);
+}
+
+void GpuResources::release(Id id)
+{
+	if (down || id.index >= slots.size() || slots[id.index].generation != id.generation)
+		return;
+	Slot& slot = slots[id.index];
+	released.names[slot.type].push_back(slot.name);
+	pending++;
+	live[slot.type]--;
+	bytes[slot.type] -= slot.bytes;
+	slot.name = 0;
+	slot.bytes = 0;
+	// 0 stays the null handle
+	if (++slot.generation == 0)
+		slot.generation = 1;
+	freeSlots.push_back(id.index);
+}
+
+void GpuResources::setBytes(Id id, size_t size)
+{
+	if (id.generation == 0 || id.index >= slots.size() || slots[id.index].generation != id.generation)
+		return;
+	Slot& slot = slots[id.index];
+	bytes[slot.type] += size - slot.bytes;
+	slot.bytes = size;
+}
+
+void GpuResources::deleteNames(GpuResourceType type, std::vector<unsigned int>& names)
+{
+	if (names.empty())
+		return;
+	GLsizei count = (GLsizei)names.size();
+	switch (type)
+	{
+	case GpuBuffer: glDeleteBuffers(count, names.data()); break;
+	case GpuVertexArray: glDeleteVertexArrays(count, names.data()); break;
+	case GpuTexture: glDeleteTextures(count, names.data()); break;
+	case GpuFramebuffer: glDeleteFramebuffers(count, names.data()); break;
+	case GpuProgram:
+		for (unsigned int name : names)
+			glDeleteProgram(name);
+		break;
+	default: break;
+	}
+	names.clear();
+}
+
+void GpuResources::deleteBatch(Batch& batch)
+{
+	for (int type = 0; type < GpuResourceTypeCount; type++)
+		deleteNames((GpuResourceType)type, batch.names[type]);
+	if (batch.fence)
+		glDeleteSync(batch.fence);
+	batch.fence = nullptr;
+}
+
+void GpuResources::endFrame()
+{
+	if (down)
+		return;
+	bool anyReleased = false;
+	for (const std::vector<unsigned int>& names : released.names)
+		anyReleased = anyReleased || !names.empty();
+	if (anyReleased)
+	{
+		released.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		inFlight.push_back(std::move(released));
+		if (spareBatches.empty())
+			released = Batch();
+		else
+		{
+			released = std::move(spareBatches.back());
+			spareBatches.pop_back();
+		}
+		released.fence = nullptr;
+	}
+
+	// fences signal in order, stop at the first the GPU has not reached
+	size_t done = 0;
+	while (done < inFlight.size())
+	{
+		GLenum status = glClientWaitSync(inFlight[done].fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		for (const std::vector<unsigned int>& names : inFlight[done].names)
+			pending -= (unsigned int)names.size();
+		deleteBatch(inFlight[done]);
+		done++;
+	}
+	for (size_t k = 0; k < done; k++)
+		spareBatches.push_back(std::move(inFlight[k]));
+	inFlight.erase(inFlight.begin(), inFlight.begin() + done);
+}
+
+void GpuResources::shutdown()
+{
+	if (down)
+		return;
+	glFinish();
+	for (Batch& batch : inFlight)
+		deleteBatch(batch);
+	inFlight.clear();
+	deleteBatch(released);
+
+	unsigned int stillLive = 0;
+	for (Slot& slot : slots)
+	{
+		if (slot.name == 0)
+			continue;
+		released.names[slot.type].push_back(slot.name);
+		slot.name = 0;
+		stillLive++;
+	}
+	deleteBatch(released);
+	LOG_INFO("gpu resources: " << stillLive << " objects deleted at shutdown, " << slots.size() << " slots, "
+		<< staleLookups << " stale handle lookups");
+	std::fill(live, live + GpuResourceTypeCount, 0u);
+	std::fill(bytes, bytes + GpuResourceTypeCount, (size_t)0);
+	pending = 0;
+	down = true;
+}
+
+GpuResourceStats GpuResources::stats() const
+{
+	GpuResourceStats result;
+	std::copy(live, live + GpuResourceTypeCount, result.live);
+	std::copy(bytes, bytes + GpuResourceTypeCount, result.bytes);
+	result.pendingDeletes = pending;
+	result.staleLookups = staleLookups;
+	return result;
+}
+
+GpuResources& gpuResources()
+{
+	static GpuResources instance;
+	return instance;
+}
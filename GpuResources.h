@@ -0,0 +1,165 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+enum GpuResourceType
+{
+	GpuBuffer = 0,
+	GpuVertexArray = 1,
+	GpuTexture = 2,
+	GpuProgram = 3,
+	GpuFramebuffer = 4,
+	GpuResourceTypeCount = 5,
+};
+
+struct GpuResourceStats
+{
+	unsigned int live[GpuResourceTypeCount];
+	size_t bytes[GpuResourceTypeCount];   // what the owners reported with setBytes
+	unsigned int pendingDeletes;          // released, waiting for the GPU to pass their fence
+	unsigned int staleLookups;            // name() through a handle whose object is gone
+};
+
+// Slot map of the GL objects owned through GpuHandle. A handle is a slot index
+// and the generation the slot had when the object was created; releasing bumps
+// the generation, so a handle that outlived its object resolves to 0 instead
+// of to whatever reused the slot.
+//
+// Released names are not deleted right away. endFrame() puts a fence behind
+// the frame that released them and they are deleted, one glDelete* per type,
+// once the GPU has passed it, so a program or buffer swapped out mid-frame is
+// never deleted under a draw still in flight. GL thread only.
+class GpuResources
+{
+public:
+	struct Id
+	{
+		unsigned int index;
+		unsigned int generation;  // 0 is the null handle
+	};
+
+	GpuResources();
+
+	// count objects with one glGen* call
+	void create(GpuResourceType type, unsigned int count, Id* ids);
+	// takes over a name made elsewhere, e.g. glCreateProgram
+	Id adopt(GpuResourceType type, unsigned int name);
+	void release(Id id);
+
+	unsigned int name(Id id) const
+	{
+		if (id.generation == 0)
+			return 0;
+		if (id.index >= slots.size() || slots[id.index].generation != id.generation)
+		{
+			staleLookups++;
+			return 0;
+		}
+		return slots[id.index].name;
+	}
+	void setBytes(Id id, size_t bytes);
+
+	// after the last command of the frame, deletes the batches the GPU is done with
+	void endFrame();
+	// waits for the GPU and deletes everything, handles destroyed later do nothing
+	void shutdown();
+
+	GpuResourceStats stats() const;
+
+private:
+	struct Slot
+	{
+		unsigned int name;
+		unsigned int generation;
+		GpuResourceType type;
+		size_t bytes;
+	};
+
+	struct Batch
+	{
+		GLsync fence;
+		std::vector<unsigned int> names[GpuResourceTypeCount];
+	};
+
+	Id allocateSlot(GpuResourceType type, unsigned int name);
+	static void deleteNames(GpuResourceType type, std::vector<unsigned int>& names);
+	static void deleteBatch(Batch& batch);
+
+	std::vector<Slot> slots;
+	std::vector<unsigned int> freeSlots;
+	Batch released;                // this frame, no fence yet
+	std::vector<Batch> inFlight;   // oldest first
+	std::vector<Batch> spareBatches;
+	unsigned int live[GpuResourceTypeCount];
+	size_t bytes[GpuResourceTypeCount];
+	unsigned int pending;
+	mutable unsigned int staleLookups;
+	bool down;
+};
+
+GpuResources& gpuResources();
+
+// Move-only owner of one GL object, released through gpuResources() when it
+// goes out of scope or is reset.
+template <GpuResourceType Type>
+class GpuHandle
+{
+public:
+	GpuHandle() : id{ 0, 0 } {}
+	~GpuHandle() { reset(); }
+
+	GpuHandle(GpuHandle&& other) : id(other.id) { other.id = GpuResources::Id{ 0, 0 }; }
+	GpuHandle& operator=(GpuHandle&& other)
+	{
+		if (this != &other)
+		{
+			reset();
+			id = other.id;
+			other.id = GpuResources::Id{ 0, 0 };
+		}
+		return *this;
+	}
+	GpuHandle(const GpuHandle&) = delete;
+	GpuHandle& operator=(const GpuHandle&) = delete;
+
+	static GpuHandle create()
+	{
+		GpuHandle handle;
+		gpuResources().create(Type, 1, &handle.id);
+		return handle;
+	}
+	// the whole array with one glGen* call
+	static void create(GpuHandle* handles, unsigned int count)
+	{
+		std::vector<GpuResources::Id> ids(count);
+		gpuResources().create(Type, count, ids.data());
+		for (unsigned int k = 0; k < count; k++)
+			handles[k] = GpuHandle(ids[k]);
+	}
+	static GpuHandle adopt(unsigned int name) { return GpuHandle(gpuResources().adopt(Type, name)); }
+
+	unsigned int get() const { return gpuResources().name(id); }
+	void setBytes(size_t bytes) const { gpuResources().setBytes(id, bytes); }
+	explicit operator bool() const { return id.generation != 0; }
+
+	void reset()
+	{
+		if (id.generation)
+			gpuResources().release(id);
+		id = GpuResources::Id{ 0, 0 };
+	}
+
+private:
+	explicit GpuHandle(GpuResources::Id id) : id(id) {}
+
+	GpuResources::Id id;
+};
+
+typedef GpuHandle<GpuBuffer> BufferHandle;
+typedef GpuHandle<GpuVertexArray> VertexArrayHandle;
+typedef GpuHandle<GpuTexture> TextureHandle;
+typedef GpuHandle<GpuProgram> ProgramHandle;
+typedef GpuHandle<GpuFramebuffer> FramebufferHandle;
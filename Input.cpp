@@ -0,0 +1,166 @@
+#include "Input.h"
+#include "Log.h"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+Input::Input()
+	: enqueuePosition(0), dequeuePosition(0), droppedCount(0), cursor(0.0f), delta(0.0f), cursorKnown(false),
+	frameEvents(0), frameOldest(0.0), frameFirst(0.0), frameTimeSum(0.0), latencySamples(0), latencySum(0.0), latencyMax(0.0)
+{
+	for (unsigned int k = 0; k < Capacity; k++)
+		cells[k].sequence.store(k, std::memory_order_relaxed);
+	memset(keys, 0, sizeof(keys));
+	memset(actionHeld, 0, sizeof(actionHeld));
+	memset(pressCounts, 0, sizeof(pressCounts));
+}
+
+double Input::now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Input::attach(GLFWwindow* window)
+{
+	glfwSetWindowUserPointer(window, this);
+	glfwSetKeyCallback(window, keyCallback);
+	glfwSetMouseButtonCallback(window, mouseButtonCallback);
+	glfwSetCursorPosCallback(window, cursorCallback);
+}
+
+void Input::keyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
+{
+	InputEvent event = { InputKey, key, action, 0.0, 0.0, now() };
+	((Input*)glfwGetWindowUserPointer(window))->push(event);
+}
+
+void Input::mouseButtonCallback(GLFWwindow* window, int button, int action, int /*mods*/)
+{
+	InputEvent event = { InputKey, mouseButton(button), action, 0.0, 0.0, now() };
+	((Input*)glfwGetWindowUserPointer(window))->push(event);
+}
+
+void Input::cursorCallback(GLFWwindow* window, double x, double y)
+{
+	InputEvent event = { InputCursor, -1, 0, x, y, now() };
+	((Input*)glfwGetWindowUserPointer(window))->push(event);
+}
+
+bool Input::push(const InputEvent& event)
+{
+	// GLFW_KEY_UNKNOWN for keys without a code, or whatever another thread made up
+	if (event.type == InputKey && (event.key < 0 || event.key >= KeyCount))
+		return false;
+	unsigned int position = enqueuePosition.load(std::memory_order_relaxed);
+	Cell* cell;
+	for (;;)
+	{
+		cell = &cells[position % Capacity];
+		int difference = (int)(cell->sequence.load(std::memory_order_acquire) - position);
+		if (difference == 0)
+		{
+			if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (difference < 0)
+		{
+			droppedCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else
+			position = enqueuePosition.load(std::memory_order_relaxed);
+	}
+	cell->event = event;
+	cell->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+void Input::bind(int action, int key, int modifierKey)
+{
+	if (action < 0 || action >= MaxActions || key < 0 || key >= KeyCount || modifierKey >= KeyCount)
+	{
+		LOG_ERROR("ERROR::INPUT::BAD_BINDING action " << action << " key " << key);
+		return;
+	}
+	bindings.push_back(Binding{ action, key, modifierKey });
+}
+
+void Input::update()
+{
+	memset(pressCounts, 0, sizeof(pressCounts));
+	delta = glm::vec2(0.0f);
+	frameEvents = 0;
+	frameTimeSum = 0.0;
+	for (;;)
+	{
+		Cell& cell = cells[dequeuePosition % Capacity];
+		if ((int)(cell.sequence.load(std::memory_order_acquire) - (dequeuePosition + 1)) < 0)
+			break;
+		InputEvent event = cell.event;
+		cell.sequence.store(dequeuePosition + Capacity, std::memory_order_release);
+		dequeuePosition++;
+
+		// summed relative to the first event, the absolute clock values would eat the digits
+		if (!frameEvents)
+			frameOldest = frameFirst = event.time;
+		frameOldest = std::min(frameOldest, event.time);
+		frameTimeSum += event.time - frameFirst;
+		frameEvents++;
+
+		if (event.type == InputCursor)
+		{
+			glm::vec2 position((float)event.x, (float)event.y);
+			// the first position has nothing to move from
+			if (cursorKnown)
+				delta += position - cursor;
+			cursor = position;
+			cursorKnown = true;
+		}
+		else if (event.action == GLFW_PRESS)
+		{
+			// bindings that go down with this key, not the ones already held through another
+			for (const Binding& binding : bindings)
+				if (binding.key == event.key && (binding.modifierKey < 0 || keys[binding.modifierKey]))
+					pressCounts[binding.action]++;
+			keys[event.key] = true;
+		}
+		else if (event.action == GLFW_RELEASE)
+			keys[event.key] = false;
+	}
+
+	memset(actionHeld, 0, sizeof(actionHeld));
+	for (const Binding& binding : bindings)
+		if (keys[binding.key] && (binding.modifierKey < 0 || keys[binding.modifierKey]))
+			actionHeld[binding.action] = true;
+}
+
+void Input::framePresented()
+{
+	if (!frameEvents)
+		return;
+	double presented = now();
+	latencySum += (presented - frameFirst) * frameEvents - frameTimeSum;
+	latencyMax = std::max(latencyMax, presented - frameOldest);
+	latencySamples += frameEvents;
+}
+
+void Input::resetLatency()
+{
+	latencySamples = 0;
+	latencySum = 0.0;
+	latencyMax = 0.0;
+}
+
+InputStats Input::stats() const
+{
+	InputStats result;
+	result.events = frameEvents;
+	result.dropped = droppedCount.load(std::memory_order_relaxed);
+	result.latencySamples = latencySamples;
+	result.latencyMilliseconds = latencySamples ? latencySum / latencySamples * 1000.0 : 0.0;
+	result.maxLatencyMilliseconds = latencyMax * 1000.0;
+	return result;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <vector>
+
+struct GLFWwindow;
+
+enum InputEventType
+{
+	InputKey,     // keys and mouse buttons, see Input::mouseButton()
+	InputCursor,
+};
+
+struct InputEvent
+{
+	InputEventType type;
+	int key;        // GLFW_KEY_* or Input::mouseButton(GLFW_MOUSE_BUTTON_*)
+	int action;     // GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+	double x, y;    // cursor position in screen coordinates
+	double time;    // Input::now() when it happened
+};
+
+struct InputStats
+{
+	unsigned int events;          // taken by the last update()
+	unsigned long long dropped;   // queue full, since the start
+	// from an event to the end of the frame that used it, over the frames since resetLatency()
+	unsigned int latencySamples;
+	double latencyMilliseconds, maxLatencyMilliseconds;
+};
+
+// Keyboard and cursor input for the render thread. The GLFW callbacks, or any
+// thread injecting events, push into a bounded lock-free queue and update()
+// takes everything queued once per frame, so no state is read from GLFW or
+// the driver while a frame runs.
+//
+// Actions are named by the application and bound to keys. Every action is
+// evaluated on its own, any number of them can be held at once, and pressed()
+// counts how often an action went down since the last update so a tap shorter
+// than a frame is not lost.
+class Input
+{
+public:
+	static const unsigned int Capacity = 1024;
+	static const int MaxActions = 32;
+	static const int KeyCount = 512;
+
+	Input();
+
+	Input(const Input&) = delete;
+	Input& operator=(const Input&) = delete;
+
+	// installs the key, mouse button and cursor callbacks, the window's user pointer is this Input
+	void attach(GLFWwindow* window);
+
+	// from any thread, false when the queue is full or a key is outside 0 .. KeyCount - 1
+	// and the event is dropped
+	bool push(const InputEvent& event);
+	// seconds on the clock of InputEvent::time
+	static double now();
+	// mouse buttons live above the keys so they bind like keys
+	static int mouseButton(int button) { return 400 + button; }
+
+	// action is held while key is down, and modifierKey with it when there is one:
+	// bind(sprint, GLFW_KEY_W, GLFW_KEY_LEFT_SHIFT). An action can have several bindings.
+	void bind(int action, int key, int modifierKey = -1);
+
+	// takes the queued events, once per frame on the render thread
+	void update();
+	bool held(int action) const { return actionHeld[action]; }
+	unsigned int pressed(int action) const { return pressCounts[action]; }
+	// cursor movement over the events of the last update()
+	glm::vec2 cursorDelta() const { return delta; }
+
+	// the frame drawn after the last update() is on screen, its events count toward the latency
+	void framePresented();
+	void resetLatency();
+	InputStats stats() const;
+
+private:
+	struct Cell
+	{
+		std::atomic<unsigned int> sequence;
+		InputEvent event;
+	};
+
+	struct Binding
+	{
+		int action, key, modifierKey;
+	};
+
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+	static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+	static void cursorCallback(GLFWwindow* window, double x, double y);
+
+	// bounded queue after Dmitry Vyukov like the log's, the render thread the only consumer
+	Cell cells[Capacity];
+	std::atomic<unsigned int> enqueuePosition;
+	unsigned int dequeuePosition;
+	std::atomic<unsigned long long> droppedCount;
+
+	bool keys[KeyCount];
+	std::vector<Binding> bindings;
+	bool actionHeld[MaxActions];
+	unsigned int pressCounts[MaxActions];
+	glm::vec2 cursor, delta;
+	bool cursorKnown;
+
+	// events of the last update(): the oldest, the first taken and the sum of their times after the first
+	unsigned int frameEvents;
+	double frameOldest, frameFirst, frameTimeSum;
+	unsigned int latencySamples;
+	double latencySum, latencyMax;
+};
@@ -0,0 +1,157 @@
+#include "Instrument.h"
+
+#include <memory>
+#include <mutex>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define INSTRUMENT_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define INSTRUMENT_RDTSC 1
+#endif
+
+namespace
+{
+	struct Event
+	{
+		const char* name;
+		InstrumentTicks begin, end;
+	};
+
+	// single producer (the owning thread), single consumer (the collector)
+	struct ThreadBuffer
+	{
+		static const unsigned int Capacity = 8192;
+
+		ThreadBuffer(unsigned int index) : index(index), name("thread " + std::to_string(index)), head(0), tail(0), dropped(0) {}
+
+		unsigned int index;
+		std::string name;
+		std::atomic<unsigned int> head, tail;
+		std::atomic<unsigned long long> dropped;
+		Event events[Capacity];
+	};
+
+	// buffers outlive their threads, the events of a finished worker can still be collected
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+	ThreadBuffer& threadBuffer()
+	{
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (!buffer)
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			registry.emplace_back(new ThreadBuffer((unsigned int)registry.size()));
+			buffer = registry.back().get();
+		}
+		return *buffer;
+	}
+}
+
+InstrumentTicks instrumentNow()
+{
+#ifdef INSTRUMENT_RDTSC
+	return __rdtsc();
+#else
+	return (InstrumentTicks)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void instrumentEvent(const char* name, InstrumentTicks begin, InstrumentTicks end)
+{
+	ThreadBuffer& buffer = threadBuffer();
+	unsigned int head = buffer.head.load(std::memory_order_relaxed);
+	if (head - buffer.tail.load(std::memory_order_acquire) == ThreadBuffer::Capacity)
+	{
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	Event& event = buffer.events[head % ThreadBuffer::Capacity];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void instrumentThreadName(const char* name)
+{
+	ThreadBuffer& buffer = threadBuffer();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	buffer.name = name + std::string(" ") + std::to_string(buffer.index);
+}
+
+InstrumentCollector::InstrumentCollector() : oldest(0)
+{
+	firstTicks = lastTicks = instrumentNow();
+	firstTime = lastTime = std::chrono::steady_clock::now();
+}
+
+std::chrono::steady_clock::time_point InstrumentCollector::toSteady(InstrumentTicks ticks) const
+{
+	double ticksPerNanosecond = 1.0;
+#ifdef INSTRUMENT_RDTSC
+	double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(lastTime - firstTime).count();
+	if (elapsed > 0.0 && lastTicks > firstTicks)
+		ticksPerNanosecond = (lastTicks - firstTicks) / elapsed;
+#endif
+	double nanoseconds = ((long long)(ticks - firstTicks)) / ticksPerNanosecond;
+	return firstTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::nano>(nanoseconds));
+}
+
+void InstrumentCollector::collectFrame()
+{
+	lastTicks = instrumentNow();
+	lastTime = std::chrono::steady_clock::now();
+
+	std::vector<TimelineEvent>* frame;
+	if (timeline.size() < MaxFrames)
+	{
+		timeline.emplace_back();
+		frame = &timeline.back();
+	}
+	else
+	{
+		frame = &timeline[oldest];
+		oldest = (oldest + 1) % MaxFrames;
+		frame->clear();
+	}
+
+	// the lock only keeps new threads from growing the registry meanwhile
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : registry)
+	{
+		unsigned int tail = buffer->tail.load(std::memory_order_relaxed);
+		unsigned int head = buffer->head.load(std::memory_order_acquire);
+		for (; tail != head; tail++)
+		{
+			const Event& event = buffer->events[tail % ThreadBuffer::Capacity];
+			TimelineEvent timelineEvent;
+			timelineEvent.name = event.name;
+			timelineEvent.thread = buffer->index;
+			timelineEvent.begin = toSteady(event.begin);
+			timelineEvent.microseconds = std::chrono::duration<double, std::micro>(toSteady(event.end) - timelineEvent.begin).count();
+			frame->push_back(timelineEvent);
+		}
+		buffer->tail.store(tail, std::memory_order_release);
+	}
+}
+
+std::vector<std::string> InstrumentCollector::threadNames() const
+{
+	std::vector<std::string> names;
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : registry)
+		names.push_back(buffer->name);
+	return names;
+}
+
+unsigned long long InstrumentCollector::droppedEvents() const
+{
+	unsigned long long dropped = 0;
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : registry)
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+	return dropped;
+}
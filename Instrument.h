@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// CPU instrumentation for multithreaded analysis. INSTRUMENT_SCOPE(name) records
+// the begin and end timestamp of the enclosing block into a ring buffer owned
+// by the calling thread, a single producer / single consumer queue that needs
+// no lock. InstrumentCollector drains the buffers of every thread into a frame
+// timeline. Building with GRAFIKA_INSTRUMENT=0 turns the macros into nothing.
+#ifndef GRAFIKA_INSTRUMENT
+#define GRAFIKA_INSTRUMENT 1
+#endif
+
+typedef unsigned long long InstrumentTicks;
+
+// rdtsc on x86, steady_clock nanoseconds elsewhere
+InstrumentTicks instrumentNow();
+// name must outlive the program, a string literal
+void instrumentEvent(const char* name, InstrumentTicks begin, InstrumentTicks end);
+void instrumentThreadName(const char* name);
+
+class InstrumentScope
+{
+public:
+	explicit InstrumentScope(const char* name) : name(name), begin(instrumentNow()) {}
+	~InstrumentScope() { instrumentEvent(name, begin, instrumentNow()); }
+
+private:
+	const char* name;
+	InstrumentTicks begin;
+};
+
+#if GRAFIKA_INSTRUMENT
+#define INSTRUMENT_CONCAT2(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT2(a, b)
+#define INSTRUMENT_SCOPE(name) InstrumentScope INSTRUMENT_CONCAT(instrumentScope, __LINE__)(name)
+#define INSTRUMENT_THREAD(name) instrumentThreadName(name)
+#else
+#define INSTRUMENT_SCOPE(name) ((void)0)
+#define INSTRUMENT_THREAD(name) ((void)0)
+#endif
+
+struct TimelineEvent
+{
+	const char* name;
+	unsigned int thread;                          // index into InstrumentCollector::threadNames()
+	std::chrono::steady_clock::time_point begin;
+	double microseconds;
+};
+
+// Owned by one thread, usually the main one, which calls collectFrame once per
+// frame. Everything recorded since the previous call becomes one frame.
+class InstrumentCollector
+{
+public:
+	static const unsigned int MaxFrames = 600;
+
+	InstrumentCollector();
+
+	void collectFrame();
+
+	// oldest first, a frame keeps its storage when the ring comes around
+	size_t frameCount() const { return timeline.size(); }
+	const std::vector<TimelineEvent>& frame(size_t k) const { return timeline[(oldest + k) % timeline.size()]; }
+	std::vector<std::string> threadNames() const;
+	// events lost to a full thread buffer, since the start
+	unsigned long long droppedEvents() const;
+
+private:
+	std::chrono::steady_clock::time_point toSteady(InstrumentTicks ticks) const;
+
+	// two readings of both clocks, the rate between them converts ticks
+	InstrumentTicks firstTicks, lastTicks;
+	std::chrono::steady_clock::time_point firstTime, lastTime;
+	std::vector<std::vector<TimelineEvent>> timeline;
+	size_t oldest;
+};
@@ -0,0 +1,48 @@
+#include "Lod.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool lodFadeDraws(int x, int y, float fade, bool outgoing)
+{
+	static const float bayer[16] = { 0.0f, 8.0f, 2.0f, 10.0f, 12.0f, 4.0f, 14.0f, 6.0f, 3.0f, 11.0f, 1.0f, 9.0f, 15.0f, 7.0f, 13.0f, 5.0f };
+	if (fade >= 1.0f)
+		return true;
+	float threshold = (bayer[(y & 3) * 4 + (x & 3)] + 0.5f) / 16.0f;
+	return (threshold < fade) != outgoing;
+}
+
+LodSelector::LodSelector(float viewportHeight, float fovY)
+	: pixelError(1.0f), hysteresis(0.25f), fadeTime(0.25f)
+{
+	pixelsPerUnit = viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+}
+
+float LodSelector::projectedError(float error, float distance) const
+{
+	return error * pixelsPerUnit / std::max(distance, 0.001f);
+}
+
+unsigned int LodSelector::select(const std::vector<MeshLod>& lods, float distance, unsigned int current) const
+{
+	unsigned int lod = std::min(current, (unsigned int)lods.size() - 1);
+	while (lod + 1 < lods.size() && projectedError(lods[lod + 1].error, distance) < pixelError * (1.0f - hysteresis))
+		lod++;
+	while (lod > 0 && projectedError(lods[lod].error, distance) > pixelError * (1.0f + hysteresis))
+		lod--;
+	return lod;
+}
+
+void LodSelector::update(LodState& state, const std::vector<MeshLod>& lods, float distance, float deltaTime) const
+{
+	unsigned int lod = select(lods, distance, state.lod);
+	if (lod != state.lod)
+	{
+		state.previousLod = state.lod;
+		state.lod = lod;
+		// the switching frame is the first step of the fade
+		state.fade = fadeTime > 0.0f ? std::min(1.0f, deltaTime / fadeTime) : 1.0f;
+	}
+	else if (state.fade < 1.0f)
+		state.fade = std::min(1.0f, state.fade + deltaTime / fadeTime);
+}
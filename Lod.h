@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <vector>
+
+struct LodState
+{
+	unsigned int lod;
+	unsigned int previousLod;
+	float fade; // 1 once the crossfade from previousLod has finished
+};
+
+// the dither test of light_cube.frag: whether the level fading in (outgoing false)
+// or the one fading out draws pixel x, y at fade. Below 1 exactly one of them does.
+bool lodFadeDraws(int x, int y, float fade, bool outgoing);
+
+// Picks the coarsest level whose error projects to less than pixelError pixels.
+// The hysteresis band keeps objects near a switching distance from popping
+// back and forth every frame.
+class LodSelector
+{
+public:
+	float pixelError;
+	float hysteresis;
+	float fadeTime; // seconds, 0 switches levels without a crossfade
+
+	LodSelector(float viewportHeight, float fovY);
+
+	float projectedError(float error, float distance) const;
+	unsigned int select(const std::vector<MeshLod>& lods, float distance, unsigned int current) const;
+	void update(LodState& state, const std::vector<MeshLod>& lods, float distance, float deltaTime) const;
+
+private:
+	float pixelsPerUnit;
+};
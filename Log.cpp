@@ -0,0 +1,307 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const size_t SlotText = 1000;
+	// LogMessages alive at once on one thread, one formatting into another's arguments
+	const int MaxNesting = 4;
+
+	int formatPrefix(char* out, size_t size, float seconds, LogLevel level)
+	{
+		static const char* const levelNames[] = { "debug", "info ", "warn ", "error" };
+		return snprintf(out, size, "[%9.3f] %s ", seconds, levelNames[level]);
+	}
+
+	struct Slot
+	{
+		std::atomic<unsigned int> sequence;
+		LogLevel level;
+		float seconds;
+		unsigned int length;
+		char text[SlotText];
+	};
+
+	// Bounded queue after Dmitry Vyukov: a producer claims a position with one
+	// compare and swap, then publishes the slot through its sequence number.
+	// The writer thread is the only consumer.
+	//
+	// Debug and info records stop at Reserved free slots, which are left to
+	// warnings and errors. Should even those run out, a warning or error is
+	// written synchronously by the thread that logs it, so none is ever lost.
+	class Logger
+	{
+	public:
+		static const unsigned int Capacity = 2048;
+		static const unsigned int Reserved = 256;
+
+		Logger() : enqueuePosition(0), dequeued(0), written(0), dropped(0), synchronous(0), quit(false), output(&std::cout), start(Clock::now())
+		{
+			for (unsigned int k = 0; k < Capacity; k++)
+				slots[k].sequence.store(k, std::memory_order_relaxed);
+			writer = std::thread(&Logger::writerLoop, this);
+		}
+
+		~Logger()
+		{
+			quit.store(true);
+			wake.notify_one();
+			writer.join();
+		}
+
+		void push(LogLevel level, const char* text, size_t length)
+		{
+			unsigned int position = enqueuePosition.load(std::memory_order_relaxed);
+			Slot* slot;
+			for (;;)
+			{
+				slot = &slots[position % Capacity];
+				int difference = (int)(slot->sequence.load(std::memory_order_acquire) - position);
+				if (difference == 0)
+				{
+					if (level < LogWarning && position - dequeued.load(std::memory_order_relaxed) >= Capacity - Reserved)
+					{
+						dropped.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+					if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0)
+				{
+					if (level >= LogWarning)
+						writeNow(level, text, length);
+					else
+						dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				else
+					position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+
+			slot->level = level;
+			slot->seconds = std::chrono::duration<float>(Clock::now() - start).count();
+			slot->length = (unsigned int)std::min(length, SlotText);
+			memcpy(slot->text, text, slot->length);
+			slot->sequence.store(position + 1, std::memory_order_release);
+			// the writer polls every few milliseconds anyway, errors go out right away
+			if (level >= LogWarning)
+				wake.notify_one();
+		}
+
+		void flush()
+		{
+			unsigned int target = enqueuePosition.load(std::memory_order_acquire);
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.notify_one();
+			flushed.wait(lock, [this, target] { return (int)(written.load() - target) >= 0; });
+		}
+
+		void setOutput(std::ostream* stream)
+		{
+			flush();
+			std::lock_guard<std::mutex> lock(outputMutex);
+			output = stream ? stream : &std::cout;
+		}
+
+		unsigned long long droppedCount() const
+		{
+			return dropped.load(std::memory_order_relaxed);
+		}
+
+		void countDropped()
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		unsigned long long synchronousCount() const
+		{
+			return synchronous.load(std::memory_order_relaxed);
+		}
+
+	private:
+		// out of order with the queued records, but written
+		void writeNow(LogLevel level, const char* text, size_t length)
+		{
+			char prefix[32];
+			int prefixLength = formatPrefix(prefix, sizeof(prefix), std::chrono::duration<float>(Clock::now() - start).count(), level);
+			std::lock_guard<std::mutex> lock(outputMutex);
+			output->write(prefix, prefixLength);
+			output->write(text, std::min(length, SlotText));
+			output->put('\n');
+			output->flush();
+			synchronous.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void writerLoop()
+		{
+			unsigned int dequeuePosition = 0;
+			unsigned long long reportedDrops = 0;
+			std::string batch;
+			char prefix[32];
+			for (;;)
+			{
+				bool stopping = quit.load();
+				for (;;)
+				{
+					Slot& slot = slots[dequeuePosition % Capacity];
+					if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+						break;
+					int prefixLength = formatPrefix(prefix, sizeof(prefix), slot.seconds, slot.level);
+					batch.append(prefix, prefixLength);
+					batch.append(slot.text, slot.length);
+					batch += '\n';
+					slot.sequence.store(dequeuePosition + Capacity, std::memory_order_release);
+					dequeuePosition++;
+					dequeued.store(dequeuePosition, std::memory_order_relaxed);
+				}
+				unsigned long long drops = dropped.load(std::memory_order_relaxed);
+				if (drops != reportedDrops)
+				{
+					batch += "[log] " + std::to_string(drops - reportedDrops) + " messages dropped, the queue was full\n";
+					reportedDrops = drops;
+				}
+
+				if (!batch.empty())
+				{
+					std::lock_guard<std::mutex> lock(outputMutex);
+					output->write(batch.data(), batch.size());
+					output->flush();
+					batch.clear();
+				}
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					written.store(dequeuePosition);
+				}
+				flushed.notify_all();
+
+				if (stopping && slots[dequeuePosition % Capacity].sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+					return;
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait_for(lock, std::chrono::milliseconds(2));
+			}
+		}
+
+		Slot slots[Capacity];
+		std::atomic<unsigned int> enqueuePosition;
+		std::atomic<unsigned int> dequeued;  // taken by the writer, behind it written once on the output
+		std::atomic<unsigned int> written;
+		std::atomic<unsigned long long> dropped, synchronous;
+		std::atomic<bool> quit;
+
+		std::mutex mutex, outputMutex;
+		std::condition_variable wake, flushed;
+		std::ostream* output;
+		Clock::time_point start;
+		std::thread writer;
+	};
+
+	Logger& logger()
+	{
+		static Logger instance;
+		return instance;
+	}
+
+	// formats straight into a per-thread buffer, whatever does not fit is cut off
+	class FixedBuffer : public std::streambuf
+	{
+	public:
+		void reset() { setp(text, text + SlotText); }
+		size_t length() const { return pptr() - pbase(); }
+		const char* data() const { return text; }
+
+	private:
+		char text[SlotText];
+	};
+
+	struct ThreadStream
+	{
+		ThreadStream() : stream(&buffer) {}
+
+		FixedBuffer buffer;
+		std::ostream stream;
+	};
+
+	// one buffer per nesting level, a message logged while another is being
+	// formatted gets the next one instead of overwriting it
+	struct ThreadStreams
+	{
+		ThreadStreams() : depth(0), discard(nullptr) { discard.setstate(std::ios::badbit); }
+
+		ThreadStream levels[MaxNesting];
+		int depth;
+		std::ostream discard;  // deeper than MaxNesting, the message is dropped
+	};
+
+	ThreadStreams& threadStreams()
+	{
+		thread_local ThreadStreams instance;
+		return instance;
+	}
+}
+
+void logWrite(LogLevel level, const char* text, size_t length)
+{
+	logger().push(level, text, length);
+}
+
+void logFlush()
+{
+	logger().flush();
+}
+
+void logSetOutput(std::ostream* stream)
+{
+	logger().setOutput(stream);
+}
+
+unsigned long long logDropped()
+{
+	return logger().droppedCount();
+}
+
+unsigned long long logSynchronous()
+{
+	return logger().synchronousCount();
+}
+
+LogMessage::LogMessage(LogLevel level) : level(level)
+{
+	ThreadStreams& thread = threadStreams();
+	depth = thread.depth++;
+	if (depth >= MaxNesting)
+		return;
+	thread.levels[depth].buffer.reset();
+	thread.levels[depth].stream.clear();
+}
+
+LogMessage::~LogMessage()
+{
+	ThreadStreams& thread = threadStreams();
+	thread.depth--;
+	if (depth >= MaxNesting)
+	{
+		logger().countDropped();
+		return;
+	}
+	const FixedBuffer& buffer = thread.levels[depth].buffer;
+	logWrite(level, buffer.data(), buffer.length());
+}
+
+std::ostream& LogMessage::stream()
+{
+	ThreadStreams& thread = threadStreams();
+	return depth < MaxNesting ? thread.levels[depth].stream : thread.discard;
+}
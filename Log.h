@@ -0,0 +1,73 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+// Asynchronous logging. LOG_INFO("lights: " << count) formats the message on
+// the calling thread and pushes the finished record into a bounded lock-free
+// multi producer queue; a writer thread does the I/O, so neither the render
+// loop nor the workers ever wait on the console. When the queue is full a
+// debug or info record is dropped and counted instead of blocking; warnings
+// and errors have slots of their own and are written on the calling thread
+// when even those are taken.
+//
+// Levels below GRAFIKA_LOG_LEVEL are compiled out together with their arguments,
+// which are still type checked so variables only logged stay used.
+enum LogLevel
+{
+	LogDebug = 0,
+	LogInfo = 1,
+	LogWarning = 2,
+	LogError = 3,
+};
+
+#ifndef GRAFIKA_LOG_LEVEL
+#define GRAFIKA_LOG_LEVEL 1
+#endif
+
+// the message is truncated to what fits into one queue slot
+void logWrite(LogLevel level, const char* text, size_t length);
+// blocks until everything pushed so far is written
+void logFlush();
+// nullptr goes back to std::cout, flushes the old stream first
+void logSetOutput(std::ostream* stream);
+unsigned long long logDropped();
+// warnings and errors that found the queue full and were written by the thread that logged them
+unsigned long long logSynchronous();
+
+// formats into a per-thread stream, pushed when it goes out of scope. A message
+// logged while building another, from an operator<< say, nests a few deep.
+class LogMessage
+{
+public:
+	explicit LogMessage(LogLevel level);
+	~LogMessage();
+
+	std::ostream& stream();
+
+private:
+	LogLevel level;
+	int depth;
+};
+
+// a constant, for messages built over several statements: if (LOG_ENABLED(LogInfo)) { LogMessage line(LogInfo); ... }
+#define LOG_ENABLED(level) ((level) >= GRAFIKA_LOG_LEVEL)
+#define LOG_AT(level, message) do { LogMessage logMessage(level); logMessage.stream() << message; } while (0)
+#define LOG_DISABLED(level, message) do { if (false) { LogMessage logMessage(level); logMessage.stream() << message; } } while (0)
+
+#if GRAFIKA_LOG_LEVEL <= 0
+#define LOG_DEBUG(message) LOG_AT(LogDebug, message)
+#else
+#define LOG_DEBUG(message) LOG_DISABLED(LogDebug, message)
+#endif
+#if GRAFIKA_LOG_LEVEL <= 1
+#define LOG_INFO(message) LOG_AT(LogInfo, message)
+#else
+#define LOG_INFO(message) LOG_DISABLED(LogInfo, message)
+#endif
+#if GRAFIKA_LOG_LEVEL <= 2
+#define LOG_WARNING(message) LOG_AT(LogWarning, message)
+#else
+#define LOG_WARNING(message) LOG_DISABLED(LogWarning, message)
+#endif
+#define LOG_ERROR(message) LOG_AT(LogError, message)
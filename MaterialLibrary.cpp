@@ -0,0 +1,210 @@
+#include "MaterialLibrary.h"
+
+#include "Log.h"
+#include "MipChain.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	typedef GLuint64 (APIENTRYP GetTextureHandleProc)(GLuint texture);
+	typedef void (APIENTRYP MakeTextureHandleResidentProc)(GLuint64 handle);
+	typedef void (APIENTRYP MakeTextureHandleNonResidentProc)(GLuint64 handle);
+
+	// not part of the GL 3.3 loader, filled by loadBindless
+	GetTextureHandleProc getTextureHandle = nullptr;
+	MakeTextureHandleResidentProc makeTextureHandleResident = nullptr;
+	MakeTextureHandleNonResidentProc makeTextureHandleNonResident = nullptr;
+
+	bool hasExtension(const char* name)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint k = 0; k < count; k++)
+			if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, k), name) == 0)
+				return true;
+		return false;
+	}
+
+	unsigned int packTint(const glm::vec4& tint)
+	{
+		glm::uvec4 bytes = glm::uvec4(glm::clamp(tint, 0.0f, 1.0f) * 255.0f + 0.5f);
+		return bytes.x | bytes.y << 8 | bytes.z << 16 | bytes.w << 24;
+	}
+}
+
+bool MaterialLibrary::loadBindless(GLADloadproc load)
+{
+	if (!hasExtension("GL_ARB_bindless_texture"))
+		return false;
+	// without it a handle that is not dynamically uniform is undefined, keep to the texture arrays
+	if (!hasExtension("GL_NV_gpu_shader5"))
+	{
+		LOG_INFO("materials: GL_ARB_bindless_texture without GL_NV_gpu_shader5, bindless disabled");
+		return false;
+	}
+	getTextureHandle = (GetTextureHandleProc)load("glGetTextureHandleARB");
+	makeTextureHandleResident = (MakeTextureHandleResidentProc)load("glMakeTextureHandleResidentARB");
+	makeTextureHandleNonResident = (MakeTextureHandleNonResidentProc)load("glMakeTextureHandleNonResidentARB");
+	if (getTextureHandle && makeTextureHandleResident && makeTextureHandleNonResident)
+		return true;
+	getTextureHandle = nullptr;
+	LOG_ERROR("ERROR::MATERIALS::BINDLESS_ENTRY_POINTS_MISSING");
+	return false;
+}
+
+MaterialLibrary::MaterialLibrary() : bindless(false)
+{
+}
+
+unsigned int MaterialLibrary::addTexture(const unsigned char* pixels, int width, int height)
+{
+	unsigned int array = 0;
+	while (array < arrays.size() && (arrays[array].width != width || arrays[array].height != height))
+		array++;
+	if (array == arrays.size())
+	{
+		arrays.emplace_back();
+		arrays.back().width = width;
+		arrays.back().height = height;
+		arrays.back().layers = 0;
+		arrays.back().handle = 0;
+	}
+	TextureArray& target = arrays[array];
+	size_t layerBytes = (size_t)width * height * 4;
+	target.pixels.insert(target.pixels.end(), pixels, pixels + layerBytes);
+	TextureRef ref = { array, target.layers++ };
+	textures.push_back(ref);
+	return (unsigned int)textures.size() - 1;
+}
+
+unsigned int MaterialLibrary::addMaterial(unsigned int first, unsigned int second, const glm::vec4& tint)
+{
+	Material material = { first, second, tint };
+	materials.push_back(material);
+	return (unsigned int)materials.size() - 1;
+}
+
+void MaterialLibrary::create(bool useBindless, bool cpuMips)
+{
+	bindless = useBindless && getTextureHandle != nullptr;
+	double mipMilliseconds = 0.0;
+	MipChain chain;
+	for (TextureArray& array : arrays)
+	{
+		array.texture = TextureHandle::create();
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture.get());
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		if (cpuMips)
+		{
+			// every level allocated, then filled a layer at a time
+			const size_t layerBytes = (size_t)array.width * array.height * 4;
+			const int levels = mipLevelCount(array.width, array.height);
+			for (int level = 0, width = array.width, height = array.height; level < levels; level++)
+			{
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, width, height, array.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+				width = mipSize(width);
+				height = mipSize(height);
+			}
+			for (unsigned int layer = 0; layer < array.layers; layer++)
+			{
+				chain.generate(&array.pixels[layer * layerBytes], array.width, array.height);
+				mipMilliseconds += chain.milliseconds();
+				for (int level = 0; level < levels; level++)
+					glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, chain.width(level), chain.height(level), 1,
+						GL_RGBA, GL_UNSIGNED_BYTE, chain.level(level));
+			}
+		}
+		else
+		{
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, array.width, array.height, array.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, array.pixels.data());
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		}
+		array.texture.setBytes(array.pixels.size() * 4 / 3);
+		std::vector<unsigned char>().swap(array.pixels);
+		// the texture's state is frozen once it has a handle
+		if (bindless)
+		{
+			array.handle = getTextureHandle(array.texture.get());
+			makeTextureHandleResident(array.handle);
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// two texels per material: the layers and the tint, then the arrays' handles
+	std::vector<glm::uvec4> texels(materials.size() * 2, glm::uvec4(0));
+	for (size_t k = 0; k < materials.size(); k++)
+	{
+		const TextureRef& first = textures[materials[k].first];
+		const TextureRef& second = textures[materials[k].second];
+		if (!bindless && first.array != second.array)
+			LOG_ERROR("ERROR::MATERIALS::TEXTURE_SIZES_DIFFER material " << k);
+		texels[k * 2] = glm::uvec4(first.layer, second.layer, packTint(materials[k].tint), first.array);
+		GLuint64 firstHandle = arrays[first.array].handle, secondHandle = arrays[second.array].handle;
+		texels[k * 2 + 1] = glm::uvec4((unsigned int)firstHandle, (unsigned int)(firstHandle >> 32),
+			(unsigned int)secondHandle, (unsigned int)(secondHandle >> 32));
+	}
+	materialBuffer = BufferHandle::create();
+	materialTexture = TextureHandle::create();
+	size_t bytes = std::max(texels.size(), (size_t)1) * sizeof(glm::uvec4);
+	glBindBuffer(GL_TEXTURE_BUFFER, materialBuffer.get());
+	glBufferData(GL_TEXTURE_BUFFER, bytes, texels.empty() ? nullptr : texels.data(), GL_STATIC_DRAW);
+	materialBuffer.setBytes(bytes);
+	glBindTexture(GL_TEXTURE_BUFFER, materialTexture.get());
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, materialBuffer.get());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	MaterialStats created = stats();
+	LOG_INFO("materials: " << created.materials << " materials, " << created.textures << " textures in "
+		<< created.arrays << " texture arrays, " << (bindless ? "bindless" : "bound per batch"));
+	if (cpuMips)
+		LOG_INFO("materials: mipmaps filtered on the CPU in " << mipMilliseconds << " ms");
+}
+
+void MaterialLibrary::release()
+{
+	for (TextureArray& array : arrays)
+	{
+		// a resident handle keeps the texture alive
+		if (array.handle)
+			makeTextureHandleNonResident(array.handle);
+		array.handle = 0;
+		array.texture.reset();
+	}
+	materialTexture.reset();
+	materialBuffer.reset();
+}
+
+void MaterialLibrary::bind(const Shader& shader, int unit, unsigned int array) const
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_BUFFER, materialTexture.get());
+	shader.setInt("materials", unit);
+	if (!bindless && array < arrays.size())
+	{
+		glActiveTexture(GL_TEXTURE0 + unit + 1);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[array].texture.get());
+		shader.setInt("materialArray", unit + 1);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+unsigned int MaterialLibrary::batchOf(unsigned int material) const
+{
+	return bindless ? 0 : textures[materials[material].first].array;
+}
+
+MaterialStats MaterialLibrary::stats() const
+{
+	MaterialStats result;
+	result.materials = (unsigned int)materials.size();
+	result.textures = (unsigned int)textures.size();
+	result.arrays = (unsigned int)arrays.size();
+	result.bindless = bindless;
+	return result;
+}
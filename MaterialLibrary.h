@@ -0,0 +1,82 @@
+#pragma once
+
+#include "GpuResources.h"
+#include "Shader.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct MaterialStats
+{
+	unsigned int materials;
+	unsigned int textures;
+	unsigned int arrays;     // GL_TEXTURE_2D_ARRAY objects, one per texture size
+	bool bindless;
+};
+
+// Textures of the same size are layers of one GL_TEXTURE_2D_ARRAY and a
+// material is two layers and a tint in a buffer texture, so the square
+// shader's MATERIALS variant draws differently textured instances with one
+// set of bindings. Without bindless textures every material of a batch has to
+// live in the same array; with ARB_bindless_texture and NV_gpu_shader5 the material buffer holds
+// the arrays' handles and any materials go in one batch.
+class MaterialLibrary
+{
+public:
+	// resolves the ARB_bindless_texture entry points, false when the driver
+	// does not have the extension or NV_gpu_shader5, which the shader needs to
+	// sample through a handle that differs per instance. Needs a current context.
+	static bool loadBindless(GLADloadproc load);
+
+	MaterialLibrary();
+
+	MaterialLibrary(const MaterialLibrary&) = delete;
+	MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+	// RGBA8 pixels, copied until create(). Returns the texture id.
+	unsigned int addTexture(const unsigned char* pixels, int width, int height);
+	// without bindless both textures must have the same size
+	unsigned int addMaterial(unsigned int first, unsigned int second, const glm::vec4& tint = glm::vec4(1.0f));
+
+	// GL side: the arrays with their mipmaps and the material buffer. bindless
+	// is ignored unless loadBindless succeeded. cpuMips filters the mipmaps with
+	// MipChain, sRGB correct, instead of glGenerateMipmap.
+	void create(bool bindless, bool cpuMips = false);
+	void release();
+	// materials on unit, the array on unit + 1 unless bindless
+	void bind(const Shader& shader, int unit, unsigned int array = 0) const;
+
+	// materials with the same batch draw together, always 0 with bindless
+	unsigned int batchOf(unsigned int material) const;
+	bool isBindless() const { return bindless; }
+	MaterialStats stats() const;
+
+private:
+	struct TextureArray
+	{
+		int width, height;
+		unsigned int layers;
+		std::vector<unsigned char> pixels;  // until create()
+		TextureHandle texture;
+		GLuint64 handle;
+	};
+
+	struct TextureRef
+	{
+		unsigned int array, layer;
+	};
+
+	struct Material
+	{
+		unsigned int first, second;
+		glm::vec4 tint;
+	};
+
+	std::vector<TextureArray> arrays;
+	std::vector<TextureRef> textures;
+	std::vector<Material> materials;
+	BufferHandle materialBuffer;
+	TextureHandle materialTexture;
+	bool bindless;
+};
@@ -0,0 +1,101 @@
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+
+Mesh::Mesh() : boundsMin(0.0f), boundsMax(0.0f)
+{
+}
+
+Mesh Mesh::fromTriangleList(const float* vertices, unsigned int vertexCount)
+{
+	Mesh mesh;
+	std::map<std::vector<float>, unsigned int> unique;
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		std::vector<float> vertex(vertices + i * vertexSize, vertices + (i + 1) * vertexSize);
+		std::map<std::vector<float>, unsigned int>::iterator found = unique.find(vertex);
+		if (found == unique.end())
+		{
+			unsigned int index = mesh.vertexCount();
+			unique[vertex] = index;
+			mesh.vertices.insert(mesh.vertices.end(), vertex.begin(), vertex.end());
+			mesh.indices.push_back(index);
+		}
+		else
+			mesh.indices.push_back(found->second);
+	}
+	mesh.lods.push_back({ 0, (unsigned int)mesh.indices.size(), 0.0f });
+	mesh.computeBounds();
+	return mesh;
+}
+
+Mesh Mesh::icosphere(unsigned int subdivisions)
+{
+	const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+	std::vector<glm::vec3> points = {
+		{ -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+		{ 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+		{ t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+	};
+	std::vector<unsigned int> triangles = {
+		0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+		1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+		3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+		4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1
+	};
+	for (glm::vec3& p : points)
+		p = glm::normalize(p);
+
+	for (unsigned int s = 0; s < subdivisions; s++)
+	{
+		std::map<std::pair<unsigned int, unsigned int>, unsigned int> midpoints;
+		std::vector<unsigned int> subdivided;
+		subdivided.reserve(triangles.size() * 4);
+		auto midpoint = [&](unsigned int a, unsigned int b) {
+			std::pair<unsigned int, unsigned int> key(std::min(a, b), std::max(a, b));
+			std::map<std::pair<unsigned int, unsigned int>, unsigned int>::iterator found = midpoints.find(key);
+			if (found != midpoints.end())
+				return found->second;
+			points.push_back(glm::normalize(points[a] + points[b]));
+			unsigned int index = (unsigned int)points.size() - 1;
+			midpoints[key] = index;
+			return index;
+		};
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			unsigned int a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+			unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+			unsigned int quads[] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+			subdivided.insert(subdivided.end(), quads, quads + 12);
+		}
+		triangles.swap(subdivided);
+	}
+
+	// unit diameter like the cube, spherical texture coords (the seam is not split)
+	Mesh mesh;
+	for (const glm::vec3& p : points)
+	{
+		float u = 0.5f + std::atan2(p.z, p.x) / (2.0f * 3.14159265f);
+		float v = 0.5f + std::asin(p.y) / 3.14159265f;
+		float vertex[] = { p.x * 0.5f, p.y * 0.5f, p.z * 0.5f, u, v, p.x, p.y, p.z };
+		mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + vertexSize);
+	}
+	mesh.indices = triangles;
+	mesh.lods.push_back({ 0, (unsigned int)mesh.indices.size(), 0.0f });
+	mesh.computeBounds();
+	return mesh;
+}
+
+void Mesh::computeBounds()
+{
+	boundsMin = glm::vec3(INFINITY);
+	boundsMax = glm::vec3(-INFINITY);
+	for (unsigned int i = 0; i < vertexCount(); i++)
+	{
+		boundsMin = glm::min(boundsMin, position(i));
+		boundsMax = glm::max(boundsMax, position(i));
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// range of Mesh::indices drawn for one level of detail
+struct MeshLod
+{
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	float error; // geometric error in mesh units
+};
+
+// Indexed triangle mesh with the same vertex layout as Cube::vertices:
+// position (3), texture coords (2), normal (3).
+class Mesh
+{
+public:
+	static const unsigned int vertexSize = 8;
+
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	// lods[0] is the full detail mesh, all levels share the vertex buffer
+	std::vector<MeshLod> lods;
+	glm::vec3 boundsMin, boundsMax;
+
+	Mesh();
+
+	// welds identical vertices of a non-indexed triangle list
+	static Mesh fromTriangleList(const float* vertices, unsigned int vertexCount);
+	static Mesh icosphere(unsigned int subdivisions);
+
+	unsigned int vertexCount() const { return (unsigned int)(vertices.size() / vertexSize); }
+	glm::vec3 position(unsigned int vertex) const { return glm::vec3(vertices[vertex * vertexSize], vertices[vertex * vertexSize + 1], vertices[vertex * vertexSize + 2]); }
+
+	void computeBounds();
+};
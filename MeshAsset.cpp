@@ -0,0 +1,371 @@
+#include "MeshAsset.h"
+#include "Log.h"
+#include "MeshSimplify.h"
+#include "MeshOptimize.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(MeshLod) == 12, "MeshLod is written to the file as-is");
+static_assert(sizeof(MeshFileHeader) == 80, "MeshFileHeader layout changed, bump MeshFileVersion");
+
+namespace
+{
+	// one v/vt/vn corner of an OBJ face, the indices are 0-based and -1 when absent
+	struct Corner
+	{
+		int position, uv, normal;
+
+		bool operator==(const Corner& other) const { return position == other.position && uv == other.uv && normal == other.normal; }
+	};
+
+	struct CornerHash
+	{
+		size_t operator()(const Corner& c) const
+		{
+			return (size_t)c.position * 73856093u ^ (size_t)c.uv * 19349663u ^ (size_t)c.normal * 83492791u;
+		}
+	};
+
+	const char* skipSpaces(const char* p)
+	{
+		while (*p == ' ' || *p == '\t')
+			p++;
+		return p;
+	}
+
+	const char* nextLine(const char* p)
+	{
+		while (*p && *p != '\n')
+			p++;
+		return *p ? p + 1 : p;
+	}
+
+	// OBJ indices are 1-based, negative ones count back from the last element read
+	int objIndex(long index, size_t count)
+	{
+		return (int)(index < 0 ? (long)count + index : index - 1);
+	}
+
+	uint64_t alignOffset(uint64_t offset)
+	{
+		return (offset + MeshFileAlignment - 1) / MeshFileAlignment * MeshFileAlignment;
+	}
+}
+
+bool importObj(const std::string& path, Mesh& mesh)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		LOG_ERROR("ERROR::OBJ::FILE_NOT_SUCCESFULLY_READ " << path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	std::vector<char> text(length + 1);
+	size_t read = fread(text.data(), 1, length, file);
+	fclose(file);
+	text[read] = 0;
+
+	std::vector<float> positions, uvs, normals;
+	std::unordered_map<Corner, unsigned int, CornerHash> unique;
+	std::vector<bool> generateNormal;
+	std::vector<unsigned int> polygon;
+	mesh = Mesh();
+
+	for (const char* p = text.data(); *p; p = nextLine(p))
+	{
+		p = skipSpaces(p);
+		char* end;
+		if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			p++;
+			for (int k = 0; k < 3; k++)
+			{
+				positions.push_back(strtof(p, &end));
+				p = end;
+			}
+		}
+		else if (p[0] == 'v' && p[1] == 't')
+		{
+			p += 2;
+			for (int k = 0; k < 2; k++)
+			{
+				uvs.push_back(strtof(p, &end));
+				p = end;
+			}
+		}
+		else if (p[0] == 'v' && p[1] == 'n')
+		{
+			p += 2;
+			for (int k = 0; k < 3; k++)
+			{
+				normals.push_back(strtof(p, &end));
+				p = end;
+			}
+		}
+		else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			polygon.clear();
+			p = skipSpaces(p + 1);
+			while (*p && *p != '\n' && *p != '\r' && *p != '#')
+			{
+				Corner corner = { objIndex(strtol(p, &end, 10), positions.size() / 3), -1, -1 };
+				p = end;
+				if (*p == '/')
+				{
+					if (p[1] != '/')
+					{
+						corner.uv = objIndex(strtol(p + 1, &end, 10), uvs.size() / 2);
+						p = end;
+					}
+					else
+						p++;
+					if (*p == '/')
+					{
+						corner.normal = objIndex(strtol(p + 1, &end, 10), normals.size() / 3);
+						p = end;
+					}
+				}
+				if (corner.position < 0 || corner.position >= (int)(positions.size() / 3)
+					|| corner.uv >= (int)(uvs.size() / 2) || corner.normal >= (int)(normals.size() / 3))
+				{
+					LOG_ERROR("ERROR::OBJ::INDEX_OUT_OF_RANGE " << path);
+					return false;
+				}
+
+				std::pair<std::unordered_map<Corner, unsigned int, CornerHash>::iterator, bool> inserted =
+					unique.insert(std::make_pair(corner, mesh.vertexCount()));
+				if (inserted.second)
+				{
+					const float* position = &positions[corner.position * 3];
+					float vertex[Mesh::vertexSize] = { position[0], position[1], position[2], 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+					if (corner.uv >= 0)
+						memcpy(vertex + 3, &uvs[corner.uv * 2], 2 * sizeof(float));
+					if (corner.normal >= 0)
+						memcpy(vertex + 5, &normals[corner.normal * 3], 3 * sizeof(float));
+					mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + Mesh::vertexSize);
+					generateNormal.push_back(corner.normal < 0);
+				}
+				polygon.push_back(inserted.first->second);
+				p = skipSpaces(p);
+			}
+			for (size_t k = 2; k < polygon.size(); k++)
+			{
+				unsigned int triangle[] = { polygon[0], polygon[k - 1], polygon[k] };
+				mesh.indices.insert(mesh.indices.end(), triangle, triangle + 3);
+			}
+		}
+	}
+
+	// area weighted face normals for the corners that came without one
+	for (size_t i = 0; i < mesh.indices.size(); i += 3)
+	{
+		const unsigned int* triangle = &mesh.indices[i];
+		glm::vec3 normal = glm::cross(mesh.position(triangle[1]) - mesh.position(triangle[0]), mesh.position(triangle[2]) - mesh.position(triangle[0]));
+		for (int k = 0; k < 3; k++)
+			if (generateNormal[triangle[k]])
+			{
+				float* n = &mesh.vertices[triangle[k] * Mesh::vertexSize + 5];
+				n[0] += normal.x; n[1] += normal.y; n[2] += normal.z;
+			}
+	}
+	for (unsigned int v = 0; v < mesh.vertexCount(); v++)
+		if (generateNormal[v])
+		{
+			float* n = &mesh.vertices[v * Mesh::vertexSize + 5];
+			glm::vec3 normal(n[0], n[1], n[2]);
+			float length = glm::length(normal);
+			if (length > 0.0f)
+				normal /= length;
+			n[0] = normal.x; n[1] = normal.y; n[2] = normal.z;
+		}
+
+	mesh.lods.push_back({ 0, (unsigned int)mesh.indices.size(), 0.0f });
+	mesh.computeBounds();
+	return true;
+}
+
+bool cookMesh(const Mesh& mesh, const std::string& path)
+{
+	MeshFileHeader header = {};
+	memcpy(header.magic, "GMSH", 4);
+	header.version = MeshFileVersion;
+	header.vertexSize = Mesh::vertexSize;
+	header.vertexCount = mesh.vertexCount();
+	header.indexCount = (uint32_t)mesh.indices.size();
+	header.lodCount = (uint32_t)mesh.lods.size();
+	memcpy(header.boundsMin, &mesh.boundsMin.x, sizeof(header.boundsMin));
+	memcpy(header.boundsMax, &mesh.boundsMax.x, sizeof(header.boundsMax));
+	header.lodOffset = alignOffset(sizeof(MeshFileHeader));
+	header.vertexOffset = alignOffset(header.lodOffset + mesh.lods.size() * sizeof(MeshLod));
+	header.indexOffset = alignOffset(header.vertexOffset + mesh.vertices.size() * sizeof(float));
+	header.fileSize = header.indexOffset + mesh.indices.size() * sizeof(unsigned int);
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		LOG_ERROR("ERROR::MESH::FILE_NOT_SUCCESFULLY_WRITTEN " << path);
+		return false;
+	}
+	const char padding[MeshFileAlignment] = {};
+	uint64_t written = 0;
+	auto write = [&](uint64_t offset, const void* data, size_t bytes) {
+		written += fwrite(padding, 1, (size_t)(offset - written), file);
+		written += fwrite(data, 1, bytes, file);
+	};
+	write(0, &header, sizeof(header));
+	write(header.lodOffset, mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+	write(header.vertexOffset, mesh.vertices.data(), mesh.vertices.size() * sizeof(float));
+	write(header.indexOffset, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+	bool success = fclose(file) == 0 && written == header.fileSize;
+	if (!success)
+		LOG_ERROR("ERROR::MESH::FILE_NOT_SUCCESFULLY_WRITTEN " << path);
+	return success;
+}
+
+int cookObj(const std::string& objPath, const std::string& meshPath, unsigned int lodCount)
+{
+	Mesh mesh;
+	if (!importObj(objPath, mesh))
+		return -1;
+	if (lodCount > 1)
+		buildLods(mesh, lodCount);
+	optimizeMesh(mesh);
+	if (!cookMesh(mesh, meshPath))
+		return -1;
+	LOG_INFO(meshPath << ": " << mesh.vertexCount() << " vertices, " << mesh.lods[0].indexCount / 3
+		<< " triangles, " << mesh.lods.size() << " level(s) of detail");
+	return 0;
+}
+
+MappedMesh::MappedMesh() : boundsMin(0.0f), boundsMax(0.0f), data(nullptr), size(0)
+#ifdef _WIN32
+	, file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#endif
+{
+}
+
+MappedMesh::~MappedMesh()
+{
+	close();
+}
+
+bool MappedMesh::open(const std::string& path)
+{
+	close();
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(MeshFileHeader))
+	{
+		close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+		data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat status;
+	if (fstat(fd, &status) == 0 && status.st_size >= (off_t)sizeof(MeshFileHeader))
+	{
+		size = (size_t)status.st_size;
+		void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped != MAP_FAILED)
+			data = (const unsigned char*)mapped;
+	}
+	::close(fd);
+#endif
+	if (!data)
+	{
+		close();
+		return false;
+	}
+
+	const MeshFileHeader& h = header();
+	bool valid = memcmp(h.magic, "GMSH", 4) == 0 && h.version == MeshFileVersion && h.vertexSize == Mesh::vertexSize
+		&& h.fileSize == size && h.lodCount > 0
+		&& h.lodOffset % MeshFileAlignment == 0 && h.vertexOffset % MeshFileAlignment == 0 && h.indexOffset % MeshFileAlignment == 0
+		// ordered and inside the file first, the sums below cannot wrap then
+		&& h.lodOffset >= sizeof(MeshFileHeader) && h.lodOffset <= h.vertexOffset && h.vertexOffset <= h.indexOffset && h.indexOffset <= size
+		&& h.lodOffset + (uint64_t)h.lodCount * sizeof(MeshLod) <= h.vertexOffset
+		&& h.vertexOffset + (uint64_t)h.vertexCount * h.vertexSize * sizeof(float) <= h.indexOffset
+		&& h.indexOffset + (uint64_t)h.indexCount * sizeof(unsigned int) <= size;
+	if (!valid)
+	{
+		LOG_ERROR("ERROR::MESH::INVALID_FILE " << path);
+		close();
+		return false;
+	}
+
+	// every level must draw whole triangles from inside the index blob, or nothing
+	const MeshLod* fileLods = (const MeshLod*)(data + h.lodOffset);
+	for (uint32_t i = 0; i < h.lodCount; i++)
+	{
+		const MeshLod& lod = fileLods[i];
+		if (lod.indexCount % 3 != 0 || (uint64_t)lod.indexOffset + lod.indexCount > h.indexCount)
+		{
+			LOG_ERROR("ERROR::MESH::INVALID_LOD " << path << " level " << i);
+			close();
+			return false;
+		}
+	}
+	// and every index must name a vertex of the file, or the GPU reads past the vertex range.
+	// One pass over the blob, it is paged in for the upload right after anyway.
+	const unsigned int* fileIndices = indices();
+	unsigned int largest = 0;
+	for (uint32_t i = 0; i < h.indexCount; i++)
+		largest = std::max(largest, fileIndices[i]);
+	if (h.indexCount > 0 && largest >= h.vertexCount)
+	{
+		LOG_ERROR("ERROR::MESH::INVALID_FILE " << path << " index " << largest << " of " << h.vertexCount << " vertices");
+		close();
+		return false;
+	}
+	lods.assign(fileLods, fileLods + h.lodCount);
+	boundsMin = glm::vec3(h.boundsMin[0], h.boundsMin[1], h.boundsMin[2]);
+	boundsMax = glm::vec3(h.boundsMax[0], h.boundsMax[1], h.boundsMax[2]);
+	return true;
+}
+
+void MappedMesh::close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (data)
+		munmap((void*)data, size);
+#endif
+	data = nullptr;
+	size = 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Cooked mesh file, written by cookMesh and mapped as-is by MappedMesh.
+// The header is followed by the LOD table, the vertex blob and the index blob,
+// each starting at a multiple of MeshFileAlignment from the start of the file.
+struct MeshFileHeader
+{
+	char magic[4];             // "GMSH"
+	uint32_t version;
+	uint32_t vertexSize;       // floats per vertex, Mesh::vertexSize
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t lodCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint64_t lodOffset;        // byte offsets from the start of the file
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t fileSize;
+};
+
+const uint32_t MeshFileVersion = 1;
+const uint64_t MeshFileAlignment = 64;
+
+// Wavefront OBJ: v, vt, vn and polygonal f records (triangulated as fans), every
+// unique v/vt/vn corner becomes one vertex. Missing normals are generated smooth.
+bool importObj(const std::string& path, Mesh& mesh);
+
+bool cookMesh(const Mesh& mesh, const std::string& path);
+
+// "grafika-projekt --cook <in.obj> <out.mesh> [lods]": import, simplify, optimise and cook
+int cookObj(const std::string& objPath, const std::string& meshPath, unsigned int lodCount);
+
+// Read-only memory mapping of a cooked mesh. Nothing is parsed, the vertex and
+// index pointers point into the mapping and go straight to the geometry pool.
+class MappedMesh
+{
+public:
+	std::vector<MeshLod> lods;
+	glm::vec3 boundsMin, boundsMax;
+
+	MappedMesh();
+	~MappedMesh();
+	MappedMesh(const MappedMesh&) = delete;
+	MappedMesh& operator=(const MappedMesh&) = delete;
+
+	// fails on a missing, truncated or older file, or one whose indices leave the vertices
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return data != nullptr; }
+	const MeshFileHeader& header() const { return *(const MeshFileHeader*)data; }
+	const float* vertices() const { return (const float*)(data + header().vertexOffset); }
+	const unsigned int* indices() const { return (const unsigned int*)(data + header().indexOffset); }
+
+private:
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+};
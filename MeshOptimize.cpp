@@ -0,0 +1,316 @@
+#include "MeshOptimize.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const int ScoreCacheSize = 32;
+
+	float vertexScore(int cachePosition, unsigned int remaining)
+	{
+		if (remaining == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// the last triangle's vertices get a fixed score so they aren't reused right away
+			if (cachePosition < 3)
+				score = 0.75f;
+			else
+				score = std::pow(1.0f - (cachePosition - 3) / float(ScoreCacheSize - 3), 1.5f);
+		}
+		// prefer vertices with few triangles left, they finish off quickly
+		return score + 2.0f * std::pow((float)remaining, -0.5f);
+	}
+
+	// cache misses of a FIFO post-transform cache
+	unsigned int countCacheMisses(const unsigned int* indices, size_t indexCount, unsigned int vertexCount, unsigned int cacheSize)
+	{
+		std::vector<unsigned int> timestamps(vertexCount, 0);
+		unsigned int time = cacheSize + 1;
+		unsigned int misses = 0;
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			unsigned int v = indices[i];
+			if (time - timestamps[v] > cacheSize)
+			{
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+	float measureOverdraw(const Mesh& mesh, const unsigned int* indices, size_t indexCount)
+	{
+		const int size = 256;
+		const glm::vec3 directions[] = {
+			{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+			{ 1, 1, 1 }, { -1, 1, 1 }, { 1, -1, 1 }, { -1, -1, 1 }, { 1, 1, -1 }, { -1, 1, -1 }, { 1, -1, -1 }, { -1, -1, -1 }
+		};
+		glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+		float radius = std::max(glm::length(mesh.boundsMax - center), 1e-6f);
+
+		std::vector<float> depth(size * size);
+		std::vector<unsigned int> shaded(size * size);
+		double shadedTotal = 0.0, coveredTotal = 0.0;
+		for (glm::vec3 direction : directions)
+		{
+			direction = glm::normalize(direction);
+			glm::vec3 right = glm::normalize(glm::cross(direction, std::fabs(direction.y) < 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+			glm::vec3 up = glm::cross(right, direction);
+			std::fill(depth.begin(), depth.end(), INFINITY);
+			std::fill(shaded.begin(), shaded.end(), 0u);
+
+			for (size_t i = 0; i + 2 < indexCount; i += 3)
+			{
+				glm::vec3 p[3];
+				for (int k = 0; k < 3; k++)
+				{
+					glm::vec3 local = (mesh.position(indices[i + k]) - center) / radius;
+					p[k] = glm::vec3((glm::dot(local, right) * 0.5f + 0.5f) * size, (glm::dot(local, up) * 0.5f + 0.5f) * size, glm::dot(local, direction));
+				}
+				float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+				if (area == 0.0f)
+					continue;
+				if (area < 0.0f)
+				{
+					std::swap(p[1], p[2]);
+					area = -area;
+				}
+				int x0 = std::max(0, (int)std::min({ p[0].x, p[1].x, p[2].x }));
+				int x1 = std::min(size - 1, (int)std::max({ p[0].x, p[1].x, p[2].x }));
+				int y0 = std::max(0, (int)std::min({ p[0].y, p[1].y, p[2].y }));
+				int y1 = std::min(size - 1, (int)std::max({ p[0].y, p[1].y, p[2].y }));
+				for (int y = y0; y <= y1; y++)
+					for (int x = x0; x <= x1; x++)
+					{
+						float px = x + 0.5f, py = y + 0.5f;
+						float w0 = (p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x);
+						float w1 = (p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x);
+						float w2 = (p[1].x - p[0].x) * (py - p[0].y) - (p[1].y - p[0].y) * (px - p[0].x);
+						if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+							continue;
+						float z = (w0 * p[0].z + w1 * p[1].z + w2 * p[2].z) / area;
+						if (z < depth[y * size + x])
+						{
+							depth[y * size + x] = z;
+							shaded[y * size + x]++;
+						}
+					}
+			}
+			for (unsigned int count : shaded)
+			{
+				shadedTotal += count;
+				coveredTotal += count > 0;
+			}
+		}
+		return coveredTotal > 0.0 ? (float)(shadedTotal / coveredTotal) : 0.0f;
+	}
+}
+
+MeshStats analyzeMesh(const Mesh& mesh, unsigned int lod, unsigned int cacheSize)
+{
+	const unsigned int* indices = mesh.indices.data() + mesh.lods[lod].indexOffset;
+	size_t indexCount = mesh.lods[lod].indexCount;
+
+	std::vector<bool> used(mesh.vertexCount(), false);
+	unsigned int usedCount = 0;
+	for (size_t i = 0; i < indexCount; i++)
+		if (!used[indices[i]])
+		{
+			used[indices[i]] = true;
+			usedCount++;
+		}
+
+	unsigned int misses = countCacheMisses(indices, indexCount, mesh.vertexCount(), cacheSize);
+	MeshStats stats;
+	stats.acmr = indexCount ? misses / (indexCount / 3.0f) : 0.0f;
+	stats.atvr = usedCount ? misses / (float)usedCount : 0.0f;
+	stats.overdraw = measureOverdraw(mesh, indices, indexCount);
+	return stats;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+
+	// triangles of every vertex, the ones not yet emitted are kept at the front of each range
+	std::vector<unsigned int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+	for (unsigned int v : indices)
+		remaining[v]++;
+	for (unsigned int v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+	std::vector<unsigned int> vertexTriangles(indices.size()), filled(vertexCount, 0);
+	for (size_t i = 0; i < indices.size(); i++)
+		vertexTriangles[offsets[indices[i]] + filled[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		score[v] = vertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	std::vector<unsigned int> cache, newCache;
+	size_t scan = 0;
+
+	while (result.size() < indices.size())
+	{
+		// best triangle touching the cache, or the next unused one after a dead end
+		int best = -1;
+		float bestScore = -INFINITY;
+		for (unsigned int v : cache)
+			for (unsigned int i = offsets[v]; i < offsets[v] + remaining[v]; i++)
+			{
+				unsigned int t = vertexTriangles[i];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = (int)t;
+				}
+			}
+		if (best < 0)
+		{
+			while (emitted[scan])
+				scan++;
+			best = (int)scan;
+		}
+
+		const unsigned int* tri = &indices[best * 3];
+		result.insert(result.end(), tri, tri + 3);
+		emitted[best] = true;
+
+		newCache.assign(tri, tri + 3);
+		for (unsigned int v : cache)
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache.push_back(v);
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = tri[k];
+			unsigned int* begin = &vertexTriangles[offsets[v]];
+			unsigned int* end = begin + remaining[v];
+			std::iter_swap(std::find(begin, end, (unsigned int)best), end - 1);
+			remaining[v]--;
+		}
+
+		for (size_t i = 0; i < newCache.size(); i++)
+		{
+			unsigned int v = newCache[i];
+			cachePosition[v] = i < (size_t)ScoreCacheSize ? (int)i : -1;
+			score[v] = vertexScore(cachePosition[v], remaining[v]);
+		}
+		for (unsigned int v : newCache)
+			for (unsigned int i = offsets[v]; i < offsets[v] + remaining[v]; i++)
+			{
+				unsigned int t = vertexTriangles[i];
+				triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+			}
+
+		if (newCache.size() > (size_t)ScoreCacheSize)
+			newCache.resize(ScoreCacheSize);
+		cache.swap(newCache);
+	}
+
+	indices.swap(result);
+}
+
+void optimizeOverdraw(const Mesh& mesh, std::vector<unsigned int>& indices, unsigned int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// a cluster starts wherever all three vertices miss the cache, reordering there costs no extra misses
+	std::vector<size_t> clusterStart;
+	std::vector<unsigned int> timestamps(mesh.vertexCount(), 0);
+	unsigned int time = cacheSize + 1;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		unsigned int misses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[t * 3 + k];
+			if (time - timestamps[v] > cacheSize)
+			{
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		if (t == 0 || misses == 3)
+			clusterStart.push_back(t);
+	}
+	clusterStart.push_back(triangleCount);
+
+	glm::vec3 meshCenter = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+	size_t clusterCount = clusterStart.size() - 1;
+	std::vector<float> sortKey(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+		{
+			glm::vec3 p0 = mesh.position(indices[t * 3]), p1 = mesh.position(indices[t * 3 + 1]), p2 = mesh.position(indices[t * 3 + 2]);
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float a = glm::length(n);
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+		if (area > 0.0f)
+			centroid /= area;
+		float length = glm::length(normal);
+		sortKey[c] = length > 0.0f ? glm::dot(centroid - meshCenter, normal / length) : 0.0f;
+	}
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t c : order)
+		result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+	indices.swap(result);
+}
+
+void optimizeVertexFetch(Mesh& mesh)
+{
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(mesh.vertexCount(), unused);
+	std::vector<float> vertices;
+	vertices.reserve(mesh.vertices.size());
+	unsigned int next = 0;
+	for (unsigned int& index : mesh.indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = next++;
+			vertices.insert(vertices.end(), mesh.vertices.begin() + index * Mesh::vertexSize, mesh.vertices.begin() + (index + 1) * Mesh::vertexSize);
+		}
+		index = remap[index];
+	}
+	mesh.vertices.swap(vertices);
+}
+
+void optimizeMesh(Mesh& mesh)
+{
+	for (const MeshLod& lod : mesh.lods)
+	{
+		std::vector<unsigned int> indices(mesh.indices.begin() + lod.indexOffset, mesh.indices.begin() + lod.indexOffset + lod.indexCount);
+		optimizeVertexCache(indices, mesh.vertexCount());
+		optimizeOverdraw(mesh, indices);
+		std::copy(indices.begin(), indices.end(), mesh.indices.begin() + lod.indexOffset);
+	}
+	optimizeVertexFetch(mesh);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <vector>
+
+struct MeshStats
+{
+	float acmr;     // post-transform cache misses per triangle
+	float atvr;     // cache misses per referenced vertex, 1 is ideal
+	float overdraw; // shaded fragments per covered pixel, averaged over a set of views
+};
+
+// FIFO cache simulation plus a small orthographic software rasterizer. There is
+// no backface culling, matching how the mesh is drawn (GL_CULL_FACE is off).
+MeshStats analyzeMesh(const Mesh& mesh, unsigned int lod = 0, unsigned int cacheSize = 16);
+
+// Tom Forsyth's linear-speed vertex cache optimisation
+void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount);
+
+// Splits the cache-ordered triangles into clusters where the cache would restart
+// anyway and sorts the clusters so that outward facing ones are drawn first
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+void optimizeOverdraw(const Mesh& mesh, std::vector<unsigned int>& indices, unsigned int cacheSize = 16);
+
+// renumbers the vertices in order of first use over all levels and drops unused ones
+void optimizeVertexFetch(Mesh& mesh);
+
+// all of the above on every level of the mesh
+void optimizeMesh(Mesh& mesh);
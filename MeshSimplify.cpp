@@ -0,0 +1,218 @@
+#include "MeshSimplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <queue>
+#include <tuple>
+
+namespace
+{
+	// symmetric 4x4 matrix of the summed squared distances to a set of planes
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+		Quadric(double a, double b, double c, double d)
+			: a2(a * a), ab(a * b), ac(a * c), ad(a * d), b2(b * b), bc(b * c), bd(b * d), c2(c * c), cd(c * d), d2(d * d) {}
+
+		Quadric& operator+=(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+			bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+			return *this;
+		}
+
+		double evaluate(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z + d2;
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		unsigned int from, to;
+		unsigned int fromVersion, toVersion;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+}
+
+std::vector<unsigned int> simplifyMesh(const Mesh& mesh, const std::vector<unsigned int>& indices,
+	unsigned int targetIndexCount, float& error)
+{
+	unsigned int vertexCount = mesh.vertexCount();
+	unsigned int triangleCount = (unsigned int)indices.size() / 3;
+	std::vector<unsigned int> triangles(indices);
+	std::vector<bool> deadTriangle(triangleCount, false);
+	std::vector<std::vector<unsigned int>> adjacency(vertexCount);
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<bool> locked(vertexCount, false), removed(vertexCount, false);
+	std::vector<unsigned int> version(vertexCount, 0);
+	error = 0.0f;
+
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		glm::vec3 p0 = mesh.position(triangles[t * 3]), p1 = mesh.position(triangles[t * 3 + 1]), p2 = mesh.position(triangles[t * 3 + 2]);
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f)
+		{
+			normal /= length;
+			Quadric plane(normal.x, normal.y, normal.z, -glm::dot(normal, p0));
+			for (int k = 0; k < 3; k++)
+				quadrics[triangles[t * 3 + k]] += plane;
+		}
+		for (int k = 0; k < 3; k++)
+			adjacency[triangles[t * 3 + k]].push_back(t);
+	}
+
+	// vertices sharing a position with another one sit on a texture or normal seam
+	std::map<std::tuple<float, float, float>, unsigned int> positions;
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		glm::vec3 p = mesh.position(v);
+		std::pair<std::map<std::tuple<float, float, float>, unsigned int>::iterator, bool> inserted =
+			positions.insert(std::make_pair(std::make_tuple(p.x, p.y, p.z), v));
+		if (!inserted.second)
+			locked[v] = locked[inserted.first->second] = true;
+	}
+
+	// border edges are used by a single triangle
+	std::map<std::pair<unsigned int, unsigned int>, unsigned int> edgeUse;
+	for (unsigned int t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int a = triangles[t * 3 + k], b = triangles[t * 3 + (k + 1) % 3];
+			edgeUse[std::make_pair(std::min(a, b), std::max(a, b))]++;
+		}
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+	auto push = [&](unsigned int from, unsigned int to) {
+		if (locked[from])
+			return;
+		Quadric q = quadrics[from];
+		q += quadrics[to];
+		queue.push({ q.evaluate(mesh.position(to)), from, to, version[from], version[to] });
+	};
+	for (const std::pair<const std::pair<unsigned int, unsigned int>, unsigned int>& edge : edgeUse)
+	{
+		if (edge.second == 1)
+			locked[edge.first.first] = locked[edge.first.second] = true;
+	}
+	for (const std::pair<const std::pair<unsigned int, unsigned int>, unsigned int>& edge : edgeUse)
+	{
+		push(edge.first.first, edge.first.second);
+		push(edge.first.second, edge.first.first);
+	}
+
+	unsigned int aliveTriangles = triangleCount;
+	double maxCost = 0.0;
+	while (aliveTriangles * 3 > targetIndexCount && !queue.empty())
+	{
+		Collapse collapse = queue.top();
+		queue.pop();
+		unsigned int u = collapse.from, v = collapse.to;
+		if (removed[u] || removed[v] || version[u] != collapse.fromVersion || version[v] != collapse.toVersion)
+			continue;
+
+		// reject collapses that flip a triangle around u
+		bool flips = false;
+		for (unsigned int t : adjacency[u])
+		{
+			if (deadTriangle[t])
+				continue;
+			unsigned int* tri = &triangles[t * 3];
+			if (tri[0] == v || tri[1] == v || tri[2] == v)
+				continue;
+			glm::vec3 before[3], after[3];
+			for (int k = 0; k < 3; k++)
+			{
+				before[k] = mesh.position(tri[k]);
+				after[k] = mesh.position(tri[k] == u ? v : tri[k]);
+			}
+			glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(n0, n1) <= 0.2f * glm::length(n0) * glm::length(n1))
+			{
+				flips = true;
+				break;
+			}
+		}
+		if (flips)
+			continue;
+
+		for (unsigned int t : adjacency[u])
+		{
+			if (deadTriangle[t])
+				continue;
+			unsigned int* tri = &triangles[t * 3];
+			if (tri[0] == v || tri[1] == v || tri[2] == v)
+			{
+				deadTriangle[t] = true;
+				aliveTriangles--;
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+				if (tri[k] == u)
+					tri[k] = v;
+			adjacency[v].push_back(t);
+		}
+		removed[u] = true;
+		adjacency[u].clear();
+		quadrics[v] += quadrics[u];
+		version[v]++;
+		maxCost = std::max(maxCost, collapse.cost);
+
+		for (unsigned int t : adjacency[v])
+		{
+			if (deadTriangle[t])
+				continue;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int w = triangles[t * 3 + k];
+				if (w != v)
+				{
+					push(v, w);
+					push(w, v);
+				}
+			}
+		}
+	}
+
+	std::vector<unsigned int> result;
+	result.reserve(aliveTriangles * 3);
+	for (unsigned int t = 0; t < triangleCount; t++)
+		if (!deadTriangle[t])
+			result.insert(result.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+
+	error = (float)std::sqrt(maxCost);
+	return result;
+}
+
+void buildLods(Mesh& mesh, unsigned int lodCount)
+{
+	std::vector<unsigned int> original(mesh.indices.begin() + mesh.lods[0].indexOffset,
+		mesh.indices.begin() + mesh.lods[0].indexOffset + mesh.lods[0].indexCount);
+
+	// every level is simplified from the full mesh so its error is measured against the original surface
+	unsigned int previousCount = (unsigned int)original.size();
+	for (unsigned int lod = 1; lod < lodCount; lod++)
+	{
+		float error;
+		std::vector<unsigned int> simplified = simplifyMesh(mesh, original, (unsigned int)original.size() >> lod, error);
+		if (simplified.size() >= previousCount)
+			break;
+		previousCount = (unsigned int)simplified.size();
+
+		mesh.lods.push_back({ (unsigned int)mesh.indices.size(), (unsigned int)simplified.size(), error });
+		mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert) by half-edge collapses:
+// vertices are only removed, never moved, so every level keeps indexing the
+// original vertex buffer. Vertices on borders and attribute seams are locked.
+// error receives the largest collapse error, in mesh units.
+std::vector<unsigned int> simplifyMesh(const Mesh& mesh, const std::vector<unsigned int>& indices,
+	unsigned int targetIndexCount, float& error);
+
+// appends up to lodCount - 1 levels to mesh.indices / mesh.lods, each with about
+// half the triangles of the previous one
+void buildLods(Mesh& mesh, unsigned int lodCount);
@@ -0,0 +1,448 @@
+#include "Metrics.h"
+#include "FrameArena.h"
+#include "Log.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+
+namespace
+{
+	FrameCounters counters = {};
+
+	// memory of one texture, explicitly uploaded mip levels or a generated chain
+	struct TextureMemory
+	{
+		unsigned long long base, levels;
+		bool mipmapped;
+
+		unsigned long long bytes() const { return base + (mipmapped ? base / 3 : levels); }
+	};
+	std::map<GLuint, TextureMemory> textures;
+
+	PFNGLDRAWARRAYSPROC drawArrays;
+	PFNGLDRAWELEMENTSPROC drawElements;
+	PFNGLDRAWARRAYSINSTANCEDPROC drawArraysInstanced;
+	PFNGLDRAWELEMENTSINSTANCEDPROC drawElementsInstanced;
+	PFNGLDRAWELEMENTSBASEVERTEXPROC drawElementsBaseVertex;
+	PFNGLUSEPROGRAMPROC useProgram;
+	PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+	PFNGLBINDTEXTUREPROC bindTexture;
+	PFNGLBINDBUFFERPROC bindBuffer;
+	PFNGLBINDFRAMEBUFFERPROC bindFramebuffer;
+	PFNGLENABLEPROC enable;
+	PFNGLDISABLEPROC disable;
+	PFNGLDEPTHFUNCPROC depthFunc;
+	PFNGLCOLORMASKPROC colorMask;
+	PFNGLVIEWPORTPROC viewport;
+	PFNGLBUFFERDATAPROC bufferData;
+	PFNGLBUFFERSUBDATAPROC bufferSubData;
+	PFNGLTEXIMAGE2DPROC texImage2D;
+	PFNGLTEXIMAGE3DPROC texImage3D;
+	PFNGLTEXSUBIMAGE2DPROC texSubImage2D;
+	PFNGLTEXSUBIMAGE3DPROC texSubImage3D;
+	PFNGLCOPYBUFFERSUBDATAPROC copyBufferSubData;
+	PFNGLGENERATEMIPMAPPROC generateMipmap;
+	PFNGLDELETETEXTURESPROC deleteTextures;
+
+	unsigned long long triangleCount(GLenum mode, GLsizei count)
+	{
+		if (mode == GL_TRIANGLES)
+			return count / 3;
+		if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count > 2)
+			return count - 2;
+		return 0;
+	}
+
+	// what the driver most likely stores, RGB textures are padded to four bytes
+	unsigned int texelBytes(GLint internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_RED: case GL_R8:
+			return 1;
+		case GL_R16F: case GL_RG8:
+			return 2;
+		case GL_RGBA16F: case GL_RG32F:
+			return 8;
+		case GL_RGBA32F:
+			return 16;
+		default:
+			return 4;
+		}
+	}
+
+	// of the client side pixels, the packed types hold a whole pixel
+	unsigned int pixelBytes(GLenum format, GLenum type)
+	{
+		unsigned int components = format == GL_RED || format == GL_RED_INTEGER || format == GL_DEPTH_COMPONENT ? 1
+			: format == GL_RG || format == GL_RG_INTEGER ? 2
+			: format == GL_RGB || format == GL_BGR || format == GL_RGB_INTEGER ? 3 : 4;
+		switch (type)
+		{
+		case GL_UNSIGNED_BYTE: case GL_BYTE:
+			return components;
+		case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+			return components * 2;
+		case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:
+			return components * 4;
+		case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_4_4_4_4: case GL_UNSIGNED_SHORT_5_5_5_1:
+			return 2;
+		default:
+			return 4;
+		}
+	}
+
+	GLuint boundTexture(GLenum target)
+	{
+		GLenum binding = target == GL_TEXTURE_2D ? GL_TEXTURE_BINDING_2D
+			: target == GL_TEXTURE_2D_ARRAY ? GL_TEXTURE_BINDING_2D_ARRAY
+			: target == GL_TEXTURE_3D ? GL_TEXTURE_BINDING_3D : 0;
+		GLint texture = 0;
+		if (binding)
+			glGetIntegerv(binding, &texture);
+		return (GLuint)texture;
+	}
+
+	void trackTexture(GLenum target, GLint level, unsigned long long bytes)
+	{
+		GLuint texture = boundTexture(target);
+		if (!texture)
+			return;
+		TextureMemory& memory = textures[texture];
+		counters.textureBytes -= memory.bytes();
+		if (level == 0)
+		{
+			memory.base = bytes;
+			memory.levels = 0;
+			memory.mipmapped = false;
+		}
+		else
+			memory.levels += bytes;
+		counters.textureBytes += memory.bytes();
+	}
+
+	void APIENTRY countDrawArrays(GLenum mode, GLint first, GLsizei count)
+	{
+		counters.drawCalls++;
+		counters.triangles += triangleCount(mode, count);
+		drawArrays(mode, first, count);
+	}
+
+	void APIENTRY countDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+	{
+		counters.drawCalls++;
+		counters.triangles += triangleCount(mode, count);
+		drawElements(mode, count, type, indices);
+	}
+
+	void APIENTRY countDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+	{
+		counters.drawCalls++;
+		counters.triangles += triangleCount(mode, count) * instances;
+		drawArraysInstanced(mode, first, count, instances);
+	}
+
+	void APIENTRY countDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances)
+	{
+		counters.drawCalls++;
+		counters.triangles += triangleCount(mode, count) * instances;
+		drawElementsInstanced(mode, count, type, indices, instances);
+	}
+
+	void APIENTRY countDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint baseVertex)
+	{
+		counters.drawCalls++;
+		counters.triangles += triangleCount(mode, count);
+		drawElementsBaseVertex(mode, count, type, indices, baseVertex);
+	}
+
+	void APIENTRY countUseProgram(GLuint program) { counters.stateChanges++; useProgram(program); }
+	void APIENTRY countBindVertexArray(GLuint array) { counters.stateChanges++; bindVertexArray(array); }
+	void APIENTRY countBindTexture(GLenum target, GLuint texture) { counters.stateChanges++; bindTexture(target, texture); }
+	void APIENTRY countBindBuffer(GLenum target, GLuint buffer) { counters.stateChanges++; bindBuffer(target, buffer); }
+	void APIENTRY countBindFramebuffer(GLenum target, GLuint framebuffer) { counters.stateChanges++; bindFramebuffer(target, framebuffer); }
+	void APIENTRY countEnable(GLenum capability) { counters.stateChanges++; enable(capability); }
+	void APIENTRY countDisable(GLenum capability) { counters.stateChanges++; disable(capability); }
+	void APIENTRY countDepthFunc(GLenum function) { counters.stateChanges++; depthFunc(function); }
+	void APIENTRY countColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a) { counters.stateChanges++; colorMask(r, g, b, a); }
+	void APIENTRY countViewport(GLint x, GLint y, GLsizei width, GLsizei height) { counters.stateChanges++; viewport(x, y, width, height); }
+
+	void APIENTRY countBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+	{
+		if (data)
+			counters.uploadedBytes += size;
+		bufferData(target, size, data, usage);
+	}
+
+	void APIENTRY countBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+	{
+		counters.uploadedBytes += size;
+		bufferSubData(target, offset, size, data);
+	}
+
+	void APIENTRY countTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels)
+	{
+		unsigned long long bytes = (unsigned long long)width * height * texelBytes(internalFormat);
+		if (pixels)
+			counters.uploadedBytes += bytes;
+		trackTexture(target, level, bytes);
+		texImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
+	}
+
+	void APIENTRY countTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels)
+	{
+		unsigned long long bytes = (unsigned long long)width * height * depth * texelBytes(internalFormat);
+		if (pixels)
+			counters.uploadedBytes += bytes;
+		trackTexture(target, level, bytes);
+		texImage3D(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+	}
+
+	// sub image uploads change no sizes, pixels is an offset with an unpack buffer bound and still counts
+	void APIENTRY countTexSubImage2D(GLenum target, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+	{
+		counters.uploadedBytes += (unsigned long long)width * height * pixelBytes(format, type);
+		texSubImage2D(target, level, x, y, width, height, format, type, pixels);
+	}
+
+	void APIENTRY countTexSubImage3D(GLenum target, GLint level, GLint x, GLint y, GLint z, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels)
+	{
+		counters.uploadedBytes += (unsigned long long)width * height * depth * pixelBytes(format, type);
+		texSubImage3D(target, level, x, y, z, width, height, depth, format, type, pixels);
+	}
+
+	// a copy on the GPU, but the same bus traffic and memory writes as an upload
+	void APIENTRY countCopyBufferSubData(GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size)
+	{
+		counters.uploadedBytes += size;
+		copyBufferSubData(readTarget, writeTarget, readOffset, writeOffset, size);
+	}
+
+	void APIENTRY countGenerateMipmap(GLenum target)
+	{
+		std::map<GLuint, TextureMemory>::iterator texture = textures.find(boundTexture(target));
+		if (texture != textures.end())
+		{
+			counters.textureBytes -= texture->second.bytes();
+			texture->second.mipmapped = true;
+			counters.textureBytes += texture->second.bytes();
+		}
+		generateMipmap(target);
+	}
+
+	void APIENTRY countDeleteTextures(GLsizei n, const GLuint* names)
+	{
+		for (GLsizei k = 0; k < n; k++)
+		{
+			std::map<GLuint, TextureMemory>::iterator texture = textures.find(names[k]);
+			if (texture == textures.end())
+				continue;
+			counters.textureBytes -= texture->second.bytes();
+			textures.erase(texture);
+		}
+		deleteTextures(n, names);
+	}
+
+	template <typename Function>
+	void wrap(Function& pointer, Function& original, Function counting)
+	{
+		original = pointer;
+		if (pointer)
+			pointer = counting;
+	}
+}
+
+void installGLCounters()
+{
+	if (drawArrays)
+		return;
+	wrap(glad_glDrawArrays, drawArrays, countDrawArrays);
+	wrap(glad_glDrawElements, drawElements, countDrawElements);
+	wrap(glad_glDrawArraysInstanced, drawArraysInstanced, countDrawArraysInstanced);
+	wrap(glad_glDrawElementsInstanced, drawElementsInstanced, countDrawElementsInstanced);
+	wrap(glad_glDrawElementsBaseVertex, drawElementsBaseVertex, countDrawElementsBaseVertex);
+	wrap(glad_glUseProgram, useProgram, countUseProgram);
+	wrap(glad_glBindVertexArray, bindVertexArray, countBindVertexArray);
+	wrap(glad_glBindTexture, bindTexture, countBindTexture);
+	wrap(glad_glBindBuffer, bindBuffer, countBindBuffer);
+	wrap(glad_glBindFramebuffer, bindFramebuffer, countBindFramebuffer);
+	wrap(glad_glEnable, enable, countEnable);
+	wrap(glad_glDisable, disable, countDisable);
+	wrap(glad_glDepthFunc, depthFunc, countDepthFunc);
+	wrap(glad_glColorMask, colorMask, countColorMask);
+	wrap(glad_glViewport, viewport, countViewport);
+	wrap(glad_glBufferData, bufferData, countBufferData);
+	wrap(glad_glBufferSubData, bufferSubData, countBufferSubData);
+	wrap(glad_glTexImage2D, texImage2D, countTexImage2D);
+	wrap(glad_glTexImage3D, texImage3D, countTexImage3D);
+	wrap(glad_glTexSubImage2D, texSubImage2D, countTexSubImage2D);
+	wrap(glad_glTexSubImage3D, texSubImage3D, countTexSubImage3D);
+	wrap(glad_glCopyBufferSubData, copyBufferSubData, countCopyBufferSubData);
+	wrap(glad_glGenerateMipmap, generateMipmap, countGenerateMipmap);
+	wrap(glad_glDeleteTextures, deleteTextures, countDeleteTextures);
+}
+
+FrameCounters& glCounters()
+{
+	return counters;
+}
+
+Histogram::Histogram(float min, float max, int bucketCount)
+	: logMin(std::log(min)), bucketScale(bucketCount / (std::log(max) - std::log(min))), buckets(bucketCount, 0)
+{
+	reset();
+}
+
+void Histogram::add(float value)
+{
+	int bucket = value > 0.0f ? (int)((std::log(value) - logMin) * bucketScale) : 0;
+	buckets[std::min(std::max(bucket, 0), (int)buckets.size() - 1)]++;
+	total++;
+	sum += value;
+	largest = std::max(largest, value);
+}
+
+void Histogram::reset()
+{
+	std::fill(buckets.begin(), buckets.end(), 0);
+	total = 0;
+	sum = 0.0;
+	largest = 0.0f;
+}
+
+float Histogram::percentile(float p) const
+{
+	if (!total)
+		return 0.0f;
+	unsigned int rank = (unsigned int)std::ceil(p * total), seen = 0;
+	for (size_t k = 0; k < buckets.size(); k++)
+	{
+		seen += buckets[k];
+		if (seen >= std::max(rank, 1u))
+			return std::min(std::exp(logMin + (k + 0.5f) / bucketScale), largest);
+	}
+	return largest;
+}
+
+// 0.1 ms to 1 s in 96 buckets, about 10 % wide each
+FrameMetrics::FrameMetrics() : start(Clock::now()), frameStart(start), allocationCount(heapAllocationCount()), last(), sums(), frameTimes(0.1f, 1000.0f, 96)
+{
+}
+
+void FrameMetrics::endFrame()
+{
+	Clock::time_point now = Clock::now();
+	frameTimes.add(std::chrono::duration<float, std::milli>(now - frameStart).count());
+	frameStart = now;
+
+	unsigned long long allocations = heapAllocationCount();
+	counters.heapAllocations = allocations - allocationCount;
+	allocationCount = allocations;
+
+	last = counters;
+	sums.drawCalls += last.drawCalls;
+	sums.triangles += last.triangles;
+	sums.stateChanges += last.stateChanges;
+	sums.uploadedBytes += last.uploadedBytes;
+	sums.heapAllocations += last.heapAllocations;
+	counters.drawCalls = counters.triangles = counters.stateChanges = counters.uploadedBytes = counters.heapAllocations = 0;
+}
+
+MetricsReport FrameMetrics::report()
+{
+	MetricsReport report;
+	report.time = std::chrono::duration<double>(Clock::now() - start).count();
+	report.frames = frameTimes.count();
+	report.frameMilliseconds = frameTimes.mean();
+	report.p50 = frameTimes.percentile(0.5f);
+	report.p95 = frameTimes.percentile(0.95f);
+	report.p99 = frameTimes.percentile(0.99f);
+	report.maxMilliseconds = frameTimes.maximum();
+	double frames = std::max(report.frames, 1u);
+	report.drawCalls = sums.drawCalls / frames;
+	report.triangles = sums.triangles / frames;
+	report.stateChanges = sums.stateChanges / frames;
+	report.uploadedBytes = sums.uploadedBytes / frames;
+	report.heapAllocations = sums.heapAllocations / frames;
+	report.textureBytes = counters.textureBytes;
+
+	frameTimes.reset();
+	sums = FrameCounters();
+	return report;
+}
+
+MetricsExporter::MetricsExporter(const std::string& path)
+	: file(path), csv(path.size() > 4 && path.compare(path.size() - 4, 4, ".csv") == 0), quit(false)
+{
+	if (!file.is_open())
+	{
+		LOG_ERROR("ERROR::METRICS::FILE_NOT_OPENED " << path);
+		return;
+	}
+	if (csv)
+		file << "time,frames,frame_ms,p50_ms,p95_ms,p99_ms,max_ms,draw_calls,triangles,state_changes,uploaded_bytes,heap_allocations,texture_bytes\n";
+	writer = std::thread(&MetricsExporter::writerLoop, this);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	if (writer.joinable())
+		writer.join();
+}
+
+void MetricsExporter::push(const MetricsReport& report)
+{
+	if (!file.is_open())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(report);
+	}
+	wake.notify_one();
+}
+
+void MetricsExporter::writerLoop()
+{
+	std::vector<MetricsReport> reports;
+	for (;;)
+	{
+		bool stop;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return quit || !queue.empty(); });
+			reports.swap(queue);
+			stop = quit;
+		}
+		for (const MetricsReport& report : reports)
+			write(report);
+		reports.clear();
+		file.flush();
+		if (stop)
+			return;
+	}
+}
+
+void MetricsExporter::write(const MetricsReport& report)
+{
+	if (csv)
+	{
+		file << report.time << "," << report.frames << "," << report.frameMilliseconds << "," << report.p50 << "," << report.p95 << ","
+			<< report.p99 << "," << report.maxMilliseconds << "," << report.drawCalls << "," << report.triangles << ","
+			<< report.stateChanges << "," << report.uploadedBytes << "," << report.heapAllocations << "," << report.textureBytes << "\n";
+		return;
+	}
+	file << "{\"time\":" << report.time << ",\"frames\":" << report.frames << ",\"frame_ms\":{\"mean\":" << report.frameMilliseconds
+		<< ",\"p50\":" << report.p50 << ",\"p95\":" << report.p95 << ",\"p99\":" << report.p99 << ",\"max\":" << report.maxMilliseconds
+		<< "},\"draw_calls\":" << report.drawCalls << ",\"triangles\":" << report.triangles << ",\"state_changes\":" << report.stateChanges
+		<< ",\"uploaded_bytes\":" << report.uploadedBytes << ",\"heap_allocations\":" << report.heapAllocations
+		<< ",\"texture_bytes\":" << report.textureBytes << "}\n";
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counted by wrappers around the glad function pointers, so every draw and
+// state change of every subsystem shows up without touching the call sites.
+// textureBytes is the memory of the live textures, the rest restart every frame.
+struct FrameCounters
+{
+	unsigned long long drawCalls;
+	unsigned long long triangles;
+	unsigned long long stateChanges;  // program, VAO, texture, buffer and framebuffer binds, enables, depth func, masks, viewport
+	unsigned long long uploadedBytes; // glBufferData with data, glBufferSubData, glTexImage with pixels, glTexSubImage, glCopyBufferSubData
+	unsigned long long textureBytes;  // level 0 of every texture, a third more with mipmaps
+	unsigned long long heapAllocations; // not a GL counter, global operator new calls on any thread
+};
+
+// call once after gladLoadGLLoader, the wrappers count on the calling thread only
+void installGLCounters();
+FrameCounters& glCounters();
+
+// log spaced buckets between min and max, values outside land in the first or last one
+class Histogram
+{
+public:
+	Histogram(float min, float max, int bucketCount);
+
+	void add(float value);
+	void reset();
+
+	// geometric middle of the bucket holding the fraction p of the values
+	float percentile(float p) const;
+	unsigned int count() const { return total; }
+	float mean() const { return total ? (float)(sum / total) : 0.0f; }
+	float maximum() const { return largest; }
+
+private:
+	float logMin, bucketScale;
+	std::vector<unsigned int> buckets;
+	unsigned int total;
+	double sum;
+	float largest;
+};
+
+// one export period, the counters are per frame averages
+struct MetricsReport
+{
+	double time;              // seconds since the start
+	unsigned int frames;
+	float frameMilliseconds, p50, p95, p99, maxMilliseconds;
+	double drawCalls, triangles, stateChanges, uploadedBytes, heapAllocations;
+	unsigned long long textureBytes;
+};
+
+// Aggregates the GL counters and the frame time once per frame. report()
+// summarizes everything since the previous report.
+class FrameMetrics
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	FrameMetrics();
+
+	// after the swap, the frame time is measured between the calls
+	void endFrame();
+	MetricsReport report();
+
+	const FrameCounters& lastFrame() const { return last; }
+
+private:
+	Clock::time_point start, frameStart;
+	unsigned long long allocationCount;
+	FrameCounters last;
+	FrameCounters sums;
+	Histogram frameTimes;
+};
+
+// Writes the reports as CSV (a .csv path) or one JSON object per line on a
+// writer thread, push only copies the report under a short lock.
+class MetricsExporter
+{
+public:
+	explicit MetricsExporter(const std::string& path);
+	~MetricsExporter();
+
+	bool isOpen() const { return file.is_open(); }
+	void push(const MetricsReport& report);
+
+private:
+	void writerLoop();
+	void write(const MetricsReport& report);
+
+	std::ofstream file;
+	bool csv;
+	std::vector<MetricsReport> queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool quit;
+	std::thread writer;
+};
@@ -0,0 +1,400 @@
+#include "MipChain.h"
+#include "CpuFeatures.h"
+#include "Instrument.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+namespace
+{
+	const int MaxTaps = 8;
+	// clamped texels on both sides of a decoded row, enough for the Kaiser taps
+	const int Pad = 4;
+	// 12 bit index into the encode table, on the square root of the linear value
+	const int EncodeSteps = 4096;
+
+	// input texel = step * output texel + first + k
+	struct Filter
+	{
+		int taps, first, step;
+		float weights[MaxTaps];
+	};
+
+	// per mode: decode 256 color then 256 alpha values, encode EncodeSteps color then EncodeSteps alpha
+	struct ColorTables
+	{
+		float decode[2][512];
+		int32_t encode[2][EncodeSteps * 2];
+	};
+
+	float srgbToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float linearToSrgb(float value)
+	{
+		return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+	}
+
+	const ColorTables& colorTables()
+	{
+		static ColorTables* tables = []
+		{
+			ColorTables* built = new ColorTables;
+			for (int mode = 0; mode < 2; mode++)
+			{
+				for (int i = 0; i < 256; i++)
+				{
+					built->decode[mode][i] = mode ? srgbToLinear(i / 255.0f) : i / 255.0f;
+					built->decode[mode][256 + i] = i / 255.0f;
+				}
+				for (int i = 0; i < EncodeSteps; i++)
+				{
+					float linear = (float)i / (EncodeSteps - 1) * ((float)i / (EncodeSteps - 1));
+					built->encode[mode][i] = (int32_t)((mode ? linearToSrgb(linear) : linear) * 255.0f + 0.5f);
+					built->encode[mode][EncodeSteps + i] = (int32_t)(linear * 255.0f + 0.5f);
+				}
+			}
+			return built;
+		}();
+		return *tables;
+	}
+
+	float besselI0(float x)
+	{
+		float sum = 1.0f, term = 1.0f;
+		for (int k = 1; k < 20; k++)
+		{
+			term *= (x / (2.0f * k)) * (x / (2.0f * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	Filter makeFilter(MipFilter type, int inputSize)
+	{
+		Filter filter;
+		if (inputSize == 1)
+		{
+			filter.taps = 1;
+			filter.first = 0;
+			filter.step = 1;
+			filter.weights[0] = 1.0f;
+			return filter;
+		}
+		filter.step = 2;
+		if (type == MipBox)
+		{
+			filter.taps = 2;
+			filter.first = 0;
+			filter.weights[0] = filter.weights[1] = 0.5f;
+			return filter;
+		}
+		// sinc cut at the new Nyquist frequency, windowed over 4 output texels
+		const float beta = 4.0f, pi = 3.14159265f;
+		filter.taps = 8;
+		filter.first = -3;
+		float sum = 0.0f;
+		for (int k = 0; k < filter.taps; k++)
+		{
+			float distance = k - 3.5f, x = distance * 0.5f * pi, window = distance / 4.0f;
+			filter.weights[k] = sinf(x) / x * besselI0(beta * sqrtf(1.0f - window * window)) / besselI0(beta);
+			sum += filter.weights[k];
+		}
+		for (int k = 0; k < filter.taps; k++)
+			filter.weights[k] /= sum;
+		return filter;
+	}
+
+	// one implementation per instruction set: a row of bytes to linear floats,
+	// the horizontal pass of a row, the vertical pass of an output row back to bytes
+	struct Kernel
+	{
+		void (*decode)(const unsigned char* source, int width, float* out, const float* table);
+		void (*filterRow)(const float* padded, int outWidth, const Filter& filter, float* out);
+		void (*filterColumn)(const float* const* rows, int outWidth, const Filter& filter, unsigned char* out, const int32_t* table);
+	};
+
+	// ------------------ SCALAR ------------------
+	void decodeScalar(const unsigned char* source, int width, float* out, const float* table)
+	{
+		for (int i = 0; i < width * 4; i += 4)
+		{
+			out[i] = table[source[i]];
+			out[i + 1] = table[source[i + 1]];
+			out[i + 2] = table[source[i + 2]];
+			out[i + 3] = table[256 + source[i + 3]];
+		}
+	}
+
+	void filterRowScalar(const float* padded, int outWidth, const Filter& filter, float* out)
+	{
+		for (int x = 0; x < outWidth; x++)
+		{
+			const float* p = padded + (Pad + filter.step * x + filter.first) * 4;
+			for (int c = 0; c < 4; c++)
+			{
+				float sum = p[c] * filter.weights[0];
+				for (int k = 1; k < filter.taps; k++)
+					sum = sum + p[k * 4 + c] * filter.weights[k];
+				out[x * 4 + c] = sum;
+			}
+		}
+	}
+
+	void filterColumnScalar(const float* const* rows, int outWidth, const Filter& filter, unsigned char* out, const int32_t* table)
+	{
+		for (int i = 0; i < outWidth * 4; i++)
+		{
+			float sum = rows[0][i] * filter.weights[0];
+			for (int k = 1; k < filter.taps; k++)
+				sum = sum + rows[k][i] * filter.weights[k];
+			float root = sqrtf(std::min(std::max(sum, 0.0f), 1.0f));
+			int index = (int)(root * (float)(EncodeSteps - 1) + 0.5f);
+			out[i] = (unsigned char)table[index + ((i & 3) == 3 ? EncodeSteps : 0)];
+		}
+	}
+
+	// ------------------ SSE ------------------
+	void filterRowSse(const float* padded, int outWidth, const Filter& filter, float* out)
+	{
+		for (int x = 0; x < outWidth; x++)
+		{
+			const float* p = padded + (Pad + filter.step * x + filter.first) * 4;
+			__m128 sum = _mm_mul_ps(_mm_loadu_ps(p), _mm_set1_ps(filter.weights[0]));
+			for (int k = 1; k < filter.taps; k++)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(p + k * 4), _mm_set1_ps(filter.weights[k])));
+			_mm_storeu_ps(out + x * 4, sum);
+		}
+	}
+
+	void filterColumnSse(const float* const* rows, int outWidth, const Filter& filter, unsigned char* out, const int32_t* table)
+	{
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		const __m128 steps = _mm_set1_ps((float)(EncodeSteps - 1)), half = _mm_set1_ps(0.5f);
+		const __m128i alphaOffset = _mm_set_epi32(EncodeSteps, 0, 0, 0);
+		alignas(16) int32_t index[4];
+		for (int i = 0; i < outWidth * 4; i += 4)
+		{
+			__m128 sum = _mm_mul_ps(_mm_loadu_ps(rows[0] + i), _mm_set1_ps(filter.weights[0]));
+			for (int k = 1; k < filter.taps; k++)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(filter.weights[k])));
+			__m128 root = _mm_sqrt_ps(_mm_min_ps(_mm_max_ps(sum, zero), one));
+			_mm_store_si128((__m128i*)index, _mm_add_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(root, steps), half)), alphaOffset));
+			out[i] = (unsigned char)table[index[0]];
+			out[i + 1] = (unsigned char)table[index[1]];
+			out[i + 2] = (unsigned char)table[index[2]];
+			out[i + 3] = (unsigned char)table[index[3]];
+		}
+	}
+
+	// ------------------ AVX2 ------------------
+	// two output texels at a time, the table lookups are gathers
+	AVX2_TARGET void decodeAvx2(const unsigned char* source, int width, float* out, const float* table)
+	{
+		const __m256i alphaOffset = _mm256_set_epi32(256, 0, 0, 0, 256, 0, 0, 0);
+		int x = 0;
+		for (; x + 1 < width; x += 2)
+		{
+			__m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(source + x * 4)));
+			_mm256_storeu_ps(out + x * 4, _mm256_i32gather_ps(table, _mm256_add_epi32(bytes, alphaOffset), 4));
+		}
+		if (x < width)
+			decodeScalar(source + x * 4, 1, out + x * 4, table);
+	}
+
+	AVX2_TARGET __m256 loadPair(const float* p, int stride)
+	{
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + stride), 1);
+	}
+
+	AVX2_TARGET void filterRowAvx2(const float* padded, int outWidth, const Filter& filter, float* out)
+	{
+		const int stride = filter.step * 4;
+		int x = 0;
+		for (; x + 1 < outWidth; x += 2)
+		{
+			const float* p = padded + (Pad + filter.step * x + filter.first) * 4;
+			__m256 sum = _mm256_mul_ps(loadPair(p, stride), _mm256_set1_ps(filter.weights[0]));
+			for (int k = 1; k < filter.taps; k++)
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(loadPair(p + k * 4, stride), _mm256_set1_ps(filter.weights[k])));
+			_mm256_storeu_ps(out + x * 4, sum);
+		}
+		if (x < outWidth)
+			filterRowSse(padded + filter.step * x * 4, 1, filter, out + x * 4);
+	}
+
+	AVX2_TARGET void filterColumnAvx2(const float* const* rows, int outWidth, const Filter& filter, unsigned char* out, const int32_t* table)
+	{
+		const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+		const __m256 steps = _mm256_set1_ps((float)(EncodeSteps - 1)), half = _mm256_set1_ps(0.5f);
+		const __m256i alphaOffset = _mm256_set_epi32(EncodeSteps, 0, 0, 0, EncodeSteps, 0, 0, 0);
+		int i = 0;
+		for (; i + 8 <= outWidth * 4; i += 8)
+		{
+			__m256 sum = _mm256_mul_ps(_mm256_loadu_ps(rows[0] + i), _mm256_set1_ps(filter.weights[0]));
+			for (int k = 1; k < filter.taps; k++)
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i), _mm256_set1_ps(filter.weights[k])));
+			__m256 root = _mm256_sqrt_ps(_mm256_min_ps(_mm256_max_ps(sum, zero), one));
+			__m256i index = _mm256_add_epi32(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(root, steps), half)), alphaOffset);
+			__m256i values = _mm256_i32gather_epi32((const int*)table, index, 4);
+			__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+			_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(words, words));
+		}
+		if (i < outWidth * 4)
+		{
+			const float* tail[MaxTaps];
+			for (int k = 0; k < filter.taps; k++)
+				tail[k] = rows[k] + i;
+			filterColumnSse(tail, 1, filter, out + i, table);
+		}
+	}
+
+	const Kernel kernels[3] = {
+		{ decodeScalar, filterRowScalar, filterColumnScalar },
+		{ decodeScalar, filterRowSse, filterColumnSse },
+		{ decodeAvx2, filterRowAvx2, filterColumnAvx2 },
+	};
+
+	const Kernel& pickKernel(MipKernel kernel)
+	{
+		const bool avx2 = cpuHasAvx2();
+		if (kernel == MipKernelScalar)
+			return kernels[0];
+		if ((kernel == MipKernelAuto || kernel == MipKernelAVX2) && avx2)
+			return kernels[2];
+		return kernels[1];
+	}
+
+	struct DownsampleJob
+	{
+		const unsigned char* source;
+		int width, height;
+		unsigned char* destination;
+		int outWidth, outHeight;
+		Filter horizontal, vertical;
+		const Kernel* kernel;
+		const float* decode;
+		const int32_t* encode;
+	};
+
+	int clampRow(int row, int height)
+	{
+		return std::min(std::max(row, 0), height - 1);
+	}
+
+	// output rows [first, last). Input rows are filtered horizontally into a ring
+	// of MaxTaps rows as the vertical taps reach them, it stays in the cache.
+	void downsampleBand(const DownsampleJob& job, int first, int last)
+	{
+		INSTRUMENT_SCOPE("mip band");
+		const Filter& vertical = job.vertical;
+		const size_t outStride = (size_t)job.outWidth * 4;
+		std::vector<float> padded((size_t)(job.width + 2 * Pad) * 4), ring(MaxTaps * outStride);
+		int ringRows[MaxTaps];
+		std::fill(ringRows, ringRows + MaxTaps, -1);
+		const float* taps[MaxTaps];
+		for (int y = first; y < last; y++)
+		{
+			for (int k = 0; k < vertical.taps; k++)
+			{
+				int row = clampRow(vertical.step * y + vertical.first + k, job.height);
+				float* filtered = &ring[(row % MaxTaps) * outStride];
+				if (ringRows[row % MaxTaps] != row)
+				{
+					job.kernel->decode(job.source + (size_t)row * job.width * 4, job.width, &padded[Pad * 4], job.decode);
+					for (int p = 0; p < Pad; p++)
+					{
+						memcpy(&padded[p * 4], &padded[Pad * 4], 4 * sizeof(float));
+						memcpy(&padded[(Pad + job.width + p) * 4], &padded[(Pad + job.width - 1) * 4], 4 * sizeof(float));
+					}
+					job.kernel->filterRow(padded.data(), job.outWidth, job.horizontal, filtered);
+					ringRows[row % MaxTaps] = row;
+				}
+				taps[k] = filtered;
+			}
+			job.kernel->filterColumn(taps, job.outWidth, vertical, job.destination + y * outStride, job.encode);
+		}
+	}
+}
+
+bool mipKernelSupported(MipKernel kernel)
+{
+	return kernel != MipKernelAVX2 || cpuHasAvx2();
+}
+
+int mipLevelCount(int width, int height)
+{
+	int levels = 1;
+	for (; width > 1 || height > 1; levels++)
+	{
+		width = mipSize(width);
+		height = mipSize(height);
+	}
+	return levels;
+}
+
+void downsampleMip(const unsigned char* source, int width, int height, unsigned char* destination, const MipOptions& options)
+{
+	const ColorTables& tables = colorTables();
+	DownsampleJob job;
+	job.source = source;
+	job.width = width;
+	job.height = height;
+	job.destination = destination;
+	job.outWidth = mipSize(width);
+	job.outHeight = mipSize(height);
+	job.horizontal = makeFilter(options.filter, width);
+	job.vertical = makeFilter(options.filter, height);
+	job.kernel = &pickKernel(options.kernel);
+	job.decode = tables.decode[options.srgb ? 1 : 0];
+	job.encode = tables.encode[options.srgb ? 1 : 0];
+
+	// bands of at least 64k output texels, a thread costs more than a small level
+	unsigned int threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	int bands = (int)std::min((long long)threads, std::max(1LL, (long long)job.outWidth * job.outHeight / 65536));
+	bands = std::min(bands, job.outHeight);
+	std::vector<std::thread> workers;
+	for (int band = 1; band < bands; band++)
+		workers.push_back(std::thread(downsampleBand, std::cref(job), job.outHeight * band / bands, job.outHeight * (band + 1) / bands));
+	downsampleBand(job, 0, job.outHeight / bands);
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+MipChain::MipChain() : generateMilliseconds(0.0)
+{
+}
+
+void MipChain::generate(const unsigned char* pixels, int width, int height, const MipOptions& options)
+{
+	INSTRUMENT_SCOPE("mip chain");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const int levels = mipLevelCount(width, height);
+	widths.resize(levels);
+	heights.resize(levels);
+	offsets.resize(levels);
+	size_t total = 0;
+	for (int level = 0; level < levels; level++)
+	{
+		widths[level] = width;
+		heights[level] = height;
+		offsets[level] = total;
+		total += (size_t)width * height * 4;
+		width = mipSize(width);
+		height = mipSize(height);
+	}
+	data.resize(total);
+	memcpy(data.data(), pixels, (size_t)widths[0] * heights[0] * 4);
+	for (int level = 1; level < levels; level++)
+		downsampleMip(data.data() + offsets[level - 1], widths[level - 1], heights[level - 1], data.data() + offsets[level], options);
+	generateMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+enum MipFilter
+{
+	MipBox,     // 2x2 average
+	MipKaiser,  // 8 taps of a Kaiser windowed sinc, sharper, keeps less aliasing
+};
+
+enum MipKernel
+{
+	MipKernelAuto,    // AVX2 when the CPU has it, else SSE
+	MipKernelScalar,
+	MipKernelSSE,
+	MipKernelAVX2,
+};
+
+struct MipOptions
+{
+	MipFilter filter;
+	bool srgb;             // color channels sRGB encoded and filtered in linear space, alpha always linear
+	MipKernel kernel;
+	unsigned int threads;  // 0 picks one per core
+
+	MipOptions(MipFilter filter = MipKaiser, bool srgb = true) : filter(filter), srgb(srgb), kernel(MipKernelAuto), threads(0) {}
+};
+
+// false for AVX2 on a CPU or OS without it, such a request falls back to SSE
+bool mipKernelSupported(MipKernel kernel);
+
+// the level below is halved in every dimension above 1
+inline int mipSize(int size) { return size > 1 ? size / 2 : 1; }
+int mipLevelCount(int width, int height);
+
+// One RGBA8 level from the one above, destination mipSize(width) x
+// mipSize(height). Rows go through a horizontal then a vertical pass in
+// floats, split into bands over the threads; every kernel computes the same
+// sums in the same order, so they give the same bytes.
+void downsampleMip(const unsigned char* source, int width, int height, unsigned char* destination, const MipOptions& options);
+
+// A full mip chain of an RGBA8 image built on the CPU, for uploading level by
+// level instead of glGenerateMipmap and for the offline cookers.
+class MipChain
+{
+public:
+	MipChain();
+
+	// level 0 is a copy of pixels
+	void generate(const unsigned char* pixels, int width, int height, const MipOptions& options = MipOptions());
+
+	int levelCount() const { return (int)widths.size(); }
+	int width(int level) const { return widths[level]; }
+	int height(int level) const { return heights[level]; }
+	const unsigned char* level(int level) const { return data.data() + offsets[level]; }
+	size_t bytes() const { return data.size(); }
+	// of the last generate(), level 0 copy included
+	double milliseconds() const { return generateMilliseconds; }
+
+private:
+	std::vector<unsigned char> data;
+	std::vector<size_t> offsets;
+	std::vector<int> widths, heights;
+	double generateMilliseconds;
+};
@@ -0,0 +1,122 @@
+#include "NormalMatrix.h"
+#include "Instrument.h"
+
+#include <emmintrin.h>
+
+namespace
+{
+	// relative tolerance for treating the columns as orthogonal and of equal length
+	const float uniformEpsilon = 1e-5f;
+
+	struct Vec3x4
+	{
+		__m128 x, y, z;
+	};
+
+	__m128 dot(const Vec3x4& a, const Vec3x4& b)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+	}
+
+	Vec3x4 cross(const Vec3x4& a, const Vec3x4& b)
+	{
+		Vec3x4 r;
+		r.x = _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y));
+		r.y = _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z));
+		r.z = _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x));
+		return r;
+	}
+
+	Vec3x4 scale(const Vec3x4& a, __m128 s)
+	{
+		Vec3x4 r = { _mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s) };
+		return r;
+	}
+
+	Vec3x4 select(__m128 mask, const Vec3x4& a, const Vec3x4& b)
+	{
+		Vec3x4 r;
+		r.x = _mm_or_ps(_mm_and_ps(mask, a.x), _mm_andnot_ps(mask, b.x));
+		r.y = _mm_or_ps(_mm_and_ps(mask, a.y), _mm_andnot_ps(mask, b.y));
+		r.z = _mm_or_ps(_mm_and_ps(mask, a.z), _mm_andnot_ps(mask, b.z));
+		return r;
+	}
+
+	__m128 absolute(__m128 a)
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+	}
+
+	// column c of four matrices, one lane per matrix
+	Vec3x4 loadColumn(const glm::mat4* models, int c)
+	{
+		__m128 m0 = _mm_loadu_ps(&models[0][c][0]);
+		__m128 m1 = _mm_loadu_ps(&models[1][c][0]);
+		__m128 m2 = _mm_loadu_ps(&models[2][c][0]);
+		__m128 m3 = _mm_loadu_ps(&models[3][c][0]);
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		Vec3x4 r = { m0, m1, m2 };
+		return r;
+	}
+
+	void storeColumn(glm::mat3* normalMatrices, int c, const Vec3x4& column)
+	{
+		__m128 m0 = column.x, m1 = column.y, m2 = column.z, m3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		__m128 lanes[4] = { m0, m1, m2, m3 };
+		for (int i = 0; i < 4; i++)
+		{
+			float values[4];
+			_mm_storeu_ps(values, lanes[i]);
+			normalMatrices[i][c] = glm::vec3(values[0], values[1], values[2]);
+		}
+	}
+}
+
+void computeNormalMatrices(const glm::mat4* models, glm::mat3* normalMatrices, size_t count)
+{
+	INSTRUMENT_SCOPE("normal matrices");
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		Vec3x4 a = loadColumn(models + i, 0), b = loadColumn(models + i, 1), c = loadColumn(models + i, 2);
+		__m128 aa = dot(a, a), bb = dot(b, b), cc = dot(c, c);
+
+		// uniform scale: equal column lengths and zero dot products, relative to |a|^2
+		__m128 tolerance = _mm_mul_ps(aa, _mm_set1_ps(uniformEpsilon));
+		__m128 uniform = _mm_and_ps(
+			_mm_and_ps(_mm_cmple_ps(absolute(_mm_sub_ps(aa, bb)), tolerance), _mm_cmple_ps(absolute(_mm_sub_ps(aa, cc)), tolerance)),
+			_mm_and_ps(_mm_and_ps(_mm_cmple_ps(absolute(dot(a, b)), tolerance), _mm_cmple_ps(absolute(dot(b, c)), tolerance)),
+				_mm_cmple_ps(absolute(dot(c, a)), tolerance)));
+
+		Vec3x4 bc = cross(b, c);
+		if (_mm_movemask_ps(uniform) == 0xF)
+		{
+			__m128 invScale = _mm_div_ps(_mm_set1_ps(1.0f), aa);
+			storeColumn(normalMatrices + i, 0, scale(a, invScale));
+			storeColumn(normalMatrices + i, 1, scale(b, invScale));
+			storeColumn(normalMatrices + i, 2, scale(c, invScale));
+			continue;
+		}
+
+		// adjugate columns are the cross products of the other two columns
+		__m128 invScale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_or_ps(_mm_and_ps(uniform, aa), _mm_andnot_ps(uniform, dot(a, bc))));
+		storeColumn(normalMatrices + i, 0, scale(select(uniform, a, bc), invScale));
+		storeColumn(normalMatrices + i, 1, scale(select(uniform, b, cross(c, a)), invScale));
+		storeColumn(normalMatrices + i, 2, scale(select(uniform, c, cross(a, b)), invScale));
+	}
+	for (; i < count; i++)
+		normalMatrices[i] = normalMatrix(models[i]);
+}
+
+glm::mat3 normalMatrix(const glm::mat4& model)
+{
+	glm::vec3 a(model[0]), b(model[1]), c(model[2]);
+	float aa = glm::dot(a, a), tolerance = aa * uniformEpsilon;
+	if (glm::abs(aa - glm::dot(b, b)) <= tolerance && glm::abs(aa - glm::dot(c, c)) <= tolerance
+		&& glm::abs(glm::dot(a, b)) <= tolerance && glm::abs(glm::dot(b, c)) <= tolerance && glm::abs(glm::dot(c, a)) <= tolerance)
+		return glm::mat3(a, b, c) / aa;
+
+	glm::vec3 bc = glm::cross(b, c);
+	return glm::mat3(bc, glm::cross(c, a), glm::cross(a, b)) / glm::dot(a, bc);
+}
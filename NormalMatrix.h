@@ -0,0 +1,14 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// Normal matrices, transpose(inverse(mat3(model))), four models at a time with SSE.
+// Rotations with a uniform scale s only need mat3(model) / s^2, every other
+// model gets the adjugate of its upper 3x3 divided by the determinant; the
+// 4x4 inverse is never computed.
+void computeNormalMatrices(const glm::mat4* models, glm::mat3* normalMatrices, size_t count);
+
+// the same for one model, scalar
+glm::mat3 normalMatrix(const glm::mat4& model);
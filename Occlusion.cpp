@@ -0,0 +1,86 @@
+#include "Occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+	: rasterizer(width, height), viewportWidth(width), viewportHeight(height)
+{
+	frameStats = OcclusionStats();
+}
+
+void OcclusionCuller::setViewport(int width, int height)
+{
+	viewportWidth = width;
+	viewportHeight = height;
+}
+
+void OcclusionCuller::beginFrame(const glm::mat4& viewProjection)
+{
+	rasterizer.beginFrame(viewProjection);
+	frameStats = OcclusionStats();
+}
+
+void OcclusionCuller::transformAabb(const glm::mat4& model, const glm::vec3& localMin, const glm::vec3& localMax,
+	glm::vec3& worldMin, glm::vec3& worldMax)
+{
+	worldMin = glm::vec3(INFINITY);
+	worldMax = glm::vec3(-INFINITY);
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? localMax.x : localMin.x, (i & 2) ? localMax.y : localMin.y, (i & 4) ? localMax.z : localMin.z);
+		glm::vec3 p = glm::vec3(model * glm::vec4(corner, 1.0f));
+		worldMin = glm::min(worldMin, p);
+		worldMax = glm::max(worldMax, p);
+	}
+}
+
+float OcclusionCuller::screenCoverage(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const
+{
+	DepthRasterizer::ScreenRect rect;
+	if (!rasterizer.projectAabb(aabbMin, aabbMax, rect))
+		return 0.0f;
+	float width = (float)rasterizer.getWidth(), height = (float)rasterizer.getHeight();
+	float w = std::min(rect.maxX, width) - std::max(rect.minX, 0.0f);
+	float h = std::min(rect.maxY, height) - std::max(rect.minY, 0.0f);
+	if (w <= 0.0f || h <= 0.0f)
+		return 0.0f;
+	return (w * h) / (width * height);
+}
+
+void OcclusionCuller::addOccluder(const float* vertices, unsigned int vertexCount, unsigned int stride, const glm::mat4& model)
+{
+	rasterizer.addMesh(vertices, vertexCount, stride, model);
+	frameStats.occluders++;
+}
+
+void OcclusionCuller::buildHiZ()
+{
+	rasterizer.rasterize();
+}
+
+bool OcclusionCuller::isVisible(const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+{
+	frameStats.tested++;
+
+	DepthRasterizer::ScreenRect rect;
+	if (!rasterizer.projectAabb(aabbMin, aabbMax, rect))
+		return true;
+
+	int width = rasterizer.getWidth(), height = rasterizer.getHeight();
+	// off screen, or every corner behind the far plane
+	if (rect.maxX < 0.0f || rect.maxY < 0.0f || rect.minX >= width || rect.minY >= height || rect.nearestDepth > 1.0f)
+	{
+		frameStats.outsideView++;
+		return false;
+	}
+
+	if (!rasterizer.isOccluded(rect))
+		return true;
+
+	float w = std::min(rect.maxX, (float)width) - std::max(rect.minX, 0.0f);
+	float h = std::min(rect.maxY, (float)height) - std::max(rect.minY, 0.0f);
+	frameStats.occluded++;
+	frameStats.fragmentsSaved += (double)w * h * ((double)viewportWidth / width) * ((double)viewportHeight / height);
+	return false;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "DepthRasterizer.h"
+
+#include <glm/glm.hpp>
+
+struct OcclusionStats
+{
+	unsigned int occluders;
+	unsigned int tested;
+	unsigned int outsideView;
+	unsigned int occluded;
+	double fragmentsSaved; // screen pixels covered by the culled objects' bounds
+};
+
+// CPU occlusion culling: the large occluders are rasterized into a small depth
+// buffer, a max-depth mip pyramid (Hi-Z) is built over it and object bounds are
+// tested against the pyramid level that covers them with a handful of texels.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller(int width, int height);
+
+	void setViewport(int width, int height);
+	void beginFrame(const glm::mat4& viewProjection);
+
+	// fraction of the screen covered by the projected box, 0 if it crosses the near plane
+	float screenCoverage(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const;
+	void addOccluder(const float* vertices, unsigned int vertexCount, unsigned int stride, const glm::mat4& model);
+	void buildHiZ();
+
+	bool isVisible(const glm::vec3& aabbMin, const glm::vec3& aabbMax);
+
+	const OcclusionStats& stats() const { return frameStats; }
+
+	static void transformAabb(const glm::mat4& model, const glm::vec3& localMin, const glm::vec3& localMax,
+		glm::vec3& worldMin, glm::vec3& worldMax);
+
+private:
+	DepthRasterizer rasterizer;
+	int viewportWidth, viewportHeight;
+
+	OcclusionStats frameStats;
+};
@@ -0,0 +1,236 @@
+#include "Profiler.h"
+#include "Log.h"
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	double microsecondsBetween(Profiler::Clock::time_point from, Profiler::Clock::time_point to)
+	{
+		return std::chrono::duration<double, std::micro>(to - from).count();
+	}
+}
+
+Profiler::Profiler() : frameNumber(0), depth(0), queriesCreated(false), dropped(0), framesCollected(0), start(Clock::now()), oldestFrame(0)
+{
+	history.reserve(MaxHistory);
+	for (Frame& frame : ring)
+	{
+		frame.number = 0;
+		frame.usedQueries = 0;
+		frame.gpuCalibration = 0;
+		frame.pending = frame.gpuValid = false;
+	}
+}
+
+void Profiler::createQueries()
+{
+	// enough for a typical frame, allocateQuery adds more when a frame needs them
+	const unsigned int initialQueries = 32;
+	for (Frame& frame : ring)
+	{
+		frame.queries.resize(initialQueries);
+		glGenQueries(initialQueries, frame.queries.data());
+	}
+	queriesCreated = true;
+}
+
+void Profiler::release()
+{
+	for (Frame& frame : ring)
+	{
+		if (!frame.queries.empty())
+			glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+		frame.queries.clear();
+		frame.usedQueries = 0;
+		frame.pending = false;
+	}
+	queriesCreated = false;
+}
+
+int Profiler::allocateQuery()
+{
+	Frame& frame = ring[frameNumber % FrameLatency];
+	if (frame.usedQueries == frame.queries.size())
+	{
+		unsigned int query;
+		glGenQueries(1, &query);
+		frame.queries.push_back(query);
+	}
+	return (int)frame.usedQueries++;
+}
+
+void Profiler::beginFrame()
+{
+	Frame& frame = ring[frameNumber % FrameLatency];
+	if (frame.pending)
+		collect(frame);
+
+	frame.number = frameNumber;
+	frame.records.clear();
+	frame.usedQueries = 0;
+	frame.cpuCalibration = Clock::now();
+	frame.gpuCalibration = 0;
+	if (queriesCreated)
+	{
+		GLint64 timestamp;
+		glGetInteger64v(GL_TIMESTAMP, &timestamp);
+		frame.gpuCalibration = timestamp;
+	}
+	depth = 0;
+}
+
+void Profiler::endFrame()
+{
+	ring[frameNumber % FrameLatency].pending = true;
+	frameNumber++;
+}
+
+unsigned int Profiler::begin(const char* name, bool gpu)
+{
+	Frame& frame = ring[frameNumber % FrameLatency];
+	Record record;
+	record.name = name;
+	record.depth = depth++;
+	record.queryBegin = record.queryEnd = -1;
+	record.gpuBegin = record.gpuEnd = 0;
+	if (gpu && queriesCreated)
+	{
+		record.queryBegin = allocateQuery();
+		glQueryCounter(frame.queries[record.queryBegin], GL_TIMESTAMP);
+	}
+	record.cpuBegin = Clock::now();
+	frame.records.push_back(record);
+	return (unsigned int)frame.records.size() - 1;
+}
+
+void Profiler::end(unsigned int scope)
+{
+	Frame& frame = ring[frameNumber % FrameLatency];
+	Record& record = frame.records[scope];
+	record.cpuEnd = Clock::now();
+	if (record.queryBegin >= 0)
+	{
+		record.queryEnd = allocateQuery();
+		glQueryCounter(frame.queries[record.queryEnd], GL_TIMESTAMP);
+	}
+	depth--;
+}
+
+void Profiler::collect(Frame& frame)
+{
+	frame.pending = false;
+	frame.gpuValid = false;
+	if (frame.usedQueries > 0)
+	{
+		// queries finish in order, the last one stands for the whole frame
+		GLint available = 0;
+		glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			for (Record& record : frame.records)
+			{
+				if (record.queryBegin < 0)
+					continue;
+				GLuint64 begin, end;
+				glGetQueryObjectui64v(frame.queries[record.queryBegin], GL_QUERY_RESULT, &begin);
+				glGetQueryObjectui64v(frame.queries[record.queryEnd], GL_QUERY_RESULT, &end);
+				record.gpuBegin = begin;
+				record.gpuEnd = end;
+			}
+			frame.gpuValid = true;
+		}
+		else
+			dropped++;
+	}
+
+	for (const Record& record : frame.records)
+	{
+		Totals* entry = nullptr;
+		for (Totals& t : totals)
+			if (t.depth == record.depth && std::strcmp(t.name, record.name) == 0)
+				entry = &t;
+		if (!entry)
+		{
+			Totals t = { record.name, record.depth, 0.0, 0.0 };
+			totals.push_back(t);
+			entry = &totals.back();
+		}
+		entry->cpu += microsecondsBetween(record.cpuBegin, record.cpuEnd) / 1000.0;
+		if (frame.gpuValid && record.queryBegin >= 0)
+			entry->gpu += (record.gpuEnd - record.gpuBegin) / 1e6;
+	}
+	framesCollected++;
+
+	if (history.size() < MaxHistory)
+		history.push_back(frame);
+	else
+	{
+		history[oldestFrame] = frame;
+		oldestFrame = (oldestFrame + 1) % MaxHistory;
+	}
+	history[(oldestFrame + history.size() - 1) % history.size()].queries.clear();
+}
+
+void Profiler::takeTimings(std::vector<PassTiming>& timings)
+{
+	timings.clear();
+	if (!framesCollected)
+		return;
+	for (const Totals& t : totals)
+	{
+		PassTiming timing = { t.name, t.depth, (float)(t.cpu / framesCollected), (float)(t.gpu / framesCollected) };
+		timings.push_back(timing);
+	}
+	totals.clear();
+	framesCollected = 0;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path, const InstrumentCollector* threads) const
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		LOG_ERROR("ERROR::PROFILER::CANNOT_WRITE " << path);
+		return false;
+	}
+	// complete events in microseconds since the profiler started, the GPU on its own track
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+	file.precision(3);
+	file << std::fixed;
+	for (size_t k = 0; k < history.size(); k++)
+	{
+		const Frame& frame = history[(oldestFrame + k) % history.size()];
+		double gpuOrigin = microsecondsBetween(start, frame.cpuCalibration);
+		for (const Record& record : frame.records)
+		{
+			file << ",\n{\"name\":\"" << record.name << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":"
+				<< microsecondsBetween(start, record.cpuBegin) << ",\"dur\":" << microsecondsBetween(record.cpuBegin, record.cpuEnd)
+				<< ",\"args\":{\"frame\":" << frame.number << "}}";
+			if (!frame.gpuValid || record.queryBegin < 0)
+				continue;
+			file << ",\n{\"name\":\"" << record.name << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":"
+				<< gpuOrigin + ((long long)record.gpuBegin - frame.gpuCalibration) / 1000.0 << ",\"dur\":" << (record.gpuEnd - record.gpuBegin) / 1000.0
+				<< ",\"args\":{\"frame\":" << frame.number << "}}";
+		}
+	}
+	if (threads)
+	{
+		// instrumented threads from tid 10 on
+		std::vector<std::string> names = threads->threadNames();
+		for (size_t i = 0; i < names.size(); i++)
+			file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << 10 + i << ",\"args\":{\"name\":\"" << names[i] << "\"}}";
+		for (size_t k = 0; k < threads->frameCount(); k++)
+			for (const TimelineEvent& event : threads->frame(k))
+				file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"thread\",\"ph\":\"X\",\"pid\":1,\"tid\":" << 10 + event.thread
+					<< ",\"ts\":" << microsecondsBetween(start, event.begin) << ",\"dur\":" << event.microseconds << "}";
+	}
+	file << "\n]}\n";
+	return (bool)file;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Instrument.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct PassTiming
+{
+	const char* name;
+	int depth;            // nesting level, 0 for the outermost passes
+	float cpuMilliseconds; // averages over the frames since the last takeTimings()
+	float gpuMilliseconds; // 0 for CPU only scopes
+};
+
+// Frame profiler with named, nestable scopes. A scope records steady_clock
+// times on the CPU and, unless it is CPU only, a pair of GL_TIMESTAMP queries.
+// The queries go to a ring of FrameLatency frames and are read back when their
+// slot comes around again, a frame whose results are not ready by then loses
+// its GPU times instead of stalling. Finished frames are kept for a Chrome
+// trace-event JSON export (chrome://tracing, Perfetto).
+class Profiler
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+	static const unsigned int FrameLatency = 3;
+	static const unsigned int MaxHistory = 600; // frames kept for the trace
+
+	Profiler();
+
+	// GL side, needs a context
+	void createQueries();
+	void release();
+
+	void beginFrame();
+	void endFrame();
+
+	unsigned int begin(const char* name, bool gpu = true);
+	void end(unsigned int scope);
+
+	class Scope
+	{
+	public:
+		Scope(Profiler& profiler, const char* name, bool gpu = true) : profiler(profiler), scope(profiler.begin(name, gpu)) {}
+		~Scope() { profiler.end(scope); }
+	private:
+		Profiler& profiler;
+		unsigned int scope;
+	};
+
+	// per pass averages since the previous call, in the order the passes first ran,
+	// timings keeps its storage from call to call
+	void takeTimings(std::vector<PassTiming>& timings);
+	unsigned int droppedFrames() const { return dropped; }
+
+	// with the instrumented CPU threads of threads on their own tracks
+	bool writeChromeTrace(const std::string& path, const InstrumentCollector* threads = nullptr) const;
+
+private:
+	struct Record
+	{
+		const char* name;
+		int depth;
+		Clock::time_point cpuBegin, cpuEnd;
+		int queryBegin, queryEnd;        // -1 for CPU only scopes
+		unsigned long long gpuBegin, gpuEnd;
+	};
+
+	struct Frame
+	{
+		unsigned int number;
+		std::vector<Record> records;
+		std::vector<unsigned int> queries;
+		unsigned int usedQueries;
+		Clock::time_point cpuCalibration;  // the same moment on both clocks
+		long long gpuCalibration;
+		bool pending;
+		bool gpuValid;
+	};
+
+	struct Totals
+	{
+		const char* name;
+		int depth;
+		double cpu, gpu; // summed over the collected frames
+	};
+
+	int allocateQuery();
+	void collect(Frame& frame);
+
+	Frame ring[FrameLatency];
+	unsigned int frameNumber;
+	int depth;
+	bool queriesCreated;
+	unsigned int dropped;
+	unsigned int framesCollected;
+	Clock::time_point start;
+
+	// ring of finished frames, a slot reuses the storage of the frame it replaces
+	std::vector<Frame> history;
+	unsigned int oldestFrame;
+	std::vector<Totals> totals;
+};
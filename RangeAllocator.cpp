@@ -0,0 +1,253 @@
+#include "RangeAllocator.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// v != 0
+	int lowestBit(unsigned int v)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, v);
+		return (int)index;
+#else
+		return __builtin_ctz(v);
+#endif
+	}
+
+	int highestBit(unsigned int v)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, v);
+		return (int)index;
+#else
+		return 31 - __builtin_clz(v);
+#endif
+	}
+}
+
+RangeAllocator::RangeAllocator(unsigned int capacity) : firstLevelMap(0), total(capacity), usedSize(0), freeCount(0)
+{
+	for (int f = 0; f < FirstLevelCount; f++)
+	{
+		secondLevelMaps[f] = 0;
+		for (int s = 0; s < SecondLevelCount; s++)
+			heads[f][s] = Invalid;
+	}
+	if (capacity == 0)
+		return;
+	unsigned int block = newBlock();
+	blocks[block].offset = 0;
+	blocks[block].size = capacity;
+	insertFree(block);
+}
+
+void RangeAllocator::mapping(unsigned int size, int& firstLevel, int& secondLevel)
+{
+	if (size < SecondLevelCount)
+	{
+		firstLevel = 0;
+		secondLevel = (int)size;
+		return;
+	}
+	int log = highestBit(size);
+	firstLevel = log - SecondLevelBits + 1;
+	secondLevel = (int)(size >> (log - SecondLevelBits)) - SecondLevelCount;
+}
+
+unsigned int RangeAllocator::newBlock()
+{
+	unsigned int block;
+	if (unusedBlocks.empty())
+	{
+		block = (unsigned int)blocks.size();
+		blocks.push_back(Block());
+	}
+	else
+	{
+		block = unusedBlocks.back();
+		unusedBlocks.pop_back();
+	}
+	Block& b = blocks[block];
+	b.offset = b.size = 0;
+	b.previous = b.next = b.previousFree = b.nextFree = Invalid;
+	b.free = false;
+	return block;
+}
+
+void RangeAllocator::insertFree(unsigned int block)
+{
+	Block& b = blocks[block];
+	int f, s;
+	mapping(b.size, f, s);
+	b.free = true;
+	b.previousFree = Invalid;
+	b.nextFree = heads[f][s];
+	if (b.nextFree != Invalid)
+		blocks[b.nextFree].previousFree = block;
+	heads[f][s] = block;
+	firstLevelMap |= 1u << f;
+	secondLevelMaps[f] |= 1u << s;
+	freeCount++;
+}
+
+void RangeAllocator::removeFree(unsigned int block)
+{
+	Block& b = blocks[block];
+	int f, s;
+	mapping(b.size, f, s);
+	if (b.previousFree != Invalid)
+		blocks[b.previousFree].nextFree = b.nextFree;
+	else
+		heads[f][s] = b.nextFree;
+	if (b.nextFree != Invalid)
+		blocks[b.nextFree].previousFree = b.previousFree;
+	if (heads[f][s] == Invalid)
+	{
+		secondLevelMaps[f] &= ~(1u << s);
+		if (!secondLevelMaps[f])
+			firstLevelMap &= ~(1u << f);
+	}
+	b.free = false;
+	b.previousFree = b.nextFree = Invalid;
+	freeCount--;
+}
+
+RangeAllocator::Range RangeAllocator::take(unsigned int block, unsigned int size)
+{
+	removeFree(block);
+	if (blocks[block].size > size)
+	{
+		// newBlock may grow the vector, no references across it
+		unsigned int rest = newBlock();
+		Block& b = blocks[block];
+		Block& r = blocks[rest];
+		r.offset = b.offset + size;
+		r.size = b.size - size;
+		r.previous = block;
+		r.next = b.next;
+		if (b.next != Invalid)
+			blocks[b.next].previous = rest;
+		b.next = rest;
+		b.size = size;
+		insertFree(rest);
+	}
+	usedSize += size;
+	Range range = { blocks[block].offset, size, block };
+	return range;
+}
+
+RangeAllocator::Range RangeAllocator::allocate(unsigned int size)
+{
+	Range none = { Invalid, 0, Invalid };
+	if (size == 0 || size > total - usedSize)
+		return none;
+
+	// round up to the next size class, any block in it or above is big enough
+	unsigned int rounded = size;
+	if (size >= SecondLevelCount)
+	{
+		unsigned int step = 1u << (highestBit(size) - SecondLevelBits);
+		if (size <= 0xffffffffu - step)
+			rounded = size + step - 1;
+	}
+	int f, s;
+	mapping(rounded, f, s);
+	unsigned int secondMap = secondLevelMaps[f] & (~0u << s);
+	if (!secondMap)
+	{
+		unsigned int firstMap = f + 1 < 32 ? firstLevelMap & (~0u << (f + 1)) : 0;
+		if (firstMap)
+		{
+			f = lowestBit(firstMap);
+			secondMap = secondLevelMaps[f];
+		}
+	}
+	if (secondMap)
+		return take(heads[f][lowestBit(secondMap)], size);
+
+	// nearly full, a block of the unrounded class may still fit
+	mapping(size, f, s);
+	for (unsigned int block = heads[f][s]; block != Invalid; block = blocks[block].nextFree)
+		if (blocks[block].size >= size)
+			return take(block, size);
+	return none;
+}
+
+void RangeAllocator::free(const Range& range)
+{
+	if (range.offset == Invalid)
+		return;
+	unsigned int block = range.block;
+	usedSize -= blocks[block].size;
+
+	unsigned int next = blocks[block].next;
+	if (next != Invalid && blocks[next].free)
+	{
+		removeFree(next);
+		blocks[block].size += blocks[next].size;
+		blocks[block].next = blocks[next].next;
+		if (blocks[next].next != Invalid)
+			blocks[blocks[next].next].previous = block;
+		unusedBlocks.push_back(next);
+	}
+	unsigned int previous = blocks[block].previous;
+	if (previous != Invalid && blocks[previous].free)
+	{
+		removeFree(previous);
+		blocks[previous].size += blocks[block].size;
+		blocks[previous].next = blocks[block].next;
+		if (blocks[block].next != Invalid)
+			blocks[blocks[block].next].previous = previous;
+		unusedBlocks.push_back(block);
+		block = previous;
+	}
+	insertFree(block);
+}
+
+RangeAllocator::Range RangeAllocator::relocate(const Range& range)
+{
+	unsigned int best = Invalid;
+	for (int f = 0; f < FirstLevelCount; f++)
+	{
+		if (!(firstLevelMap & (1u << f)))
+			continue;
+		for (int s = 0; s < SecondLevelCount; s++)
+			for (unsigned int block = heads[f][s]; block != Invalid; block = blocks[block].nextFree)
+			{
+				const Block& b = blocks[block];
+				if (b.size >= range.size && b.offset + range.size <= range.offset && (best == Invalid || b.offset < blocks[best].offset))
+					best = block;
+			}
+	}
+	if (best == Invalid)
+		return range;
+	Range moved = take(best, range.size);
+	free(range);
+	return moved;
+}
+
+unsigned int RangeAllocator::largestFree() const
+{
+	if (!firstLevelMap)
+		return 0;
+	int f = highestBit(firstLevelMap);
+	int s = highestBit(secondLevelMaps[f]);
+	unsigned int largest = 0;
+	for (unsigned int block = heads[f][s]; block != Invalid; block = blocks[block].nextFree)
+		if (blocks[block].size > largest)
+			largest = blocks[block].size;
+	return largest;
+}
+
+float RangeAllocator::fragmentation() const
+{
+	unsigned int freeSize = total - usedSize;
+	if (freeSize == 0)
+		return 0.0f;
+	return 1.0f - (float)largestFree() / freeSize;
+}
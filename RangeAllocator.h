@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+// Two level segregated fit (TLSF) allocator of ranges in [0, capacity). It
+// only does the bookkeeping, the units are whatever the owner places there,
+// vertices or indices in a GL buffer for GeometryPool. Free ranges sit in
+// lists by size class, a power of two split into 16 steps, found through two
+// bitmaps, so allocate and free are constant time. Neighbouring free ranges
+// are merged on free.
+class RangeAllocator
+{
+public:
+	static const unsigned int Invalid = 0xffffffffu;
+
+	struct Range
+	{
+		unsigned int offset;  // Invalid when nothing fits
+		unsigned int size;
+		unsigned int block;   // bookkeeping node, for free()
+	};
+
+	explicit RangeAllocator(unsigned int capacity);
+
+	Range allocate(unsigned int size);
+	void free(const Range& range);
+	// moves range to the lowest free spot that ends before it starts, returns
+	// range itself when there is none. Walks every free range, for compaction.
+	Range relocate(const Range& range);
+
+	unsigned int capacity() const { return total; }
+	unsigned int used() const { return usedSize; }
+	unsigned int largestFree() const;
+	unsigned int freeRangeCount() const { return freeCount; }
+	// 0 when all free space is one range, towards 1 when it is scattered
+	float fragmentation() const;
+
+private:
+	static const int SecondLevelBits = 4;
+	static const int SecondLevelCount = 1 << SecondLevelBits;
+	static const int FirstLevelCount = 32 - SecondLevelBits + 1;
+
+	struct Block
+	{
+		unsigned int offset, size;
+		unsigned int previous, next;          // physical neighbours, Invalid at the ends
+		unsigned int previousFree, nextFree;  // size class list
+		bool free;
+	};
+
+	static void mapping(unsigned int size, int& firstLevel, int& secondLevel);
+	unsigned int newBlock();
+	void insertFree(unsigned int block);
+	void removeFree(unsigned int block);
+	// splits size off the front of a free block and marks it used
+	Range take(unsigned int block, unsigned int size);
+
+	std::vector<Block> blocks;
+	std::vector<unsigned int> unusedBlocks;
+	unsigned int heads[FirstLevelCount][SecondLevelCount];
+	unsigned int firstLevelMap;
+	unsigned int secondLevelMaps[FirstLevelCount];
+	unsigned int total, usedSize, freeCount;
+};
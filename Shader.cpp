@@ -1,32 +1,145 @@
 #include "Shader.h"
+#include "Log.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+#include <algorithm>
+#include <set>
+
+namespace
 {
-	std::string vertexCode;
-	std::string fragmentCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
+	std::string readFile(const std::string& path)
+	{
+		std::ifstream file;
+		file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		file.open(path);
+		std::stringstream stream;
+		stream << file.rdbuf();
+		return stream.str();
+	}
+
+	std::string directoryOf(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	// expands #include "file" relative to the including file, every file at most
+	// once, and keeps the line numbers of the compiler messages with #line
+	void expandIncludes(const std::string& path, std::set<std::string>& included, std::string& out)
+	{
+		std::istringstream source(readFile(path));
+		std::string line;
+		int number = 0;
+		while (std::getline(source, line))
+		{
+			number++;
+			size_t first = line.find_first_not_of(" \t");
+			if (first != std::string::npos && line.compare(first, 8, "#include") == 0)
+			{
+				size_t open = line.find('"', first), close = line.find('"', open + 1);
+				if (open == std::string::npos || close == std::string::npos)
+				{
+					LOG_ERROR("ERROR::SHADER::BAD_INCLUDE " << path << ":" << number);
+					out += "\n";
+					continue;
+				}
+				std::string includePath = directoryOf(path) + line.substr(open + 1, close - open - 1);
+				if (included.insert(includePath).second)
+				{
+					out += "#line 1\n";
+					expandIncludes(includePath, included, out);
+					out += "#line " + std::to_string(number + 1) + "\n";
+				}
+				else
+					out += "\n";
+			}
+			else if (first != std::string::npos && line.compare(first, 16, "#pragma keywords") == 0)
+				out += "\n"; // read by ShaderVariants, the compiler would warn about it
+			else
+				out += line + "\n";
+		}
+	}
+}
 
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+std::string Shader::loadSource(const std::string& path, const std::vector<std::string>& defines, std::vector<std::string>* files)
+{
+	std::set<std::string> included;
+	included.insert(path);
+	std::string expanded;
 	try
 	{
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream, fShaderStream;
+		expandIncludes(path, included, expanded);
+	}
+	catch (...)
+	{
+		// a missing include still has to be watched for hot reload
+		if (files)
+			files->insert(files->end(), included.begin(), included.end());
+		throw;
+	}
+	if (files)
+		files->insert(files->end(), included.begin(), included.end());
 
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
+	// the defines go right after #version, which has to stay the first statement
+	std::string header;
+	for (const std::string& define : defines)
+		header += "#define " + define + "\n";
+	size_t version = expanded.find("#version");
+	if (version == std::string::npos)
+		return header + "#line 1\n" + expanded;
+	size_t lineEnd = expanded.find('\n', version);
+	if (lineEnd == std::string::npos)
+		return expanded + "\n" + header;
+	int versionLine = 1 + (int)std::count(expanded.begin(), expanded.begin() + lineEnd, '\n');
+	return expanded.substr(0, lineEnd + 1) + header + "#line " + std::to_string(versionLine + 1) + "\n" + expanded.substr(lineEnd + 1);
+}
 
-		vShaderFile.close();
-		fShaderFile.close();
+Shader::Shader(const char* vertexPath, const char* fragmentPath)
+	: Shader(vertexPath, fragmentPath, std::vector<std::string>())
+{
+}
 
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines)
+	: ID(0), vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines)
+{
+	build(ID);
+	program = ProgramHandle::adopt(ID);
+	uniforms.build(ID);
+}
+
+bool Shader::reload()
+{
+	unsigned int rebuilt;
+	if (!build(rebuilt))
+	{
+		glDeleteProgram(rebuilt);
+		return false;
+	}
+	copyUniforms(ID, rebuilt);
+	// the old program is deleted once the frames that drew with it are done
+	program = ProgramHandle::adopt(rebuilt);
+	ID = rebuilt;
+	uniforms.build(ID);
+	return true;
+}
+
+bool Shader::usesSource(const std::string& path) const
+{
+	return std::find(sources.begin(), sources.end(), path) != sources.end();
+}
+
+bool Shader::build(unsigned int& program)
+{
+	std::string vertexCode;
+	std::string fragmentCode;
+	sources.clear();
+	try
+	{
+		vertexCode = loadSource(vertexPath, defines, &sources);
+		fragmentCode = loadSource(fragmentPath, defines, &sources);
 	}
 	catch (std::ifstream::failure e)
 	{
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		LOG_ERROR("ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ");
 	}
 	const char* vShaderCode = vertexCode.c_str();
 	const char* fShaderCode = fragmentCode.c_str();
@@ -43,7 +156,7 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 	if (!success)
 	{
 		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		std::cout << "ERROR:SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+		LOG_ERROR("ERROR:SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog);
 		success = 1;
 	}
 
@@ -55,44 +168,97 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 	if (!success)
 	{
 		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		std::cout << "ERROR:SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+		LOG_ERROR("ERROR:SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog);
 		success = 1;
 	}
 
-	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
-	glLinkProgram(ID);
+	program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glLinkProgram(program);
 
-	glGetProgramiv(ID, GL_LINK_STATUS, &success);
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
 	if (!success)
 	{
-		glGetProgramInfoLog(ID, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		glGetProgramInfoLog(program, 512, NULL, infoLog);
+		LOG_ERROR("ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog);
 	}
 
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
+	return success != 0;
+}
 
+void Shader::copyUniforms(unsigned int from, unsigned int to)
+{
+	int previous, count;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+	glUseProgram(to);
+	glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+	for (int i = 0; i < count; i++)
+	{
+		char name[256];
+		int size;
+		GLenum type;
+		glGetActiveUniform(from, i, sizeof(name), NULL, &size, &type, name);
+		std::string base(name);
+		if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+			base.resize(base.size() - 3);
+
+		for (int element = 0; element < size; element++)
+		{
+			std::string elementName = size > 1 ? base + "[" + std::to_string(element) + "]" : base;
+			int source = glGetUniformLocation(from, elementName.c_str());
+			int target = glGetUniformLocation(to, elementName.c_str());
+			if (source < 0 || target < 0) // uniform block member or gone from the new program
+				continue;
+
+			float f[16];
+			int n[4];
+			unsigned int u[4];
+			switch (type)
+			{
+			case GL_FLOAT: glGetUniformfv(from, source, f); glUniform1fv(target, 1, f); break;
+			case GL_FLOAT_VEC2: glGetUniformfv(from, source, f); glUniform2fv(target, 1, f); break;
+			case GL_FLOAT_VEC3: glGetUniformfv(from, source, f); glUniform3fv(target, 1, f); break;
+			case GL_FLOAT_VEC4: glGetUniformfv(from, source, f); glUniform4fv(target, 1, f); break;
+			case GL_FLOAT_MAT2: glGetUniformfv(from, source, f); glUniformMatrix2fv(target, 1, GL_FALSE, f); break;
+			case GL_FLOAT_MAT3: glGetUniformfv(from, source, f); glUniformMatrix3fv(target, 1, GL_FALSE, f); break;
+			case GL_FLOAT_MAT4: glGetUniformfv(from, source, f); glUniformMatrix4fv(target, 1, GL_FALSE, f); break;
+			case GL_INT_VEC2: case GL_BOOL_VEC2: glGetUniformiv(from, source, n); glUniform2iv(target, 1, n); break;
+			case GL_INT_VEC3: case GL_BOOL_VEC3: glGetUniformiv(from, source, n); glUniform3iv(target, 1, n); break;
+			case GL_INT_VEC4: case GL_BOOL_VEC4: glGetUniformiv(from, source, n); glUniform4iv(target, 1, n); break;
+			case GL_UNSIGNED_INT: glGetUniformuiv(from, source, u); glUniform1uiv(target, 1, u); break;
+			case GL_UNSIGNED_INT_VEC2: glGetUniformuiv(from, source, u); glUniform2uiv(target, 1, u); break;
+			case GL_UNSIGNED_INT_VEC3: glGetUniformuiv(from, source, u); glUniform3uiv(target, 1, u); break;
+			case GL_UNSIGNED_INT_VEC4: glGetUniformuiv(from, source, u); glUniform4uiv(target, 1, u); break;
+			default: // int, bool and the samplers
+				glGetUniformiv(from, source, n);
+				glUniform1iv(target, 1, n);
+				break;
+			}
+		}
+	}
+	glUseProgram(previous);
 }
 void Shader::use()
 {
 	glUseProgram(ID);
 }
 
-void Shader::setBool(const std::string& name, bool value) const
+void Shader::setBool(UniformName name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	glUniform1i(uniforms.find(name), (int)value);
 }
-void Shader::setInt(const std::string& name, int value) const
+void Shader::setInt(UniformName name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1i(uniforms.find(name), value);
 }
-void Shader::setFloat(const std::string& name, float value) const
+void Shader::setFloat(UniformName name, float value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1f(uniforms.find(name), value);
 }
-void Shader::setColor(const std::string& name, float r, float g, float b) const
+void Shader::setColor(UniformName name, float r, float g, float b) const
 {
-	glUniform4f(glGetUniformLocation(ID, name.c_str()), r, g, b, 1.0f);
+	glUniform4f(uniforms.find(name), r, g, b, 1.0f);
 }
\ No newline at end of file
@@ -4,67 +4,98 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "GpuResources.h"
+#include "UniformTable.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
 public:
+	// name of the program the private handle owns, for code calling gl* directly
 	unsigned int ID;
 
 	Shader(const char* vertexPath, const char* fragmentPath);
+	// every define is injected as "#define <define>" after the #version line
+	Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines);
+
+	// source with the #include "file" lines expanded and the defines injected,
+	// files gets the paths of the file and everything it includes
+	static std::string loadSource(const std::string& path, const std::vector<std::string>& defines,
+		std::vector<std::string>* files = nullptr);
+
+	// recompiles from the same files and swaps ID, the uniform values of the old
+	// program carry over. On failure the old program is kept.
+	bool reload();
+	bool usesSource(const std::string& path) const;
+	const std::vector<std::string>& getSources() const { return sources; }
 
 	void use();
 
-	void setBool(const std::string& name, bool value) const;
-	void setInt(const std::string& name, int value) const;
-	void setFloat(const std::string& name, float value) const;
-	void setColor(const std::string& name, float r, float g, float b) const;
+	// location from the table built at link time, no driver call
+	int location(UniformName name) const { return uniforms.find(name); }
+
+	void setBool(UniformName name, bool value) const;
+	void setInt(UniformName name, int value) const;
+	void setFloat(UniformName name, float value) const;
+	void setColor(UniformName name, float r, float g, float b) const;
     
     // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+    void setVec2(UniformName name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(uniforms.find(name), 1, &value[0]);
     }
-    void setVec2(const std::string& name, float x, float y) const
+    void setVec2(UniformName name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(uniforms.find(name), x, y);
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
+    void setVec3(UniformName name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(uniforms.find(name), 1, &value[0]);
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+    void setVec3(UniformName name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(uniforms.find(name), x, y, z);
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
+    void setVec4(UniformName name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(uniforms.find(name), 1, &value[0]);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w)
+    void setVec4(UniformName name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(uniforms.find(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
+    void setMat2(UniformName name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(uniforms.find(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
+    void setMat3(UniformName name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(uniforms.find(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    void setMat4(UniformName name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(uniforms.find(name), 1, GL_FALSE, &mat[0][0]);
     }
+
+private:
+	bool build(unsigned int& program);
+	static void copyUniforms(unsigned int from, unsigned int to);
+
+	std::string vertexPath, fragmentPath;
+	std::vector<std::string> defines;
+	std::vector<std::string> sources;
+	ProgramHandle program;
+	UniformTable uniforms;
 };
 
 #endif
@@ -0,0 +1,83 @@
+#include "ShaderVariants.h"
+#include "Log.h"
+
+#include <iostream>
+
+ShaderVariants::ShaderVariants(const char* vertexPath, const char* fragmentPath)
+	: vertexPath(vertexPath), fragmentPath(fragmentPath)
+{
+	readKeywords(vertexPath);
+	readKeywords(fragmentPath);
+}
+
+void ShaderVariants::readKeywords(const char* path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		LOG_ERROR("ERROR::SHADER_VARIANTS::FILE_NOT_SUCCESFULLY_READ " << path);
+		return;
+	}
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream words(line);
+		std::string directive, pragma, name;
+		if (!(words >> directive >> pragma) || directive != "#pragma" || pragma != "keywords")
+			continue;
+		while (words >> name)
+		{
+			if (keyword(name))
+				continue; // shared by both stages
+			if (keywords.size() == MaxKeywords)
+			{
+				LOG_ERROR("ERROR::SHADER_VARIANTS::TOO_MANY_KEYWORDS " << path);
+				return;
+			}
+			keywords.push_back(name);
+		}
+	}
+}
+
+unsigned int ShaderVariants::keyword(const std::string& name) const
+{
+	for (size_t i = 0; i < keywords.size(); i++)
+		if (keywords[i] == name)
+			return 1u << i;
+	return 0;
+}
+
+unsigned int ShaderVariants::mask(std::initializer_list<const char*> names) const
+{
+	unsigned int result = 0;
+	for (const char* name : names)
+	{
+		unsigned int bit = keyword(name);
+		if (!bit)
+			LOG_ERROR("ERROR::SHADER_VARIANTS::UNKNOWN_KEYWORD " << name << " in " << vertexPath << " / " << fragmentPath);
+		result |= bit;
+	}
+	return result;
+}
+
+Shader& ShaderVariants::get(unsigned int mask)
+{
+	std::unique_ptr<Shader>& variant = variants[mask];
+	if (!variant)
+	{
+		std::vector<std::string> defines;
+		for (size_t i = 0; i < keywords.size(); i++)
+			if (mask & (1u << i))
+				defines.push_back(keywords[i]);
+		variant.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines));
+	}
+	return *variant;
+}
+
+std::vector<Shader*> ShaderVariants::compiled() const
+{
+	std::vector<Shader*> result;
+	for (const auto& variant : variants)
+		result.push_back(variant.second.get());
+	return result;
+}
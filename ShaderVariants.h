@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Shader.h"
+
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Permutations of one vertex + fragment shader pair. The sources declare their
+// feature keywords with "#pragma keywords A B C", every keyword gets one bit of
+// the variant mask in declaration order, vertex shader first. A variant is
+// compiled with a #define per set bit the first time it is requested.
+class ShaderVariants
+{
+public:
+	static const unsigned int MaxKeywords = 32;
+
+	ShaderVariants(const char* vertexPath, const char* fragmentPath);
+
+	// 0 and an error for a keyword neither shader declares
+	unsigned int keyword(const std::string& name) const;
+	unsigned int mask(std::initializer_list<const char*> names) const;
+
+	Shader& get(unsigned int mask);
+
+	const std::vector<std::string>& getKeywords() const { return keywords; }
+	size_t compiledCount() const { return variants.size(); }
+	std::vector<Shader*> compiled() const;
+
+private:
+	void readKeywords(const char* path);
+
+	std::string vertexPath, fragmentPath;
+	std::vector<std::string> keywords;
+	std::map<unsigned int, std::unique_ptr<Shader>> variants;
+};
@@ -0,0 +1,212 @@
+#include "ShaderWatcher.h"
+#include "Instrument.h"
+#include "Log.h"
+
+#include <iostream>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// editors save in several writes, the batch is reloaded once it has been quiet this long
+	const std::chrono::milliseconds settleTime(20);
+
+	double millisecondsBetween(ShaderWatcher::Clock::time_point from, ShaderWatcher::Clock::time_point to)
+	{
+		return std::chrono::duration<double, std::milli>(to - from).count();
+	}
+}
+
+ShaderWatcher::ShaderWatcher() : watchedPrograms(0), quit(false)
+{
+#ifdef __linux__
+	inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify < 0 || pipe(quitPipe) != 0)
+	{
+		LOG_ERROR("ERROR::SHADER_WATCHER::INOTIFY_FAILED");
+		return;
+	}
+#endif
+	watcher = std::thread(&ShaderWatcher::watcherLoop, this);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+	if (!watcher.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+#ifdef __linux__
+	char wake = 0;
+	if (write(quitPipe[1], &wake, 1) != 1)
+		LOG_ERROR("ERROR::SHADER_WATCHER::WAKE_FAILED");
+#endif
+	watcher.join();
+#ifdef __linux__
+	close(inotify);
+	close(quitPipe[0]);
+	close(quitPipe[1]);
+#endif
+}
+
+void ShaderWatcher::add(Shader& shader)
+{
+	shaders.push_back(&shader);
+	watchSources();
+}
+
+void ShaderWatcher::add(ShaderVariants& variants)
+{
+	variantSets.push_back(&variants);
+	watchSources();
+}
+
+void ShaderWatcher::watchSources()
+{
+	size_t programs = shaders.size();
+	for (ShaderVariants* variants : variantSets)
+		programs += variants->compiledCount();
+	if (programs == watchedPrograms)
+		return;
+	watchedPrograms = programs;
+
+	for (Shader* shader : shaders)
+		for (const std::string& path : shader->getSources())
+			watch(path);
+	for (ShaderVariants* variants : variantSets)
+		for (Shader* shader : variants->compiled())
+			for (const std::string& path : shader->getSources())
+				watch(path);
+}
+
+void ShaderWatcher::watch(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!watchedFiles.insert(path).second)
+		return;
+#ifdef __linux__
+	// the directory and not the file, saving through a rename replaces the inode
+	size_t slash = path.find_last_of('/');
+	std::string prefix = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	int descriptor = inotify_add_watch(inotify, prefix.empty() ? "." : prefix.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (descriptor < 0)
+		LOG_ERROR("ERROR::SHADER_WATCHER::CANNOT_WATCH " << path);
+	else
+		directories[descriptor] = prefix;
+#else
+	struct stat info;
+	modificationTimes[path] = stat(path.c_str(), &info) == 0 ? (long long)info.st_mtime : 0;
+#endif
+}
+
+void ShaderWatcher::fileChanged(const std::string& path)
+{
+	// with the mutex held
+	if (!watchedFiles.count(path))
+		return;
+	Clock::time_point now = Clock::now();
+	if (changedFiles.empty())
+		firstChange = now;
+	lastChange = now;
+	changedFiles.insert(path);
+}
+
+void ShaderWatcher::watcherLoop()
+{
+	INSTRUMENT_THREAD("shader watcher");
+#ifdef __linux__
+	alignas(inotify_event) char buffer[4096];
+	pollfd descriptors[2] = { { inotify, POLLIN, 0 }, { quitPipe[0], POLLIN, 0 } };
+	for (;;)
+	{
+		if (poll(descriptors, 2, -1) < 0)
+			continue;
+		std::lock_guard<std::mutex> lock(mutex);
+		if (quit)
+			return;
+		ssize_t length;
+		while ((length = read(inotify, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+			{
+				const inotify_event* event = (const inotify_event*)p;
+				std::map<int, std::string>::const_iterator directory = directories.find(event->wd);
+				if (event->len && directory != directories.end())
+					fileChanged(directory->second + event->name);
+			}
+		}
+	}
+#else
+	for (;;)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		std::lock_guard<std::mutex> lock(mutex);
+		if (quit)
+			return;
+		for (auto& file : modificationTimes)
+		{
+			struct stat info;
+			if (stat(file.first.c_str(), &info) != 0 || (long long)info.st_mtime == file.second)
+				continue;
+			file.second = (long long)info.st_mtime;
+			fileChanged(file.first);
+		}
+	}
+#endif
+}
+
+void ShaderWatcher::update()
+{
+	watchSources();
+
+	std::set<std::string> changed;
+	Clock::time_point changeTime;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (changedFiles.empty() || Clock::now() - lastChange < settleTime)
+			return;
+		changed.swap(changedFiles);
+		changeTime = firstChange;
+	}
+
+	std::vector<Shader*> affected;
+	for (Shader* shader : shaders)
+		affected.push_back(shader);
+	for (ShaderVariants* variants : variantSets)
+		for (Shader* shader : variants->compiled())
+			affected.push_back(shader);
+
+	INSTRUMENT_SCOPE("shader reload");
+	Clock::time_point start = Clock::now();
+	unsigned int reloaded = 0, failed = 0;
+	for (Shader* shader : affected)
+	{
+		bool uses = false;
+		for (const std::string& path : changed)
+			uses = uses || shader->usesSource(path);
+		if (!uses)
+			continue;
+		if (shader->reload())
+			reloaded++;
+		else
+			failed++;
+	}
+	// new includes are only known after the recompile
+	watchedPrograms = 0;
+	watchSources();
+	Clock::time_point end = Clock::now();
+
+	for (const std::string& path : changed)
+		LOG_INFO("shader reload: " << path);
+	LOG_INFO("shader reload: " << reloaded << " programs in " << millisecondsBetween(start, end) << " ms, "
+		<< millisecondsBetween(changeTime, end) << " ms after the change"
+		<< (failed ? ", " + std::to_string(failed) + " failed and kept the old program" : ""));
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Shader.h"
+#include "ShaderVariants.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Hot reload of shader sources. A background thread waits for changes with
+// inotify on the directories of the watched files (polls modification times
+// elsewhere), update() recompiles the affected programs between frames. A
+// program that fails to compile or link keeps running the old version.
+class ShaderWatcher
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	ShaderWatcher();
+	~ShaderWatcher();
+
+	void add(Shader& shader);
+	// variants compiled later are picked up by update()
+	void add(ShaderVariants& variants);
+
+	// call at the frame boundary with no program in use that the frame still needs
+	void update();
+
+private:
+	void watch(const std::string& path);
+	void watchSources();
+	void watcherLoop();
+	void fileChanged(const std::string& path);
+
+	std::vector<Shader*> shaders;
+	std::vector<ShaderVariants*> variantSets;
+	size_t watchedPrograms;
+
+	std::mutex mutex;
+	std::set<std::string> watchedFiles;
+	std::set<std::string> changedFiles;
+	Clock::time_point firstChange, lastChange;
+
+	std::thread watcher;
+	bool quit;
+#ifdef __linux__
+	int inotify;
+	int quitPipe[2];
+	std::map<int, std::string> directories; // watch descriptor -> prefix of the paths in it
+#else
+	std::map<std::string, long long> modificationTimes;
+#endif
+};
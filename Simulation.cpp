@@ -0,0 +1,124 @@
+#include "Simulation.h"
+#include "Instrument.h"
+
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+Simulation::Simulation(double step, unsigned int lightCount, bool threaded, unsigned int maxSteps)
+	: step(step), maxSteps(maxSteps), threaded(threaded), started(false), accumulator(0.0), lastTime(0.0),
+	stepCount(0), droppedCount(0), stepSeconds(0.0), pendingTarget(0.0), pending(false), quit(false)
+{
+	// the state at time 0, as if a step had just ended there
+	current.time = -step;
+	current.spin = -(float)step;
+	current.lights.resize(lightCount);
+	simulate(current, current);
+	previous = current;
+	blended = current;
+	frameStats = SimulationStats{ 0, 0, 0.0f, 0.0, threaded };
+	if (threaded)
+		worker = std::thread(&Simulation::threadLoop, this);
+}
+
+Simulation::~Simulation()
+{
+	if (!worker.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void Simulation::simulate(const SimulationState& from, SimulationState& to) const
+{
+	to.time = from.time + step;
+	to.spin = from.spin + (float)step;
+	for (size_t i = 0; i < to.lights.size(); i++)
+	{
+		float phase = (float)(to.time * 0.5) + i;
+		to.lights[i] = glm::vec3(sin(phase) * 2.0f, sin(phase * 1.3f), cos(phase) * 2.0f);
+	}
+}
+
+void Simulation::runSteps(double target)
+{
+	INSTRUMENT_SCOPE("simulation");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	accumulator += target - lastTime;
+	lastTime = target;
+	stepCount = 0;
+	while (accumulator >= step)
+	{
+		if (stepCount == maxSteps)
+		{
+			// falling behind for good otherwise, every frame taking longer to catch up
+			droppedCount += (unsigned int)(accumulator / step);
+			accumulator = fmod(accumulator, step);
+			break;
+		}
+		std::swap(previous, current);
+		simulate(previous, current);
+		accumulator -= step;
+		stepCount++;
+	}
+	stepSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Simulation::blend(const SimulationState& from, const SimulationState& to, float alpha)
+{
+	blended.time = from.time + (to.time - from.time) * alpha;
+	blended.spin = from.spin + (to.spin - from.spin) * alpha;
+	for (size_t i = 0; i < blended.lights.size(); i++)
+		blended.lights[i] = glm::mix(from.lights[i], to.lights[i], alpha);
+	frameStats.alpha = alpha;
+	frameStats.steps = stepCount;
+	frameStats.dropped = droppedCount;
+	frameStats.stepMicroseconds = stepCount ? stepSeconds / stepCount * 1e6 : 0.0;
+}
+
+void Simulation::advance(double now)
+{
+	if (!started)
+	{
+		started = true;
+		lastTime = now;
+		return;
+	}
+	if (!threaded)
+	{
+		runSteps(now);
+		blend(previous, current, (float)(accumulator / step));
+		return;
+	}
+	{
+		// the thread is idle once the last target is done, its states can be read
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return !pending; });
+		blend(previous, current, (float)(accumulator / step));
+		pendingTarget = now;
+		pending = true;
+	}
+	wake.notify_one();
+}
+
+void Simulation::threadLoop()
+{
+	INSTRUMENT_THREAD("simulation");
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		wake.wait(lock, [this] { return quit || pending; });
+		if (quit)
+			return;
+		double target = pendingTarget;
+		lock.unlock();
+		runSteps(target);
+		lock.lock();
+		pending = false;
+		done.notify_one();
+	}
+}
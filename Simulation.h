@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// everything that moves in the scene, at one point of simulated time
+struct SimulationState
+{
+	double time;                    // simulated seconds
+	float spin;                     // radians, the cubes turn at multiples of it
+	std::vector<glm::vec3> lights;  // offsets of the point lights from where they were placed
+};
+
+struct SimulationStats
+{
+	unsigned int steps;      // taken for the last frame
+	unsigned int dropped;    // steps skipped since the start, frames that were too slow
+	float alpha;             // between the two states the last frame was drawn at
+	double stepMicroseconds; // mean of a step over the last frame's steps
+	bool threaded;
+};
+
+// Fixed step simulation decoupled from the frame rate. The frame loop samples
+// the clock once and calls advance(): the steps that fit in the elapsed time
+// run, leftover time stays in an accumulator, and state() is the last two
+// states blended by accumulator / step. What is drawn is then always one step
+// behind the clock but moves smoothly at any frame rate, and the cost of the
+// simulation depends only on the step.
+//
+// Threaded, the steps run on a thread of their own while the frame that asked
+// for them renders: advance() waits for the steps of the previous frame's
+// time, publishes them and hands the new time over. The drawn state is one
+// frame later than inline in exchange for the overlap.
+class Simulation
+{
+public:
+	// at most maxSteps per frame, a slower frame drops the rest of the time
+	Simulation(double step, unsigned int lightCount, bool threaded, unsigned int maxSteps = 8);
+	~Simulation();
+
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	// now is the frame's single time sample, in seconds
+	void advance(double now);
+	const SimulationState& state() const { return blended; }
+	const SimulationStats& stats() const { return frameStats; }
+	double getStep() const { return step; }
+
+private:
+	// the steps up to target, from the thread or advance()
+	void runSteps(double target);
+	// one step on from the state before, from and to may be the same
+	void simulate(const SimulationState& from, SimulationState& to) const;
+	void blend(const SimulationState& from, const SimulationState& to, float alpha);
+	void threadLoop();
+
+	double step;
+	unsigned int maxSteps;
+	bool threaded;
+	bool started;
+	double accumulator, lastTime;
+
+	// owned by whoever runs the steps
+	SimulationState previous, current;
+	unsigned int stepCount, droppedCount;
+	double stepSeconds;
+
+	SimulationState blended;
+	SimulationStats frameStats;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	double pendingTarget;
+	bool pending, quit;
+};
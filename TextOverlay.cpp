@@ -0,0 +1,234 @@
+#include "TextOverlay.h"
+
+#include "Log.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+namespace
+{
+	const int GlyphWidth = 5, GlyphHeight = 7;
+	// a cell is one pixel wider and taller than the glyph for the spacing
+	const int CellWidth = GlyphWidth + 1, CellHeight = GlyphHeight + 1;
+	const int FirstGlyph = ' ', GlyphCount = '_' - ' ' + 1;
+	// the cell after the font is filled, the panel samples it
+	const int SolidGlyph = GlyphCount;
+	const int FloatsPerVertex = 8;
+
+	// rows from the top, bit 4 is the leftmost column
+	const unsigned char font[GlyphCount][GlyphHeight] =
+	{
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+		{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+		{ 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+		{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a }, // #
+		{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 }, // $
+		{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+		{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d }, // &
+		{ 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '
+		{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+		{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+		{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 }, // *
+		{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 }, // +
+		{ 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 }, // ,
+		{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 }, // -
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c }, // .
+		{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+		{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e }, // 0
+		{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e }, // 1
+		{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f }, // 2
+		{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e }, // 3
+		{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 }, // 4
+		{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e }, // 5
+		{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e }, // 6
+		{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+		{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e }, // 8
+		{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c }, // 9
+		{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 }, // :
+		{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 }, // ;
+		{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+		{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 }, // =
+		{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+		{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+		{ 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e }, // @
+		{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // A
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e }, // B
+		{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e }, // C
+		{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c }, // D
+		{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f }, // E
+		{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 }, // F
+		{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f }, // G
+		{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // H
+		{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, // I
+		{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c }, // J
+		{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f }, // L
+		{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+		{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+		{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // O
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 }, // P
+		{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d }, // Q
+		{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 }, // R
+		{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e }, // S
+		{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // U
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 }, // V
+		{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a }, // W
+		{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 }, // X
+		{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 }, // Y
+		{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f }, // Z
+		{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e }, // [
+		{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // backslash
+		{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e }, // ]
+		{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 }, // ^
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f }, // _
+	};
+
+	int glyphIndex(char c)
+	{
+		if (c >= 'a' && c <= 'z')
+			c = c - 'a' + 'A';
+		if (c < FirstGlyph || c >= FirstGlyph + GlyphCount)
+			c = '?';
+		return c - FirstGlyph;
+	}
+}
+
+TextOverlay::TextOverlay(int scale)
+	: scale(scale), glyphs(128, 64, 0, 1), glyphImages(GlyphCount + 1, -1)
+{
+	clear();
+}
+
+int TextOverlay::glyphImage(int glyph)
+{
+	if (glyphImages[glyph] >= 0)
+		return glyphImages[glyph];
+	// the whole cell, the spacing included
+	unsigned char pixels[CellHeight][CellWidth] = {};
+	for (int y = 0; y < CellHeight; y++)
+		for (int x = 0; x < CellWidth; x++)
+		{
+			bool set = glyph == SolidGlyph || (x < GlyphWidth && y < GlyphHeight && (font[glyph][y] & (0x10 >> x)));
+			pixels[y][x] = set ? 255 : 0;
+		}
+	glyphImages[glyph] = glyphs.add(&pixels[0][0], CellWidth, CellHeight);
+	if (glyphImages[glyph] < 0)
+	{
+		// the atlas has room for every glyph, this is a bug
+		LOG_ERROR("ERROR::OVERLAY::GLYPH_ATLAS_FULL");
+		glyphImages[glyph] = 0;
+	}
+	return glyphImages[glyph];
+}
+
+void TextOverlay::create()
+{
+	if (vao)
+		return;
+	shader.reset(new Shader("overlay.vert", "overlay.frag"));
+	shader->use();
+	shader->setInt("glyphs", 0);
+	glyphs.create(GL_NEAREST);
+
+	vao = VertexArrayHandle::create();
+	vbo = BufferHandle::create();
+	glBindVertexArray(vao.get());
+	glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, FloatsPerVertex * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, FloatsPerVertex * sizeof(float), (void*)(2 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, FloatsPerVertex * sizeof(float), (void*)(4 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TextOverlay::release()
+{
+	if (!vao)
+		return;
+	vao.reset();
+	vbo.reset();
+	glyphs.release();
+	shader.reset();
+}
+
+void TextOverlay::clear()
+{
+	lineCount = longestLine = 0;
+	// room for the panel, filled in by draw once the size is known
+	vertices.assign(6 * FloatsPerVertex, 0.0f);
+}
+
+void TextOverlay::print(const char* line, const glm::vec4& color)
+{
+	const float margin = 4.0f * scale;
+	float y = margin + lineCount * CellHeight * scale;
+	int length = 0;
+	for (; line[length]; length++)
+	{
+		if (line[length] == ' ')
+			continue;
+		int glyph = glyphIndex(line[length]);
+		vertices.resize(vertices.size() + 6 * FloatsPerVertex);
+		writeQuad(&vertices[vertices.size() - 6 * FloatsPerVertex], margin + length * CellWidth * scale, y,
+			(float)CellWidth * scale, (float)CellHeight * scale, glyph, color);
+	}
+	lineCount++;
+	longestLine = std::max(longestLine, length);
+}
+
+void TextOverlay::writeQuad(float* out, float x, float y, float width, float height, int glyph, const glm::vec4& color)
+{
+	const AtlasEntry& cell = glyphs.entry(glyphImage(glyph));
+	float u0 = cell.offset.x, u1 = cell.offset.x + cell.scale.x;
+	float v0 = cell.offset.y, v1 = cell.offset.y + cell.scale.y;
+	const float corners[6][4] =
+	{
+		{ x, y, u0, v0 }, { x, y + height, u0, v1 }, { x + width, y + height, u1, v1 },
+		{ x, y, u0, v0 }, { x + width, y + height, u1, v1 }, { x + width, y, u1, v0 },
+	};
+	for (int v = 0; v < 6; v++, out += FloatsPerVertex)
+	{
+		std::copy(corners[v], corners[v] + 4, out);
+		std::copy(&color[0], &color[0] + 4, out + 4);
+	}
+}
+
+void TextOverlay::draw(int screenWidth, int screenHeight)
+{
+	if (!vao || !lineCount)
+		return;
+
+	// the panel goes first, the text is blended over it
+	const float padding = 2.0f * scale;
+	writeQuad(vertices.data(), padding, padding, (longestLine * CellWidth + 2) * scale + 2.0f * padding,
+		(lineCount * CellHeight + 2) * scale + 2.0f * padding, SolidGlyph, glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	shader->use();
+	shader->setVec2("screenSize", glm::vec2((float)screenWidth, (float)screenHeight));
+	// glyphs printed for the first time this frame
+	glyphs.upload();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, glyphs.texture());
+	glBindVertexArray(vao.get());
+	glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STREAM_DRAW);
+	vbo.setBytes(vertices.size() * sizeof(float));
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(vertices.size() / FloatsPerVertex));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (depthTest)
+		glEnable(GL_DEPTH_TEST);
+	if (!blend)
+		glDisable(GL_BLEND);
+}
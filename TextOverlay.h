@@ -0,0 +1,48 @@
+#pragma once
+
+#include "GpuResources.h"
+#include "Shader.h"
+#include "TextureAtlas.h"
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+// Lines of text in the top left corner over a translucent panel, built from a
+// 5x7 bitmap font. Every line of a frame goes into one vertex buffer and is
+// drawn with a single draw call. Lower case prints as upper case. Glyphs go
+// into a single channel texture atlas the first time they are printed.
+class TextOverlay
+{
+public:
+	// scale in screen pixels per font pixel
+	explicit TextOverlay(int scale = 2);
+
+	// GL side, needs a context
+	void create();
+	void release();
+
+	void clear();
+	void print(const char* line, const glm::vec4& color = glm::vec4(1.0f));
+	void draw(int screenWidth, int screenHeight);
+
+	AtlasStats atlasStats() const { return glyphs.stats(); }
+
+private:
+	int glyphImage(int glyph);
+	// six vertices at out
+	void writeQuad(float* out, float x, float y, float width, float height, int glyph, const glm::vec4& color);
+
+	int scale;
+	int lineCount, longestLine;
+	// x, y, u, v, r, g, b, a, the first quad is the panel
+	std::vector<float> vertices;
+
+	TextureAtlas glyphs;
+	std::vector<int> glyphImages;  // atlas image of every glyph, -1 until printed
+
+	std::unique_ptr<Shader> shader;
+	VertexArrayHandle vao;
+	BufferHandle vbo;
+};
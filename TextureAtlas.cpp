@@ -0,0 +1,153 @@
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	GLenum internalFormat(int channels) { return channels == 1 ? GL_R8 : GL_RGBA8; }
+	GLenum pixelFormat(int channels) { return channels == 1 ? GL_RED : GL_RGBA; }
+}
+
+TextureAtlas::TextureAtlas(int width, int height, int maxMipLevel, int channels)
+	: packer(width >> maxMipLevel, height >> maxMipLevel), border(1 << maxMipLevel), maxMipLevel(maxMipLevel), channels(channels),
+	pixels((size_t)(width >> maxMipLevel << maxMipLevel) * (height >> maxMipLevel << maxMipLevel) * channels, 0), imageArea(0), packSeconds(0.0), uploads(0),
+	dirtyMinX(0), dirtyMinY(0), dirtyMaxX(0), dirtyMaxY(0)
+{
+}
+
+int TextureAtlas::add(const unsigned char* image, int width, int height)
+{
+	Clock::time_point start = Clock::now();
+	AtlasRect cells;
+	if (!packer.pack((width + 2 * border + border - 1) / border, (height + 2 * border + border - 1) / border, cells))
+		return -1;
+
+	const int atlasWidth = getWidth(), atlasHeight = getHeight();
+	const int x = cells.x * border + border, y = cells.y * border + border;
+	for (int row = 0; row < height; row++)
+		std::memcpy(&pixels[((size_t)(y + row) * atlasWidth + x) * channels], image + (size_t)row * width * channels, (size_t)width * channels);
+	extrude(x, y, width, height);
+
+	AtlasEntry placed = { glm::vec2((float)x / atlasWidth, (float)y / atlasHeight),
+		glm::vec2((float)width / atlasWidth, (float)height / atlasHeight) };
+	entries.push_back(placed);
+	imageArea += (long long)width * height;
+
+	if (dirtyMinX >= dirtyMaxX)
+	{
+		dirtyMinX = dirtyMinY = std::max(atlasWidth, atlasHeight);
+		dirtyMaxX = dirtyMaxY = 0;
+	}
+	dirtyMinX = std::min(dirtyMinX, x - border);
+	dirtyMinY = std::min(dirtyMinY, y - border);
+	dirtyMaxX = std::max(dirtyMaxX, x + width + border);
+	dirtyMaxY = std::max(dirtyMaxY, y + height + border);
+	packSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+	return (int)entries.size() - 1;
+}
+
+void TextureAtlas::extrude(int x, int y, int width, int height)
+{
+	const int atlasWidth = getWidth();
+	for (int row = y - border; row < y + height + border; row++)
+	{
+		int sourceRow = std::min(std::max(row, y), y + height - 1);
+		for (int column = x - border; column < x + width + border; column++)
+		{
+			if (row == sourceRow && column >= x && column < x + width)
+			{
+				// the image itself, skip to its right border
+				column = x + width - 1;
+				continue;
+			}
+			int sourceColumn = std::min(std::max(column, x), x + width - 1);
+			std::memcpy(&pixels[((size_t)row * atlasWidth + column) * channels], &pixels[((size_t)sourceRow * atlasWidth + sourceColumn) * channels], channels);
+		}
+	}
+}
+
+void TextureAtlas::remapUVs(float* vertices, unsigned int vertexCount, unsigned int stride, unsigned int uvOffset, int image) const
+{
+	const AtlasEntry& placed = entries[image];
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		float* uv = vertices + v * stride + uvOffset;
+		uv[0] = placed.offset.x + uv[0] * placed.scale.x;
+		uv[1] = placed.offset.y + uv[1] * placed.scale.y;
+	}
+}
+
+void TextureAtlas::remapUVs(Mesh& mesh, int image) const
+{
+	// position, texture coords, normal
+	remapUVs(mesh.vertices.data(), mesh.vertexCount(), Mesh::vertexSize, 3, image);
+}
+
+void TextureAtlas::create(GLenum magFilter)
+{
+	if (handle.get())
+		return;
+	handle = TextureHandle::create();
+	glBindTexture(GL_TEXTURE_2D, handle.get());
+	// R8 rows are not a multiple of 4 bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat(channels), getWidth(), getHeight(), 0, pixelFormat(channels), GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	GLenum minFilter = magFilter;
+	if (maxMipLevel > 0)
+	{
+		minFilter = magFilter == GL_NEAREST ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR;
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	// past maxMipLevel the images would bleed into each other
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxMipLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	handle.setBytes(pixels.size() * (maxMipLevel > 0 ? 4 : 3) / 3);
+	dirtyMinX = dirtyMaxX = 0;
+	uploads++;
+}
+
+void TextureAtlas::release()
+{
+	handle.reset();
+}
+
+void TextureAtlas::upload()
+{
+	if (!handle.get() || dirtyMinX >= dirtyMaxX)
+		return;
+	glBindTexture(GL_TEXTURE_2D, handle.get());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, getWidth());
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, dirtyMinX);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, dirtyMinY);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, dirtyMinX, dirtyMinY, dirtyMaxX - dirtyMinX, dirtyMaxY - dirtyMinY, pixelFormat(channels), GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if (maxMipLevel > 0)
+		glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	dirtyMinX = dirtyMaxX = 0;
+	uploads++;
+}
+
+AtlasStats TextureAtlas::stats() const
+{
+	AtlasStats result;
+	result.images = (unsigned int)entries.size();
+	result.occupancy = (float)((double)imageArea / ((double)getWidth() * getHeight()));
+	result.packed = packer.occupancy();
+	result.packMicroseconds = entries.empty() ? 0.0 : packSeconds / entries.size() * 1e6;
+	result.uploads = uploads;
+	return result;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "AtlasPacker.h"
+#include "GpuResources.h"
+#include "Mesh.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// where an image landed, uv' = offset + uv * scale
+struct AtlasEntry
+{
+	glm::vec2 offset, scale;
+};
+
+struct AtlasStats
+{
+	unsigned int images;
+	float occupancy;              // image texels over atlas texels, borders not counted
+	float packed;                 // the same with the borders and the alignment
+	double packMicroseconds;      // mean of add(), packing and copying
+	unsigned int uploads;         // upload() calls that had something to send
+};
+
+// Small RGBA8 or single channel R8 images packed into one texture, so everything drawn with them
+// needs a single bind. Every image gets a border of its edge texels repeated
+// and starts on a multiple of the border width: up to maxMipLevel the mipmaps
+// never average texels of two images and bilinear filtering at the edges
+// clamps like a texture of its own. Texture coordinates must stay in [0, 1],
+// repeat wrapping does not survive atlasing.
+class TextureAtlas
+{
+public:
+	// the border is 1 << maxMipLevel texels, channels 4 for RGBA8 or 1 for R8
+	TextureAtlas(int width, int height, int maxMipLevel = 0, int channels = 4);
+
+	TextureAtlas(const TextureAtlas&) = delete;
+	TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+	// copies the image in, channels bytes a texel, returns its id or -1 when the atlas is full. Works
+	// without a context and at any time, upload() sends the new texels.
+	int add(const unsigned char* pixels, int width, int height);
+	const AtlasEntry& entry(int image) const { return entries[image]; }
+
+	// moves texture coordinates in [0, 1] into the image's rectangle
+	void remapUVs(float* vertices, unsigned int vertexCount, unsigned int stride, unsigned int uvOffset, int image) const;
+	void remapUVs(Mesh& mesh, int image) const;
+
+	// GL side. magFilter GL_NEAREST keeps texels sharp, mipmapping follows maxMipLevel.
+	void create(GLenum magFilter = GL_LINEAR);
+	void release();
+	// the rectangle changed since the last upload, then the mipmaps
+	void upload();
+	unsigned int texture() const { return handle.get(); }
+
+	int getWidth() const { return packer.getWidth() * border; }
+	int getHeight() const { return packer.getHeight() * border; }
+	AtlasStats stats() const;
+
+private:
+	void extrude(int x, int y, int width, int height);
+
+	// in cells of border x border texels, that keeps every image aligned
+	AtlasPacker packer;
+	int border, maxMipLevel, channels;
+	std::vector<unsigned char> pixels;
+	std::vector<AtlasEntry> entries;
+	long long imageArea;
+	double packSeconds;
+	unsigned int uploads;
+	// texels touched since the last upload, empty when minX >= maxX
+	int dirtyMinX, dirtyMinY, dirtyMaxX, dirtyMaxY;
+	TextureHandle handle;
+};
@@ -0,0 +1,86 @@
+#include "UniformTable.h"
+
+#include <glad/glad.h>
+
+void UniformTable::build(unsigned int program)
+{
+	clear();
+	int active;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &active);
+	for (int i = 0; i < active; i++)
+	{
+		char name[256];
+		int length, size;
+		GLenum type;
+		glGetActiveUniform(program, i, sizeof(name), &length, &size, &type, name);
+		int location = glGetUniformLocation(program, name);
+		if (location < 0) // uniform block member
+			continue;
+		insert(name, length, location);
+
+		if (length <= 3 || strcmp(name + length - 3, "[0]") != 0)
+			continue;
+		// element locations are not promised to be consecutive, so ask for each
+		std::string base(name, length - 3);
+		insert(base.c_str(), base.size(), location);
+		for (int element = 1; element < size; element++)
+		{
+			std::string elementName = base + "[" + std::to_string(element) + "]";
+			insert(elementName.c_str(), elementName.size(), glGetUniformLocation(program, elementName.c_str()));
+		}
+	}
+}
+
+void UniformTable::clear()
+{
+	slots.clear();
+	names.clear();
+	count = 0;
+}
+
+void UniformTable::insert(const char* name, size_t length, int location)
+{
+	if (length == 0)
+		return;
+	if ((count + 1) * 2 > slots.size())
+		grow();
+
+	uint32_t hash = UniformName::hashOf(name, length);
+	size_t mask = slots.size() - 1;
+	for (size_t k = hash & mask;; k = (k + 1) & mask)
+	{
+		Entry& entry = slots[k];
+		if (entry.length == 0)
+		{
+			entry.hash = hash;
+			entry.location = location;
+			entry.offset = (uint32_t)names.size();
+			entry.length = (uint32_t)length;
+			names.append(name, length);
+			count++;
+			return;
+		}
+		if (entry.hash == hash && entry.length == length && names.compare(entry.offset, length, name, length) == 0)
+		{
+			entry.location = location;
+			return;
+		}
+	}
+}
+
+void UniformTable::grow()
+{
+	std::vector<Entry> old;
+	old.swap(slots);
+	slots.assign(old.empty() ? 32 : old.size() * 2, Entry{ 0, -1, 0, 0 });
+	size_t mask = slots.size() - 1;
+	for (const Entry& entry : old)
+	{
+		if (entry.length == 0)
+			continue;
+		size_t k = entry.hash & mask;
+		while (slots[k].length != 0)
+			k = (k + 1) & mask;
+		slots[k] = entry;
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// A uniform name together with its FNV-1a hash. String literals convert
+// implicitly, so setMat4("model", m) builds no std::string. The constructor is
+// constexpr: a constexpr UniformName is hashed by the compiler, a literal
+// passed straight to a setter is hashed on the call, which is still cheap but
+// not free, so names set per draw are best declared once. Other text has to
+// say so with the explicit const char* constructor or come as a std::string.
+class UniformName
+{
+public:
+	template <size_t N>
+	constexpr UniformName(const char (&text)[N]) : text(text), length(lengthOf(text, N)), hash(hashOf(text, lengthOf(text, N))) {}
+	UniformName(const std::string& text) : text(text.c_str()), length(text.size()), hash(hashOf(text.c_str(), text.size())) {}
+	explicit UniformName(const char* text) : text(text), length(strlen(text)), hash(hashOf(text, length)) {}
+
+	static constexpr uint32_t hashOf(const char* text, size_t length)
+	{
+		uint32_t hash = 2166136261u;
+		for (size_t k = 0; k < length; k++)
+			hash = (hash ^ (unsigned char)text[k]) * 16777619u;
+		return hash;
+	}
+
+	// nul terminated, it is what glGetUniformLocation would get
+	const char* text;
+	size_t length;
+	uint32_t hash;
+
+private:
+	// a char buffer may hold a shorter string than its size
+	static constexpr size_t lengthOf(const char* text, size_t size)
+	{
+		size_t length = 0;
+		while (length + 1 < size && text[length])
+			length++;
+		return length;
+	}
+};
+
+// Name to location table of one linked program, filled once after linking so
+// setting a uniform is a hash probe instead of a glGetUniformLocation call.
+// Array elements are entered one by one ("lights[3].color", "bones[7]") and
+// the first element also under its bare name.
+class UniformTable
+{
+public:
+	UniformTable() : count(0) {}
+
+	void build(unsigned int program);
+	void clear();
+	void insert(const char* name, size_t length, int location);
+
+	// -1 for names the program does not use, which glUniform* ignores
+	int find(const UniformName& name) const
+	{
+		if (slots.empty())
+			return -1;
+		size_t mask = slots.size() - 1;
+		for (size_t k = name.hash & mask;; k = (k + 1) & mask)
+		{
+			const Entry& entry = slots[k];
+			if (entry.length == 0)
+				return -1;
+			if (entry.hash == name.hash && entry.length == name.length && memcmp(names.data() + entry.offset, name.text, name.length) == 0)
+				return entry.location;
+		}
+	}
+
+	size_t size() const { return count; }
+
+private:
+	struct Entry
+	{
+		uint32_t hash;
+		int location;
+		uint32_t offset, length;  // into names, length 0 marks a free slot
+	};
+
+	void grow();
+
+	std::vector<Entry> slots;  // open addressing, power of two, at most half full
+	std::string names;
+	size_t count;
+};
@@ -2,23 +2,24 @@
 
 #include <glad/glad.h>
 
-#include <iostream>
-
-Vao::Vao(unsigned int *VAO, unsigned int* VBO, float *vertices, size_t data_size){
-	glBindVertexArray(*VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, *VBO);
+Vao::Vao(const float* vertices, size_t data_size)
+	: VAO(VertexArrayHandle::create()), VBO(BufferHandle::create())
+{
+	glBindVertexArray(VAO.get());
+	glBindBuffer(GL_ARRAY_BUFFER, VBO.get());
 	glBufferData(GL_ARRAY_BUFFER, data_size, vertices, GL_STATIC_DRAW);
+	VBO.setBytes(data_size);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 	glBindVertexArray(0);
 }
 
-void Vao::bind(unsigned int* VAO)
+void Vao::bind() const
 {
-	glBindVertexArray(*VAO);
+	glBindVertexArray(VAO.get());
 }
 
-void Vao::unbind()
+void Vao::unbind() const
 {
 	glBindVertexArray(0);
-}
\ No newline at end of file
+}
@@ -1,11 +1,20 @@
 #pragma once
+
+#include "GpuResources.h"
+
+#include <cstddef>
+
+// position only vertex array that owns its buffer
 class Vao
 {
 public:
 
-	Vao(unsigned int* VAO, unsigned int* VBO, float *vertices, size_t data_size);
+	Vao(const float* vertices, size_t data_size);
 
-	void bind(unsigned int* VAO);
-	void unbind();
-};
+	void bind() const;
+	void unbind() const;
 
+private:
+	VertexArrayHandle VAO;
+	BufferHandle VBO;
+};
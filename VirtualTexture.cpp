@@ -0,0 +1,492 @@
+#include "VirtualTexture.h"
+
+#include "Instrument.h"
+#include "Log.h"
+#include "MipChain.h"
+
+#include <glad/glad.h>
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const unsigned int StagingPages = 32;
+
+	bool seek(FILE* file, uint64_t offset)
+	{
+#ifdef _MSC_VER
+		return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+#else
+		return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+	}
+
+	// slot x, y and the mip of the page in it, one byte each
+	uint32_t packEntry(unsigned int slotX, unsigned int slotY, unsigned int mip)
+	{
+		return slotX | slotY << 8 | mip << 16 | 0xffu << 24;
+	}
+}
+
+bool cookVirtualTexture(const unsigned char* pixels, int size, int pageSize, int border, const std::string& path)
+{
+	if (size < pageSize || (size & (size - 1)) || (pageSize & (pageSize - 1)) || size / pageSize > 256)
+	{
+		LOG_ERROR("ERROR::VIRTUAL_TEXTURE::UNSUPPORTED_SIZE " << size << " in pages of " << pageSize);
+		return false;
+	}
+	VirtualTextureHeader header;
+	memcpy(header.magic, "GVTX", 4);
+	header.version = VirtualTextureVersion;
+	header.size = size;
+	header.pageSize = pageSize;
+	header.border = border;
+	header.mipCount = 1;
+	header.pageCount = 1;
+	for (int pages = size / pageSize; pages > 1; pages /= 2)
+	{
+		header.pageCount += pages * pages;
+		header.mipCount++;
+	}
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		LOG_ERROR("ERROR::VIRTUAL_TEXTURE::FILE_NOT_SUCCESFULLY_WRITTEN " << path);
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	const int tile = pageSize + 2 * border;
+	std::vector<unsigned char> level(pixels, pixels + (size_t)size * size * 4), next, page((size_t)tile * tile * 4);
+	for (uint32_t mip = 0; mip < header.mipCount && written; mip++)
+	{
+		const int levelSize = size >> mip, pages = levelSize / pageSize;
+		for (int py = 0; py < pages && written; py++)
+			for (int px = 0; px < pages && written; px++)
+			{
+				// the border repeats the edge texels where the texture ends
+				for (int ty = 0; ty < tile; ty++)
+				{
+					int sy = std::min(std::max(py * pageSize - border + ty, 0), levelSize - 1);
+					for (int tx = 0; tx < tile; tx++)
+					{
+						int sx = std::min(std::max(px * pageSize - border + tx, 0), levelSize - 1);
+						memcpy(&page[((size_t)ty * tile + tx) * 4], &level[((size_t)sy * levelSize + sx) * 4], 4);
+					}
+				}
+				written = fwrite(page.data(), page.size(), 1, file) == 1;
+			}
+		if (mip + 1 == header.mipCount)
+			break;
+		next.resize((size_t)mipSize(levelSize) * mipSize(levelSize) * 4);
+		downsampleMip(level.data(), levelSize, levelSize, next.data(), MipOptions(MipKaiser, true));
+		level.swap(next);
+	}
+	written = fclose(file) == 0 && written;
+	if (!written)
+		LOG_ERROR("ERROR::VIRTUAL_TEXTURE::FILE_NOT_SUCCESFULLY_WRITTEN " << path);
+	return written;
+}
+
+VirtualTexture::VirtualTexture(int cacheSlots, unsigned int pagesPerFrame)
+	: file(nullptr), cacheSlots(cacheSlots), pagesPerFrame(pagesPerFrame), feedbackDivisor(8), indirectionDirty(false),
+	frame(0), frameStats(), hits(0), quit(false), feedbackWidth(0), feedbackHeight(0), feedbackFrame(0)
+{
+	memset(&header, 0, sizeof(header));
+	readbackWidth[0] = readbackWidth[1] = readbackHeight[0] = readbackHeight[1] = 0;
+	readbackFull[0] = readbackFull[1] = false;
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	stopLoader();
+	if (file)
+		fclose(file);
+}
+
+bool VirtualTexture::open(const std::string& path)
+{
+	file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "GVTX", 4) == 0
+		&& header.version == VirtualTextureVersion && header.pageSize && header.size >= header.pageSize
+		&& header.size / header.pageSize <= 256 && header.mipCount <= 9;
+	if (valid)
+	{
+		mipOffsets.assign(header.mipCount + 1, 0);
+		for (uint32_t mip = 0; mip < header.mipCount; mip++)
+			mipOffsets[mip + 1] = mipOffsets[mip] + pagesAcross(mip) * pagesAcross(mip);
+		valid = mipOffsets.back() == header.pageCount && seek(file, sizeof(header) + (uint64_t)header.pageCount * tileBytes())
+			&& fgetc(file) == EOF;
+	}
+	if (!valid)
+	{
+		LOG_ERROR("ERROR::VIRTUAL_TEXTURE::INVALID_FILE " << path);
+		fclose(file);
+		file = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool VirtualTexture::readPage(unsigned int page, unsigned char* out)
+{
+	return seek(file, sizeof(header) + (uint64_t)page * tileBytes()) && fread(out, tileBytes(), 1, file) == 1;
+}
+
+void VirtualTexture::create(int divisor)
+{
+	if (!file || cache.get())
+		return;
+	feedbackDivisor = divisor;
+	const unsigned int pageCount = header.pageCount;
+	pageSlots.assign(pageCount, -1);
+	pending.assign(pageCount, 0);
+	requestStamps.assign(pageCount, 0);
+	wantStamps.assign(pageCount, 0);
+	wanted.reserve(pageCount);
+	slotPages.assign(cacheSlots * cacheSlots, -1);
+	slotUsed.assign(cacheSlots * cacheSlots, 0);
+	indirection.resize(header.mipCount);
+	for (uint32_t mip = 0; mip < header.mipCount; mip++)
+		indirection[mip].assign(pagesAcross(mip) * pagesAcross(mip), 0);
+
+	cache = TextureHandle::create();
+	glBindTexture(GL_TEXTURE_2D, cache.get());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cacheSlots * tileSize(), cacheSlots * tileSize(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	frameStats.cacheBytes = (size_t)cacheSlots * cacheSlots * tileBytes();
+	frameStats.virtualBytes = (size_t)pageCount * tileBytes();
+	cache.setBytes(frameStats.cacheBytes);
+
+	// a level per mip, sampled with texelFetch
+	indirectionTexture = TextureHandle::create();
+	glBindTexture(GL_TEXTURE_2D, indirectionTexture.get());
+	for (uint32_t mip = 0; mip < header.mipCount; mip++)
+		glTexImage2D(GL_TEXTURE_2D, mip, GL_RGBA8, pagesAcross(mip), pagesAcross(mip), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.mipCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	indirectionTexture.setBytes((size_t)mipOffsets.back() * 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	staging.resize(StagingPages * tileBytes());
+	freeStaging.clear();
+	for (unsigned int k = 0; k < StagingPages; k++)
+		freeStaging.push_back(k);
+	requests.reserve(StagingPages);
+	loaded.reserve(StagingPages);
+	taken.reserve(StagingPages);
+
+	// the coarsest page is the fallback of every other one
+	const unsigned int top = header.pageCount - 1;
+	if (readPage(top, staging.data()))
+		upload(top, staging.data());
+	else
+		LOG_ERROR("ERROR::VIRTUAL_TEXTURE::PAGE_NOT_SUCCESFULLY_READ " << top);
+	rebuildIndirection();
+
+	quit = false;
+	loader = std::thread(&VirtualTexture::loaderLoop, this);
+}
+
+void VirtualTexture::stopLoader()
+{
+	if (!loader.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	loader.join();
+}
+
+void VirtualTexture::release()
+{
+	stopLoader();
+	requests.clear();
+	loaded.clear();
+	cache.reset();
+	indirectionTexture.reset();
+	feedbackColor.reset();
+	feedbackDepth.reset();
+	feedbackFramebuffer.reset();
+	readback[0].reset();
+	readback[1].reset();
+	feedbackWidth = feedbackHeight = 0;
+}
+
+void VirtualTexture::loaderLoop()
+{
+	INSTRUMENT_THREAD("virtual texture loader");
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		wake.wait(lock, [this] { return quit || !requests.empty(); });
+		if (quit)
+			return;
+		// requests are sorted coarse to fine, the fallbacks arrive first
+		PageRequest request = requests.front();
+		requests.erase(requests.begin());
+		lock.unlock();
+		request.read = readPage(request.page, &staging[request.staging * tileBytes()]);
+		lock.lock();
+		if (!request.read)
+			LOG_ERROR("ERROR::VIRTUAL_TEXTURE::PAGE_NOT_SUCCESFULLY_READ " << request.page);
+		loaded.push_back(request);
+	}
+}
+
+void VirtualTexture::beginFeedback(int screenWidth, int screenHeight)
+{
+	if (!cache.get())
+		return;
+	int width = std::max(screenWidth / feedbackDivisor, 1), height = std::max(screenHeight / feedbackDivisor, 1);
+	if (width != feedbackWidth || height != feedbackHeight)
+	{
+		feedbackWidth = width;
+		feedbackHeight = height;
+		feedbackColor = TextureHandle::create();
+		feedbackDepth = TextureHandle::create();
+		feedbackFramebuffer = FramebufferHandle::create();
+		glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer.get());
+		const GLenum internalFormats[2] = { GL_RGBA8, GL_DEPTH_COMPONENT24 };
+		const GLenum formats[2] = { GL_RGBA, GL_DEPTH_COMPONENT };
+		const GLenum types[2] = { GL_UNSIGNED_BYTE, GL_UNSIGNED_INT };
+		const GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT };
+		TextureHandle* targets[2] = { &feedbackColor, &feedbackDepth };
+		for (int k = 0; k < 2; k++)
+		{
+			glBindTexture(GL_TEXTURE_2D, targets[k]->get());
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[k], width, height, 0, formats[k], types[k], nullptr);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[k], GL_TEXTURE_2D, targets[k]->get(), 0);
+			targets[k]->setBytes((size_t)width * height * 4);
+		}
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			LOG_ERROR("ERROR::VIRTUAL_TEXTURE::FRAMEBUFFER_INCOMPLETE");
+		glBindTexture(GL_TEXTURE_2D, 0);
+		for (int k = 0; k < 2; k++)
+		{
+			if (!readback[k].get())
+				readback[k] = BufferHandle::create();
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[k].get());
+			glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, nullptr, GL_STREAM_READ);
+			readback[k].setBytes((size_t)width * height * 4);
+			readbackFull[k] = false;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer.get());
+	glViewport(0, 0, feedbackWidth, feedbackHeight);
+	// alpha 0 asks for nothing
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTexture::endFeedback()
+{
+	if (!cache.get())
+		return;
+	// update() maps the buffer two frames later
+	unsigned int buffer = feedbackFrame++ & 1;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[buffer].get());
+	glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readbackWidth[buffer] = feedbackWidth;
+	readbackHeight[buffer] = feedbackHeight;
+	readbackFull[buffer] = true;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VirtualTexture::want(unsigned int mip, unsigned int x, unsigned int y)
+{
+	// the page and every coarser one covering it, those are its fallbacks
+	for (; mip < header.mipCount; mip++, x /= 2, y /= 2)
+	{
+		unsigned int page = mipOffsets[mip] + y * pagesAcross(mip) + x;
+		if (wantStamps[page] == frame)
+			return;
+		wantStamps[page] = frame;
+		wanted.push_back(page);
+	}
+}
+
+void VirtualTexture::readFeedback(unsigned int buffer)
+{
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[buffer].get());
+	const size_t bytes = (size_t)readbackWidth[buffer] * readbackHeight[buffer] * 4;
+	const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+	if (pixels)
+	{
+		for (size_t p = 0; p < bytes; p += 4)
+		{
+			// r, g page x and y, b the mip, a 255 where something asked
+			if (pixels[p + 3] != 255)
+				continue;
+			unsigned int x = pixels[p], y = pixels[p + 1], mip = pixels[p + 2];
+			if (mip >= header.mipCount || x >= pagesAcross(mip) || y >= pagesAcross(mip))
+				continue;
+			unsigned int page = mipOffsets[mip] + y * pagesAcross(mip) + x;
+			if (requestStamps[page] == frame)
+				continue;
+			requestStamps[page] = frame;
+			frameStats.requested++;
+			hits += pageSlots[page] >= 0;
+			want(mip, x, y);
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readbackFull[buffer] = false;
+}
+
+int VirtualTexture::takeSlot()
+{
+	int oldest = -1;
+	const unsigned int top = header.pageCount - 1;
+	for (int slot = 0; slot < (int)slotPages.size(); slot++)
+	{
+		if (slotPages[slot] < 0)
+			return slot;
+		// wanted this frame or the fallback of everything, stays
+		if (slotUsed[slot] == frame || slotPages[slot] == (int)top)
+			continue;
+		if (oldest < 0 || slotUsed[slot] < slotUsed[oldest])
+			oldest = slot;
+	}
+	if (oldest >= 0)
+	{
+		pageSlots[slotPages[oldest]] = -1;
+		slotPages[oldest] = -1;
+	}
+	return oldest;
+}
+
+void VirtualTexture::upload(unsigned int page, const unsigned char* texels)
+{
+	int slot = takeSlot();
+	if (slot < 0)
+	{
+		frameStats.dropped++;
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, cache.get());
+	glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % cacheSlots) * tileSize(), (slot / cacheSlots) * tileSize(), tileSize(), tileSize(),
+		GL_RGBA, GL_UNSIGNED_BYTE, texels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	slotPages[slot] = page;
+	slotUsed[slot] = frame;
+	pageSlots[page] = slot;
+	indirectionDirty = true;
+	frameStats.streamed++;
+}
+
+void VirtualTexture::rebuildIndirection()
+{
+	// coarse to fine, a page that is not resident takes its parent's entry
+	for (int mip = header.mipCount - 1; mip >= 0; mip--)
+	{
+		const unsigned int across = pagesAcross(mip);
+		for (unsigned int y = 0; y < across; y++)
+			for (unsigned int x = 0; x < across; x++)
+			{
+				int slot = pageSlots[mipOffsets[mip] + y * across + x];
+				uint32_t& entry = indirection[mip][y * across + x];
+				if (slot >= 0)
+					entry = packEntry(slot % cacheSlots, slot / cacheSlots, mip);
+				else if (mip + 1 < (int)header.mipCount)
+					entry = indirection[mip + 1][(y / 2) * pagesAcross(mip + 1) + x / 2];
+				else
+					entry = 0;
+			}
+	}
+	glBindTexture(GL_TEXTURE_2D, indirectionTexture.get());
+	for (uint32_t mip = 0; mip < header.mipCount; mip++)
+		glTexSubImage2D(GL_TEXTURE_2D, mip, 0, 0, pagesAcross(mip), pagesAcross(mip), GL_RGBA, GL_UNSIGNED_BYTE, indirection[mip].data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+	indirectionDirty = false;
+}
+
+void VirtualTexture::update()
+{
+	if (!cache.get())
+		return;
+	frame++;
+	frameStats.requested = frameStats.streamed = frameStats.dropped = 0;
+	hits = 0;
+	wanted.clear();
+
+	// the feedback of two frames ago, the GPU is done with it and mapping does not wait
+	unsigned int buffer = feedbackFrame & 1;
+	if (readbackFull[buffer])
+		readFeedback(buffer);
+	frameStats.hitRate = frameStats.requested ? (float)hits / frameStats.requested : 1.0f;
+
+	// coarse pages first, they are the fallback of the finer ones
+	for (unsigned int page : wanted)
+		if (pageSlots[page] >= 0)
+			slotUsed[pageSlots[page]] = frame;
+	std::sort(wanted.begin(), wanted.end(), [](unsigned int a, unsigned int b) { return a > b; });
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (unsigned int page : wanted)
+		{
+			if (freeStaging.empty())
+				break;
+			if (pageSlots[page] >= 0 || pending[page])
+				continue;
+			PageRequest request = { page, freeStaging.back(), false };
+			freeStaging.pop_back();
+			requests.push_back(request);
+			pending[page] = 1;
+		}
+		// at most pagesPerFrame uploads, the rest waits in loaded
+		size_t count = std::min(loaded.size(), (size_t)pagesPerFrame);
+		taken.assign(loaded.begin(), loaded.begin() + count);
+		loaded.erase(loaded.begin(), loaded.begin() + count);
+	}
+	wake.notify_one();
+
+	for (const PageRequest& request : taken)
+	{
+		if (request.read)
+			upload(request.page, &staging[request.staging * tileBytes()]);
+		pending[request.page] = 0;
+		freeStaging.push_back(request.staging);
+	}
+	if (indirectionDirty)
+		rebuildIndirection();
+
+	frameStats.resident = 0;
+	for (int page : slotPages)
+		frameStats.resident += page >= 0;
+	frameStats.pending = StagingPages - (unsigned int)freeStaging.size();
+	frameStats.residentBytes = frameStats.resident * tileBytes();
+}
+
+void VirtualTexture::bind(const Shader& shader, int unit, bool feedback) const
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, cache.get());
+	glActiveTexture(GL_TEXTURE0 + unit + 1);
+	glBindTexture(GL_TEXTURE_2D, indirectionTexture.get());
+	glActiveTexture(GL_TEXTURE0);
+	shader.setInt("vtCache", unit);
+	shader.setInt("vtIndirection", unit + 1);
+	shader.setFloat("vtPages", (float)pagesAcross(0));
+	shader.setFloat("vtPageSize", (float)header.pageSize);
+	shader.setFloat("vtBorder", (float)header.border);
+	shader.setFloat("vtSlots", (float)cacheSlots);
+	shader.setFloat("vtMaxMip", (float)(header.mipCount - 1));
+	// derivatives in the smaller target are feedbackDivisor times larger
+	shader.setFloat("vtMipBias", feedback ? -log2f((float)feedbackDivisor) : 0.0f);
+}
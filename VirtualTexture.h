@@ -0,0 +1,146 @@
+#pragma once
+
+#include "GpuResources.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Cooked virtual texture, written by cookVirtualTexture. The header is followed
+// by the pages of every mip level, the finest first and each level row by row.
+// A page is (pageSize + 2 * border)^2 RGBA8 texels, the border holds the
+// neighbouring pages' texels so filtering in the cache needs nothing else.
+struct VirtualTextureHeader
+{
+	char magic[4];         // "GVTX"
+	uint32_t version;
+	uint32_t size;         // texels across mip 0, the texture is square
+	uint32_t pageSize, border;
+	uint32_t mipCount;     // down to a single page
+	uint32_t pageCount;
+};
+
+const uint32_t VirtualTextureVersion = 1;
+
+// size a power of two and at least pageSize, the mips are Kaiser filtered in linear space
+bool cookVirtualTexture(const unsigned char* pixels, int size, int pageSize, int border, const std::string& path);
+
+struct VirtualTextureStats
+{
+	unsigned int requested;  // distinct pages the last feedback read back asked for
+	float hitRate;           // of those, the part that was resident
+	unsigned int streamed;   // pages uploaded into the cache this frame
+	unsigned int pending;    // with the loader thread
+	unsigned int dropped;    // loaded but every slot was in use this frame
+	unsigned int resident;
+	size_t residentBytes, cacheBytes;
+	size_t virtualBytes;     // every page of every mip
+};
+
+// Virtual texturing of one large texture. Only the pages the view needs are in
+// the physical cache, a texture of cacheSlots x cacheSlots pages; an
+// indirection texture with a texel per page and a level per mip says which
+// slot holds a page, or the nearest coarser page that is resident. The
+// coarsest mip is one page and never leaves the cache.
+//
+// The pages come from a feedback pass: the same geometry drawn into a small
+// target with the FEEDBACK variant writing the page and mip every pixel wants.
+// The target is read back through a pixel buffer a frame later, missing pages
+// go to a loader thread reading the cooked file, and update() uploads a few
+// of the loaded ones per frame, evicting the least recently wanted.
+class VirtualTexture
+{
+public:
+	// at most pagesPerFrame pages go into the cache per frame
+	VirtualTexture(int cacheSlots, unsigned int pagesPerFrame);
+	~VirtualTexture();
+
+	VirtualTexture(const VirtualTexture&) = delete;
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+	// fails on a missing, truncated or older file
+	bool open(const std::string& path);
+
+	// GL side and the loader thread. The feedback target is the screen size
+	// divided by feedbackDivisor.
+	void create(int feedbackDivisor);
+	void release();
+
+	// draws between these two go to the feedback target, they restore the
+	// default framebuffer but not the viewport
+	void beginFeedback(int screenWidth, int screenHeight);
+	void endFeedback();
+
+	// reads back the previous feedback, hands missing pages to the loader and
+	// uploads what it has loaded
+	void update();
+
+	// the cache on unit, the indirection on unit + 1; feedback sets the mip
+	// bias of the smaller target
+	void bind(const Shader& shader, int unit, bool feedback) const;
+
+	const VirtualTextureStats& stats() const { return frameStats; }
+
+private:
+	struct PageRequest
+	{
+		unsigned int page;
+		unsigned int staging;  // buffer the loader reads into
+		bool read;
+	};
+
+	unsigned int pagesAcross(unsigned int mip) const { return std::max(header.size >> mip, header.pageSize) / header.pageSize; }
+	unsigned int tileSize() const { return header.pageSize + 2 * header.border; }
+	size_t tileBytes() const { return (size_t)tileSize() * tileSize() * 4; }
+
+	bool readPage(unsigned int page, unsigned char* out);
+	void readFeedback(unsigned int buffer);
+	void want(unsigned int mip, unsigned int x, unsigned int y);
+	int takeSlot();
+	void upload(unsigned int page, const unsigned char* texels);
+	void rebuildIndirection();
+	void loaderLoop();
+	void stopLoader();
+
+	VirtualTextureHeader header;
+	FILE* file;
+	std::vector<unsigned int> mipOffsets;  // index of the first page of every mip
+	int cacheSlots;
+	unsigned int pagesPerFrame;
+	int feedbackDivisor;
+
+	std::vector<int> pageSlots;        // -1 when not resident
+	std::vector<unsigned char> pending;
+	std::vector<unsigned int> requestStamps, wantStamps;
+	std::vector<int> slotPages;        // -1 when free
+	std::vector<unsigned int> slotUsed;
+	std::vector<unsigned int> wanted;
+	std::vector<std::vector<uint32_t>> indirection;
+	bool indirectionDirty;
+	unsigned int frame;
+	VirtualTextureStats frameStats;
+	unsigned int hits;
+
+	// loader thread, requests and loaded pages move under the mutex
+	std::vector<unsigned char> staging;
+	std::vector<unsigned int> freeStaging;
+	std::vector<PageRequest> requests, loaded, taken;
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool quit;
+
+	TextureHandle cache, indirectionTexture, feedbackColor, feedbackDepth;
+	FramebufferHandle feedbackFramebuffer;
+	BufferHandle readback[2];
+	int readbackWidth[2], readbackHeight[2];
+	bool readbackFull[2];
+	int feedbackWidth, feedbackHeight;
+	unsigned int feedbackFrame;
+};
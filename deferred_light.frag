@@ -0,0 +1,53 @@
+#version 330 core
+// the lighting terms of light_cube.frag, scaled by the stored albedo
+#pragma keywords DIRECTIONAL POINT SPECULAR CLUSTERED SHADOWS
+#include "lighting.glsl"
+
+out vec4 FragColor;
+
+in vec2 uv;
+
+// G-buffer, see GBuffer.h
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+uniform vec3 lightDir;
+
+void main()
+{
+    float depth = texture(gDepth, uv).r;
+    if (depth == 1.0)
+        discard;
+    gl_FragDepth = depth;
+
+    vec4 viewPosition = inverseProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    viewPosition /= viewPosition.w;
+    vec3 position = vec3(inverseView * viewPosition);
+    vec4 material = texture(gAlbedo, uv);
+    vec3 normal = octDecode(texture(gNormal, uv).xy);
+
+    vec3 color = vec3(0.0), specular = vec3(0.0);
+#ifdef DIRECTIONAL
+    float light = directionalLight(lightDir, normal);
+#ifdef SHADOWS
+    light *= directionalShadow(position, normal, -viewPosition.z);
+#endif
+    color += vec3(light, 0.0, 0.0);
+#endif
+#ifdef POINT
+    float light2 = pointLight(lightPos, normal, position);
+    color += vec3(0.0, light2, 0.0) * 0.5;
+#endif
+#ifdef SPECULAR
+    float light3 = specularLight(lightPos, normal, position, eyePos, material.a * 256.0);
+    specular = vec3(light3, light3, light3);
+#endif
+#ifdef CLUSTERED
+    color += clusteredLights(normal, position, -viewPosition.z);
+#endif
+
+    FragColor = vec4(specular + material.rgb * color, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 330 core
+// The ground, textured from the VirtualTexture.
+// FEEDBACK: writes the page every pixel wants instead of its color
+#pragma keywords FEEDBACK
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+#include "virtual_texture.glsl"
+
+void main()
+{
+#ifdef FEEDBACK
+    FragColor = vtFeedback(TexCoord);
+#else
+    FragColor = vtSample(TexCoord);
+#endif
+}
\ No newline at end of file
@@ -1,5 +1,19 @@
 #version 330 core
+// LOD_FADE: dithered crossfade between two levels of detail
+// GBUFFER: writes the deferred G-buffer instead of shading
+// the rest switch the lighting terms, a variant without any of them only writes depth
+#pragma keywords LOD_FADE GBUFFER DIRECTIONAL POINT SPECULAR CLUSTERED SHADOWS
+#include "lighting.glsl"
+
+#ifdef GBUFFER
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec2 gNormal;
+
+uniform vec3 albedo = vec3(1.0);
+uniform float shininess = 256.0;
+#else
 out vec4 FragColor;
+#endif
 
 uniform vec4 ourColor;
 in vec2 TexCoord;
@@ -8,64 +22,59 @@ uniform sampler2D texture1;
 uniform sampler2D texture2;
 uniform float mixer;
 
-uniform vec3 eyePos;
 uniform vec3 lightDir;
-vec3 lightPos = vec3(-500.0, 0.0, 0.0);
+
+#ifdef LOD_FADE
+// LOD crossfade: 1 draws every pixel, f in [0, 1) the pixels whose dither
+// threshold is below f, or with lodFadeOut the complementary ones. Mirrored by
+// lodFadeDraws() in Lod.cpp.
+uniform float lodFade;
+uniform bool lodFadeOut;
+const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+#endif
 
 in vec3 normal;
 in vec3 position;
-
-float directionalLight(vec3 lightDir, vec3 normal) {
-    float f = dot(normalize(normal), -lightDir);
-    if (f > 0)
-        return f;
-    else
-        return 0.0;
-}
-
-float pointLight(vec3 lightPos, vec3 normal, vec3 position) {
-    vec3 lightDelta = position - lightPos;
-    vec3 lightDir = normalize(lightDelta);
-
-    return directionalLight(lightDir, normal);
-
-    // fajne rzeczy
-    // vec3 distance = length(lightDelta);
-    //  float attenuation = 0.1 * distance + 0.001 * distance * distance;
-    // return directionalLight(lightDir, normal) / attenuation;
-}
-
-float specularLight(vec3 lightPos, vec3 normal, vec3 position, vec3 eyePos, float shininess) {
-    vec3 lightDelta = position - lightPos;
-    vec3 lightDir = normalize(lightDelta);
-
-    float f = dot(normalize(normal), -lightDir);
-    if (f < 0)
-        return 0.0;
-
-    vec3 viewDir = -normalize(eyePos - position);
-    vec3 reflectDir = reflect(-lightDir, normal);
-
-    float s = pow(
-        max(0.0, dot(viewDir, reflectDir)),
-        shininess
-    );
-    return s;
-}
+in float viewDepth;
 
 void main()
 {
+#ifdef LOD_FADE
+    if (lodFade < 1.0) {
+        ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+        float threshold = (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+        if ((threshold < lodFade) == lodFadeOut)
+            discard;
+    }
+#endif
+
+#ifdef GBUFFER
+    gAlbedo = vec4(albedo, shininess / 256.0);
+    gNormal = octEncode(normalize(normal));
+#else
+    vec3 color = vec3(0.0);
+#ifdef DIRECTIONAL
     float light = directionalLight(lightDir, normal);
-    vec3 color = vec3(light, 0.0, 0.0);
-
+#ifdef SHADOWS
+    light *= directionalShadow(position, normalize(normal), viewDepth);
+#endif
+    color += vec3(light, 0.0, 0.0);
+#endif
+#ifdef POINT
     float light2 = pointLight(lightPos, normal, position);
-    vec3 color2 = vec3(0.0, light2, 0.0);
-
+    color += vec3(0.0, light2, 0.0) * 0.5;
+#endif
+#ifdef SPECULAR
     float light3 = specularLight(lightPos, normal, position, eyePos, 256.0);
-    vec3 color3 = vec3(light3, light3, light3);
+    color += vec3(light3, light3, light3);
+#endif
+#ifdef CLUSTERED
+    color += clusteredLights(normalize(normal), position, viewDepth);
+#endif
 
 	//FragColor = vec4(1.0, 0.0, 0.0, 1.0);
-	FragColor = vec4(color3 + color2 * 0.5, 1.0);
+	FragColor = vec4(color, 1.0);
 	//FragColor = mix(texture(texture1, TexCoord), 
 	//				texture(texture2, vec2(TexCoord.x, TexCoord.y)), mixer);
-};
\ No newline at end of file
+#endif
+};
@@ -0,0 +1,122 @@
+// Lighting terms shared by light_cube.frag and deferred_light.frag, pulled in
+// with #include by the Shader loader.
+
+uniform vec3 eyePos;
+vec3 lightPos = vec3(-500.0, 0.0, 0.0);
+
+// clustered point lights, see ClusteredLights.h
+uniform samplerBuffer lightData;     // 2 texels per light: position + radius, color + intensity
+uniform usamplerBuffer lightGrid;    // offset and count per cluster
+uniform usamplerBuffer lightIndices;
+uniform vec2 clusterScale;           // clusters per pixel
+uniform float sliceScale;
+uniform float sliceBias;
+const int clustersX = 16;
+const int clustersY = 9;
+const int clustersZ = 24;
+
+float directionalLight(vec3 lightDir, vec3 normal) {
+    float f = dot(normalize(normal), -lightDir);
+    if (f > 0)
+        return f;
+    else
+        return 0.0;
+}
+
+float pointLight(vec3 lightPos, vec3 normal, vec3 position) {
+    vec3 lightDelta = position - lightPos;
+    vec3 lightDir = normalize(lightDelta);
+
+    return directionalLight(lightDir, normal);
+
+    // fajne rzeczy
+    // vec3 distance = length(lightDelta);
+    //  float attenuation = 0.1 * distance + 0.001 * distance * distance;
+    // return directionalLight(lightDir, normal) / attenuation;
+}
+
+float specularLight(vec3 lightPos, vec3 normal, vec3 position, vec3 eyePos, float shininess) {
+    vec3 lightDelta = position - lightPos;
+    vec3 lightDir = normalize(lightDelta);
+
+    float f = dot(normalize(normal), -lightDir);
+    if (f < 0)
+        return 0.0;
+
+    vec3 viewDir = -normalize(eyePos - position);
+    vec3 reflectDir = reflect(-lightDir, normal);
+
+    float s = pow(
+        max(0.0, dot(viewDir, reflectDir)),
+        shininess
+    );
+    return s;
+}
+
+vec3 clusteredLights(vec3 normal, vec3 position, float viewDepth) {
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterScale), int(log(viewDepth) * sliceScale + sliceBias));
+    cluster = clamp(cluster, ivec3(0), ivec3(clustersX - 1, clustersY - 1, clustersZ - 1));
+    uvec2 range = texelFetch(lightGrid, (cluster.z * clustersY + cluster.y) * clustersX + cluster.x).xy;
+
+    vec3 color = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(lightIndices, int(range.x + i)).x);
+        vec4 positionRadius = texelFetch(lightData, light * 2);
+        vec4 colorIntensity = texelFetch(lightData, light * 2 + 1);
+
+        vec3 lightDelta = positionRadius.xyz - position;
+        float distance2 = dot(lightDelta, lightDelta);
+        float radius2 = positionRadius.w * positionRadius.w;
+        if (distance2 >= radius2)
+            continue;
+        float falloff = 1.0 - distance2 / radius2;
+        float diffuse = max(dot(normal, lightDelta * inversesqrt(distance2)), 0.0);
+        color += colorIntensity.rgb * (colorIntensity.w * diffuse * falloff * falloff);
+    }
+    return color;
+}
+
+#ifdef SHADOWS
+// cascaded shadow maps of the directional light, see CascadedShadows.h
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform vec4 cascadeSplits;          // far view depth of every cascade
+uniform vec4 shadowTexelSizes;       // world size of one texel, scales the normal offset
+uniform int cascadeCount;
+
+// 1 lit, 0 in shadow
+float directionalShadow(vec3 position, vec3 normal, float viewDepth) {
+    int cascade = 0;
+    while (cascade < cascadeCount - 1 && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if (viewDepth > cascadeSplits[cascade])
+        return 1.0;
+
+    // pushed out along the normal against acne on surfaces at a grazing angle to the light
+    vec3 offsetPosition = position + normal * shadowTexelSizes[cascade] * 1.5;
+    vec3 shadowPosition = (shadowMatrices[cascade] * vec4(offsetPosition, 1.0)).xyz * 0.5 + 0.5;
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+            lit += texture(shadowMap, vec4(shadowPosition.xy + vec2(x, y) * texel, float(cascade), shadowPosition.z));
+    return lit / 9.0;
+}
+#endif
+
+// octahedral mapping of the unit sphere onto [0, 1]^2, used by the G-buffer
+vec2 octEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0)
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e * 0.5 + 0.5;
+}
+
+vec3 octDecode(vec2 e) {
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
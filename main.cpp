@@ -3,9 +3,42 @@
 #include <GLFW/glfw3.h>
 #include <string>
 #include <fstream>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
 #include "Shader.h"
+#include "ShaderVariants.h"
+#include "ShaderWatcher.h"
 #include "Cube.h"
 #include "Vao.h"
+#include "Occlusion.h"
+#include "Mesh.h"
+#include "MeshSimplify.h"
+#include "MeshOptimize.h"
+#include "MeshAsset.h"
+#include "NormalMatrix.h"
+#include "ClusteredLights.h"
+#include "GBuffer.h"
+#include "CascadedShadows.h"
+#include "Profiler.h"
+#include "Instrument.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "FrameArena.h"
+#include "GpuResources.h"
+#include "GeometryPool.h"
+#include "MaterialLibrary.h"
+#include "Simulation.h"
+#include "Input.h"
+#include "TextOverlay.h"
+#include "VirtualTexture.h"
+#include "Lod.h"
+#include "Benchmark.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -17,25 +50,109 @@
 using namespace std;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow* window, Shader* shader);
+void processInput(GLFWwindow* window, Input& input);
+void injectInput(Input& input, double rate, const std::atomic<bool>& running);
 
 auto getProgramiv_ptr = &glGetProgramiv;
 void ProgramErrorHandling(PFNGLGETPROGRAMIVPROC GetProgramParameter, GLuint program, int prog_param);
 void ShaderErrorHandling(PFNGLGETSHADERIVPROC GetShaderParameter, GLuint shader, int shader_param);
 const char* load_shader_src(string filename);
 
-const char* vertexShaderSource = load_shader_src("primary.vert");
+const char* vertexShaderSource = load_shader_src("mesh.vert");
 const char* fragmentShaderSourceOrange = load_shader_src("orange.frag");
 const char* fragmentShaderSourceYellow = load_shader_src("yellow.frag");
 
 glm::vec3 cameraPos		= glm::vec3(0.0f, 0.0f, 3.0f);
 glm::vec3 cameraFront   = glm::vec3(0.0f, 0.0f, -1.0f);
 glm::vec3 cameraUp		= glm::vec3(0.0f, 1.0f, 0.0f);
+// degrees, cameraFront follows them while the right mouse button is down
+float cameraYaw = -90.0f, cameraPitch = 0.0f;
 
+// wall clock time between the last two frames, for the camera and the LOD fades
 float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+double lastFrame = 0.0;
+
+// G toggles between the forward and the deferred path
+bool deferredShading = false;
+// 1-5 toggle the lighting terms, a disabled term is compiled out of the shader variant.
+// SHADOWS only takes effect with DIRECTIONAL.
+const int lightingTermCount = 5;
+const char* lightingKeywords[lightingTermCount] = { "DIRECTIONAL", "POINT", "SPECULAR", "CLUSTERED", "SHADOWS" };
+bool lightingTerms[lightingTermCount] = { false, true, true, true, true };
+// the square's mixer uniform, kept here and only ever written to the shader
+float mixerValue = 0.2f;
+
+// what the keys do, see the bindings in main
+enum Action
+{
+	ActionQuit,
+	ActionDeferred,
+	ActionLightingTerm,  // one per lighting term
+	ActionMixerUp = ActionLightingTerm + lightingTermCount,
+	ActionMixerDown,
+	ActionForward,
+	ActionBack,
+	ActionLeft,
+	ActionRight,
+	ActionLook,
+};
+
+// one entry of the per frame render queue, the uniforms of a draw packed in FrameArena memory
+struct DrawItem
+{
+	glm::mat4 model;
+	glm::mat3 normalMatrix;
+	unsigned int lod, previousLod;
+	float fade;
+};
+
+// set once per draw, constexpr so the compiler hashes the names
+static constexpr UniformName modelUniform = "model";
+static constexpr UniformName normalMatrixUniform = "normalMatrix";
+static constexpr UniformName lodFadeUniform = "lodFade";
+static constexpr UniformName lodFadeOutUniform = "lodFadeOut";
+
+int main(int argc, char** argv) {
+	if (argc > 2 && string(argv[1]) == "--bench")
+		return runBenchmark(argv[2]);
+	if (argc > 3 && string(argv[1]) == "--cook")
+		return cookObj(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 1);
+	unsigned int lightCount = 1024;
+	int cascadeCount = 4;
+	string tracePath, metricsPath;
+	bool zeroAllocations = false;
+	bool allowBindless = true;
+	bool cpuMips = false;
+	double simulationRate = 60.0;
+	bool simulationThread = false;
+	double injectRate = 0.0;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--lights" && i + 1 < argc)
+			lightCount = atoi(argv[++i]);
+		else if (string(argv[i]) == "--cascades" && i + 1 < argc)
+			cascadeCount = atoi(argv[++i]);
+		else if (string(argv[i]) == "--trace" && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (string(argv[i]) == "--metrics" && i + 1 < argc)
+			metricsPath = argv[++i];
+		else if (string(argv[i]) == "--zero-alloc")
+			zeroAllocations = true;
+		else if (string(argv[i]) == "--deferred")
+			deferredShading = true;
+		else if (string(argv[i]) == "--no-bindless")
+			allowBindless = false;
+		else if (string(argv[i]) == "--cpu-mips")
+			cpuMips = true;
+		else if (string(argv[i]) == "--sim-rate" && i + 1 < argc)
+			simulationRate = std::max(1.0, atof(argv[++i]));
+		else if (string(argv[i]) == "--sim-thread")
+			simulationThread = true;
+		else if (string(argv[i]) == "--inject-input" && i + 1 < argc)
+			injectRate = std::max(0.0, atof(argv[++i]));
+	}
+
+	INSTRUMENT_THREAD("main");
 
-int main() {
 	// ------------------ WINDOW ------------------
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -44,18 +161,35 @@ int main() {
 	GLFWwindow* window = glfwCreateWindow(800, 600, "LearnOpenGL", NULL, NULL);
 	if (window == NULL) 
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
+		LOG_ERROR("Failed to create GLFW window");
 		glfwTerminate();
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	// keys and the cursor come in through callbacks, taken once per frame by processInput
+	Input input;
+	input.attach(window);
+	input.bind(ActionQuit, GLFW_KEY_ESCAPE);
+	input.bind(ActionDeferred, GLFW_KEY_G);
+	for (int k = 0; k < lightingTermCount; k++)
+		input.bind(ActionLightingTerm + k, GLFW_KEY_1 + k);
+	input.bind(ActionMixerUp, GLFW_KEY_UP);
+	input.bind(ActionMixerDown, GLFW_KEY_DOWN);
+	input.bind(ActionForward, GLFW_KEY_W);
+	input.bind(ActionBack, GLFW_KEY_S);
+	input.bind(ActionLeft, GLFW_KEY_A);
+	input.bind(ActionRight, GLFW_KEY_D);
+	input.bind(ActionLook, Input::mouseButton(GLFW_MOUSE_BUTTON_RIGHT));
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) 
 	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
+		LOG_ERROR("Failed to initialize GLAD");
 		return -1;
 	}
+	installGLCounters();
 	glViewport(0, 0, 800, 600);
+	// --no-bindless keeps the texture array path for comparison
+	const bool bindless = allowBindless && MaterialLibrary::loadBindless((GLADloadproc)glfwGetProcAddress);
 
 	float vertices_triangle_one[] =
 	{
@@ -99,95 +233,7 @@ int main() {
 		-0.5f,  0.5f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 2.0f // top left
 	};
 
-	float cube[] = {
-	-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,	0.0f, 0.0f, -1.0f,
-	 0.5f, -0.5f, -0.5f,  1.0f, 0.0f,	0.0f, 0.0f, -1.0f,
-	 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,	0.0f, 0.0f, -1.0f,
-	 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,	0.0f, 0.0f, -1.0f,
-	-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,	0.0f, 0.0f, -1.0f,
-	-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,	0.0f, 0.0f, -1.0f,
-
-	-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,	0.0f, 0.0f, 1.0f,
-	 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,	0.0f, 0.0f, 1.0f,
-	 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,	0.0f, 0.0f, 1.0f,
-	 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,	0.0f, 0.0f, 1.0f,
-	-0.5f,  0.5f,  0.5f,  0.0f, 1.0f,	0.0f, 0.0f, 1.0f,
-	-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,	0.0f, 0.0f, 1.0f,
-
-	-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,	-1.0f, 0.0f, 0.0f,
-	-0.5f,  0.5f, -0.5f,  1.0f, 1.0f,	-1.0f, 0.0f, 0.0f,
-	-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,	-1.0f, 0.0f, 0.0f,
-	-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,	-1.0f, 0.0f, 0.0f,
-	-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,	-1.0f, 0.0f, 0.0f,
-	-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,	-1.0f, 0.0f, 0.0f,
-
-	 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,	1.0f, 0.0f, 0.0f,
-	 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,	1.0f, 0.0f, 0.0f,
-	 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,	1.0f, 0.0f, 0.0f,
-	 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,	1.0f, 0.0f, 0.0f,
-	 0.5f, -0.5f,  0.5f,  0.0f, 0.0f,	1.0f, 0.0f, 0.0f,
-	 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,	1.0f, 0.0f, 0.0f,
-
-	-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,	0.0f, -1.0f, 0.0f,
-	 0.5f, -0.5f, -0.5f,  1.0f, 1.0f,	0.0f, -1.0f, 0.0f,
-	 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,	0.0f, -1.0f, 0.0f,
-	 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,	0.0f, -1.0f, 0.0f,
-	-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,	0.0f, -1.0f, 0.0f,
-	-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,	0.0f, -1.0f, 0.0f,
-
-	-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,	0.0f, 1.0f, 0.0f,
-	 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,	0.0f, 1.0f, 0.0f,
-	 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,	0.0f, 1.0f, 0.0f,
-	 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,	0.0f, 1.0f, 0.0f,
-	-0.5f,  0.5f,  0.5f,  0.0f, 0.0f,	0.0f, 1.0f, 0.0f,
-	-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,	0.0f, 1.0f, 0.0f
-	};
-
-	float naked_cube[] = {
-	-0.5f, -0.5f, -0.5f,
-	 0.5f, -0.5f, -0.5f,
-	 0.5f,  0.5f, -0.5f,
-	 0.5f,  0.5f, -0.5f,
-	-0.5f,  0.5f, -0.5f,
-	-0.5f, -0.5f, -0.5f,
-
-	-0.5f, -0.5f,  0.5f,
-	 0.5f, -0.5f,  0.5f,
-	 0.5f,  0.5f,  0.5f,
-	 0.5f,  0.5f,  0.5f,
-	-0.5f,  0.5f,  0.5f,
-	-0.5f, -0.5f,  0.5f,
-
-	-0.5f,  0.5f,  0.5f,
-	-0.5f,  0.5f, -0.5f,
-	-0.5f, -0.5f, -0.5f,
-	-0.5f, -0.5f, -0.5f,
-	-0.5f, -0.5f,  0.5f,
-	-0.5f,  0.5f,  0.5f,
-
-	 0.5f,  0.5f,  0.5f,
-	 0.5f,  0.5f, -0.5f,
-	 0.5f, -0.5f, -0.5f,
-	 0.5f, -0.5f, -0.5f,
-	 0.5f, -0.5f,  0.5f,
-	 0.5f,  0.5f,  0.5f,
-
-	-0.5f, -0.5f, -0.5f,
-	 0.5f, -0.5f, -0.5f,
-	 0.5f, -0.5f,  0.5f,
-	 0.5f, -0.5f,  0.5f,
-	-0.5f, -0.5f,  0.5f,
-	-0.5f, -0.5f, -0.5f,
-
-	-0.5f,  0.5f, -0.5f,
-	 0.5f,  0.5f, -0.5f,
-	 0.5f,  0.5f,  0.5f,
-	 0.5f,  0.5f,  0.5f,
-	-0.5f,  0.5f,  0.5f,
-	-0.5f,  0.5f, -0.5f,
-	};
-
-	glm::vec3 cubePositions[] = {
+	std::vector<glm::vec3> cubePositions = {
 		glm::vec3(0.0f,  0.0f,  0.0f),
 		glm::vec3(2.0f,  5.0f, -15.0f),
 		glm::vec3(-1.5f, -2.2f, -2.5f),
@@ -200,31 +246,40 @@ int main() {
 		glm::vec3(-1.3f,  1.0f, -1.5f)
 	};
 
-	// Vertex Array Object  (VAO)
-	unsigned int VAOs[5], VBOs[5], EBO;
-	glGenVertexArrays(4, VAOs);
-	glGenBuffers(4, VBOs);
-	glGenBuffers(1, &EBO);
+	// dense field of cubes behind the first ten, most of it hidden by its own front rows
+	const int cubeFieldSize = 32;
+	for (int x = 0; x < cubeFieldSize; x++)
+		for (int z = 0; z < cubeFieldSize; z++)
+			cubePositions.push_back(glm::vec3((x - cubeFieldSize / 2) * 1.5f, sin(x * 0.7f + z * 0.3f) * 1.5f, -20.0f - z * 1.5f));
+
+	// Vertex Array Object  (VAO), owned through handles and deleted with them
+	VertexArrayHandle VAOs[2];
+	BufferHandle VBOs[2], EBO = BufferHandle::create();
+	VertexArrayHandle::create(VAOs, 2);
+	BufferHandle::create(VBOs, 2);
 
-	glBindVertexArray(VAOs[0]);
-	glBindBuffer(GL_ARRAY_BUFFER, VBOs[0]);
+	glBindVertexArray(VAOs[0].get());
+	glBindBuffer(GL_ARRAY_BUFFER, VBOs[0].get());
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_triangle_one), vertices_triangle_one, GL_STATIC_DRAW);
+	VBOs[0].setBytes(sizeof(vertices_triangle_one));
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
 	glEnableVertexAttribArray(1);
 
 	//glBindVertexArray(VAOs[1]);
-	Vao trojkat_2(&VAOs[1], &VBOs[1], vertices_triangle_two, sizeof(vertices_triangle_two));
+	Vao trojkat_2(vertices_triangle_two, sizeof(vertices_triangle_two));
 
 	// Element Buffer Object (EBO)
 	// KWADRAT
-	glBindVertexArray(VAOs[2]);
-	glBindBuffer(GL_ARRAY_BUFFER, VBOs[2]);
+	glBindVertexArray(VAOs[1].get());
+	glBindBuffer(GL_ARRAY_BUFFER, VBOs[1].get());
 	glBufferData(GL_ARRAY_BUFFER, sizeof(square), square, GL_STATIC_DRAW);
+	VBOs[1].setBytes(sizeof(square));
 	
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(square), indices_square, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.get());
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_square), indices_square, GL_STATIC_DRAW);
+	EBO.setBytes(sizeof(indices_square));
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
@@ -232,102 +287,199 @@ int main() {
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
 	glEnableVertexAttribArray(2);
 
-	// SZESCIANY
-	glBindVertexArray(VAOs[3]);
-	glBindBuffer(GL_ARRAY_BUFFER, VBOs[3]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
+	// meshes in the Mesh layout share the buffers of a geometry pool and are drawn
+	// with a base vertex, cubes and spheres then need a single VAO
+	GeometryPool geometry(1 << 16, 1 << 18);
 
-	const unsigned positionSize = 3; //x,y,z
-	const unsigned texcoordSize = 2; //u,v
-	const unsigned normalSize = 3; //nx, ny, nz
-	const unsigned vertexSize = positionSize + texcoordSize + normalSize;
-	glVertexAttribPointer(0, positionSize, GL_FLOAT, GL_FALSE, vertexSize * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, texcoordSize, GL_FLOAT, GL_FALSE, vertexSize * sizeof(float), (void*)(positionSize * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, normalSize, GL_FLOAT, GL_FALSE, vertexSize * sizeof(float), (void*)((positionSize+texcoordSize) * sizeof(float)));
-	glEnableVertexAttribArray(2);
-
-	//Vao szescian_light(&VAOs[4], &VBOs[4], naked_cube, sizeof(naked_cube));
-
-	Shader ourShader("primary.vert", "yellow.frag");
-	Shader TriShader("primary.vert", "orange.frag");
-	Shader SquareShader("square.vert", "square.frag");
-	Shader CubeShader("cube.vert", "cube.frag");
-	Shader LightShader("light_cube.vert", "light_cube.frag");
-	SquareShader.use();
-	SquareShader.setInt("texture1", 0);
-	SquareShader.setInt("texture2", 1);
+	// SZESCIANY - welded to 24 vertices and indexed
+	Mesh cubeMesh = Mesh::fromTriangleList(Cube::vertices, Cube::vertexCount);
+	optimizeMesh(cubeMesh);
+	const unsigned int cubeGeometry = geometry.add(cubeMesh.vertices.data(), cubeMesh.vertexCount(),
+		cubeMesh.indices.data(), (unsigned int)cubeMesh.indices.size());
 
+	// KULE - icospheres, the simplified LODs share the vertices. Cooked into
+	// sphere.mesh on the first run, later runs map the file straight into the pool.
+	MappedMesh sphere;
+	if (!sphere.open("sphere.mesh"))
+	{
+		Mesh icosphere = Mesh::icosphere(4);
+		buildLods(icosphere, 5);
+		MeshStats sphereStats = analyzeMesh(icosphere);
+		optimizeMesh(icosphere);
+		MeshStats sphereOptimized = analyzeMesh(icosphere);
+		LOG_INFO("sphere mesh: ACMR " << sphereStats.acmr << " -> " << sphereOptimized.acmr
+			<< ", ATVR " << sphereStats.atvr << " -> " << sphereOptimized.atvr
+			<< ", overdraw " << sphereStats.overdraw << " -> " << sphereOptimized.overdraw);
+		if (!cookMesh(icosphere, "sphere.mesh") || !sphere.open("sphere.mesh"))
+			return -1;
+	}
+	const unsigned int sphereGeometry = geometry.add(sphere.vertices(), sphere.header().vertexCount,
+		sphere.indices(), sphere.header().indexCount);
+	sphere.close();
+
+	std::vector<glm::vec3> spherePositions;
+	const int sphereFieldSize = 24;
+	for (int x = 0; x < sphereFieldSize; x++)
+		for (int z = 0; z < sphereFieldSize; z++)
+			spherePositions.push_back(glm::vec3((x - sphereFieldSize / 2) * 2.5f, -4.0f, -z * 2.5f));
+	std::vector<LodState> sphereLods(spherePositions.size(), LodState{ 0, 0, 1.0f });
+
+	// PODLOGA - a quad under the spheres, textured from a virtual texture
+	const float groundVertices[] = {
+		-40.0f, -5.0f, 10.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+		40.0f, -5.0f, 10.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+		40.0f, -5.0f, -70.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+		-40.0f, -5.0f, -70.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+	};
+	const unsigned int groundIndices[] = { 0, 1, 2, 0, 2, 3 };
+	const MeshLod groundLod = { 0, 6, 0.0f };
+	const unsigned int groundGeometry = geometry.add(groundVertices, 4, groundIndices, 6);
+
+	//Vao szescian_light(Cube::positions, sizeof(Cube::positions));
+
+	Shader ourShader("mesh.vert", "yellow.frag", { "VERTEX_COLOR" });
+	Shader TriShader("mesh.vert", "orange.frag", { "VERTEX_COLOR" });
+	std::vector<std::string> squareDefines = { "VERTEX_COLOR", "TRANSFORM", "MATERIALS" };
+	if (bindless)
+		squareDefines.push_back("BINDLESS");
+	Shader SquareShader("mesh.vert", "square.frag", squareDefines);
+	Shader CubeShader("mesh.vert", "cube.frag", { "TRANSFORM" });
+	Shader groundShader("mesh.vert", "ground.frag", { "TRANSFORM" });
+	Shader groundFeedbackShader("mesh.vert", "ground.frag", { "TRANSFORM", "FEEDBACK" });
+	// cubes and spheres, forward or into the G-buffer, and the deferred lighting pass
+	ShaderVariants sceneShaders("mesh.vert", "light_cube.frag");
+	ShaderVariants deferredShaders("deferred_light.vert", "deferred_light.frag");
+	const unsigned int sceneBase = sceneShaders.mask({ "TRANSFORM", "NORMALS" });
+	const unsigned int lodFadeKeyword = sceneShaders.keyword("LOD_FADE");
+	const unsigned int gbufferKeyword = sceneShaders.keyword("GBUFFER");
+	// edited shader sources are recompiled between frames
+	ShaderWatcher shaderWatcher;
+	shaderWatcher.add(ourShader);
+	shaderWatcher.add(TriShader);
+	shaderWatcher.add(SquareShader);
+	shaderWatcher.add(CubeShader);
+	shaderWatcher.add(groundShader);
+	shaderWatcher.add(groundFeedbackShader);
+	shaderWatcher.add(sceneShaders);
+	shaderWatcher.add(deferredShaders);
 	CubeShader.use();
 	CubeShader.setInt("texture1", 0);
 	CubeShader.setInt("texture2", 1);
 
-	LightShader.use();
-	LightShader.setInt("texture1", 0);
-	LightShader.setInt("texture2", 1);
-
 	float timeValue;
 	float greenValue;
 	int vertexColorLocation;
 
-	unsigned int texture[2]; 
-	glGenTextures(2, texture);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
+	// the square's textures are layers of one texture array, a material picks two
+	// of them and a tint. Both images are 512x512, so every material is one batch.
+	MaterialLibrary materials;
 	stbi_set_flip_vertically_on_load(true);
+	auto loadTexture = [&materials](const char* path) {
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(path, &width, &height, &channels, 4);
+		if (!pixels) {
+			LOG_ERROR("Failed to load texture");
+			const unsigned char white[4] = { 255, 255, 255, 255 };
+			return materials.addTexture(white, 1, 1);
+		}
+		unsigned int texture = materials.addTexture(pixels, width, height);
+		stbi_image_free(pixels);
+		return texture;
+	};
+	const unsigned int deski = loadTexture("container.jpg");
+	const unsigned int awesomeface = loadTexture("awesomeface.png");
 
-	int width, height, nrChannels;
-	unsigned char* deski = stbi_load("container.jpg", &width, &height, &nrChannels, 0);
-
-	if (deski)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, deski);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
+	// a row of squares drawn instanced, each with its own material
+	struct SquareInstance
 	{
-		cout << "Failed to load texture" << endl;
-	}
-
-	stbi_image_free(deski);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, texture[1]);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	
-	int width2, height2, nrChannels2;
-	unsigned char* awesomeface = stbi_load("awesomeface.png", &width2, &height2, &nrChannels2, 0);
+		glm::vec3 offset;
+		int material;
+	};
+	std::vector<SquareInstance> squareInstances = {
+		{ glm::vec3(0.0f, 0.0f, 0.0f), (int)materials.addMaterial(deski, awesomeface) },
+		{ glm::vec3(-1.2f, 0.0f, 0.0f), (int)materials.addMaterial(awesomeface, deski) },
+		{ glm::vec3(1.2f, 0.0f, 0.0f), (int)materials.addMaterial(deski, deski, glm::vec4(1.0f, 0.6f, 0.3f, 1.0f)) },
+		{ glm::vec3(-2.4f, 0.0f, 0.0f), (int)materials.addMaterial(awesomeface, awesomeface, glm::vec4(0.5f, 0.8f, 1.0f, 1.0f)) },
+		{ glm::vec3(2.4f, 0.0f, 0.0f), (int)materials.addMaterial(deski, awesomeface, glm::vec4(0.6f, 1.0f, 0.6f, 1.0f)) },
+	};
+	materials.create(bindless, cpuMips);
 
-	if (awesomeface)
+	// the ground's 4096^2 texture, with its mips 85 mb, streams through a cache of
+	// 12x12 pages of 128^2. Cooked into ground.vt on the first run from the
+	// container texture tiled and tinted, so no two pages look the same.
+	VirtualTexture groundTexture(12, 8);
+	if (!groundTexture.open("ground.vt"))
 	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width2, height2, 0, GL_RGBA, GL_UNSIGNED_BYTE, awesomeface);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		const int groundSize = 4096;
+		int width, height, channels;
+		unsigned char* tile = stbi_load("container.jpg", &width, &height, &channels, 4);
+		std::vector<unsigned char> groundPixels((size_t)groundSize * groundSize * 4, 255);
+		for (int y = 0; y < groundSize; y++)
+			for (int x = 0; x < groundSize; x++)
+			{
+				unsigned char* texel = &groundPixels[((size_t)y * groundSize + x) * 4];
+				const float tint[3] = { 0.6f + 0.4f * x / groundSize, 0.6f + 0.4f * y / groundSize,
+					0.8f + 0.2f * sin(x * 0.003f + y * 0.002f) };
+				for (int c = 0; c < 3; c++)
+				{
+					float value = tile ? tile[((y % height) * width + x % width) * 4 + c] : 255.0f;
+					texel[c] = (unsigned char)(value * tint[c]);
+				}
+			}
+		if (tile)
+			stbi_image_free(tile);
+		else
+			LOG_ERROR("Failed to load texture");
+		if (!cookVirtualTexture(groundPixels.data(), groundSize, 128, 4, "ground.vt") || !groundTexture.open("ground.vt"))
+			return -1;
 	}
-	else
+	groundTexture.create(8);
+
+	// instances sorted by batch, a batch is one instanced draw: everything with
+	// bindless, the materials of one texture array otherwise
+	std::stable_sort(squareInstances.begin(), squareInstances.end(), [&materials](const SquareInstance& a, const SquareInstance& b) {
+		return materials.batchOf(a.material) < materials.batchOf(b.material);
+	});
+	struct SquareBatch
 	{
-		cout << "Failed to load texture" << endl;
+		unsigned int batch, first, count;
+	};
+	std::vector<SquareBatch> squareBatches;
+	for (unsigned int i = 0; i < squareInstances.size(); i++) {
+		unsigned int batch = materials.batchOf(squareInstances[i].material);
+		if (squareBatches.empty() || squareBatches.back().batch != batch)
+			squareBatches.push_back(SquareBatch{ batch, i, 0 });
+		squareBatches.back().count++;
 	}
-
-	stbi_image_free(awesomeface);
-
-	SquareShader.setFloat("mixer", 0.2f);
+	BufferHandle squareInstanceBuffer = BufferHandle::create();
+	glBindVertexArray(VAOs[1].get());
+	glBindBuffer(GL_ARRAY_BUFFER, squareInstanceBuffer.get());
+	glBufferData(GL_ARRAY_BUFFER, squareInstances.size() * sizeof(SquareInstance), squareInstances.data(), GL_STATIC_DRAW);
+	squareInstanceBuffer.setBytes(squareInstances.size() * sizeof(SquareInstance));
+	// without a base instance in GL 3.3 a batch moves the attribute offsets instead
+	auto pointSquareInstances = [](unsigned int first) {
+		const size_t base = first * sizeof(SquareInstance);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(SquareInstance), (void*)(base + offsetof(SquareInstance, offset)));
+		glVertexAttribIPointer(4, 1, GL_INT, sizeof(SquareInstance), (void*)(base + offsetof(SquareInstance, material)));
+	};
+	pointSquareInstances(0);
+	glEnableVertexAttribArray(3);
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(4);
+	glVertexAttribDivisor(4, 1);
+	glBindVertexArray(0);
+
+	// the matrices below go to the current program
+	SquareShader.use();
+	SquareShader.setFloat("mixer", mixerValue);
+	// what the shader has, compared instead of reading the uniform back
+	float squareMixer = mixerValue;
 
 	glm::mat4 trans2 = glm::mat4(1.0f);
 	trans2 = glm::scale(trans2, glm::vec3(0.5, 0.5, 0.5)); // kolejnosc poprawna?
 	trans2 = glm::rotate(trans2, glm::radians(90.0f), glm::vec3(0.0, 0.0, 1.0));
 	
-	unsigned int transformLoc = glGetUniformLocation(SquareShader.ID, "transform");
+	unsigned int transformLoc = SquareShader.location("transform");
 	glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(trans2));
 
 	glm::mat4 model_matrix = glm::mat4(1.0f);
@@ -337,93 +489,525 @@ int main() {
 	glm::mat4 projection_matrix;
 	projection_matrix = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
 
-	unsigned int modelLoc = glGetUniformLocation(SquareShader.ID, "model");
+	unsigned int modelLoc = SquareShader.location("model");
 	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model_matrix));
-	unsigned int viewLoc = glGetUniformLocation(SquareShader.ID, "view");
+	unsigned int viewLoc = SquareShader.location("view");
 	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view_matrix));
-	unsigned int projectionLoc = glGetUniformLocation(SquareShader.ID, "projection");
+	unsigned int projectionLoc = SquareShader.location("projection");
 	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection_matrix));	
 
-	LightShader.setMat4("projection", projection_matrix);
-	LightShader.setVec3("lightDir", glm::vec3(-1.f, -1.f, -1.f));
+	const glm::vec3 lightDir(-1.f, -1.f, -1.f);
+	// 1024^2 per cascade up to 60 units, the spheres are static casters and the rotating cubes dynamic
+	CascadedShadows shadows(cascadeCount, 1024, 60.0f);
+	shadows.createTargets();
+	const unsigned int shadowLod = sphere.lods.size() > 1 ? 1 : 0;
+	GBuffer gbuffer;
+	VertexArrayHandle fullscreenVAO = VertexArrayHandle::create();
 
 	glEnable(GL_DEPTH_TEST);
 
+	// occlusion culling of the cubes against a 256x192 CPU depth pyramid
+	OcclusionCuller culler(256, 192);
+	culler.setViewport(800, 600);
+	const unsigned int maxOccluders = 32;
+	const float occluderCoverage = 0.01f;
+	std::vector<glm::mat4> cubeModels(cubePositions.size());
+	std::vector<glm::mat3> cubeNormals(cubePositions.size());
+	std::vector<glm::vec3> cubeBoundsMin(cubePositions.size()), cubeBoundsMax(cubePositions.size());
+	double lastStatsTime = 0.0;
+
+	// point lights drifting over the cube and sphere fields
+	std::vector<PointLight> lights(lightCount), lightBase(lightCount);
+	for (unsigned int i = 0; i < lightCount; i++) {
+		float hue = i * 0.618034f;
+		lightBase[i].position = glm::vec3((rand() / (float)RAND_MAX - 0.5f) * 60.0f, -5.0f + rand() / (float)RAND_MAX * 8.0f, 2.0f - rand() / (float)RAND_MAX * 70.0f);
+		lightBase[i].radius = 2.0f + rand() / (float)RAND_MAX * 2.0f;
+		lightBase[i].color = glm::clamp(glm::abs(glm::fract(glm::vec3(hue, hue + 0.333f, hue + 0.667f)) * 6.0f - 3.0f) - 1.0f, 0.0f, 1.0f);
+		lightBase[i].intensity = 1.5f;
+	}
+	// the colour, the square, the cubes and the lights move in fixed steps of
+	// simulated time, --sim-rate steps per second, on a thread with --sim-thread
+	Simulation simulation(1.0 / simulationRate, lightCount, simulationThread);
+	ClusteredLights clusteredLights(projection_matrix, 0.1f, 100.0f);
+	clusteredLights.createBuffers();
+
+	// fadeTime = 0 switches levels without the dithered crossfade
+	LodSelector lodSelector(600.0f, glm::radians(45.0f));
+	unsigned int lodTriangles = 0, fullTriangles = 0;
+
+	// per pass CPU and GPU times, --trace writes the last frames as a Chrome trace on exit
+	Profiler profiler;
+	profiler.createQueries();
+	// INSTRUMENT_SCOPE events of every thread, drained once per frame
+	InstrumentCollector instrumentCollector;
+	// draw calls, triangles, state changes and uploads per frame on screen, --metrics writes
+	// them every second as CSV (a .csv path) or JSON lines
+	FrameMetrics frameMetrics;
+	MetricsReport metricsReport = MetricsReport();
+	std::unique_ptr<MetricsExporter> metricsExporter;
+	if (!metricsPath.empty())
+		metricsExporter.reset(new MetricsExporter(metricsPath));
+	TextOverlay overlay;
+	overlay.create();
+	std::vector<PassTiming> timings;
+	// transient data of a frame: culling results, the render queue, overlay text.
+	// --zero-alloc reports every frame that still touches the heap once the trace rings are full.
+	FrameArena frameArena(1 << 20);
+	unsigned int frameCount = 0;
+	// --inject-input N presses the mixer keys N times a second from a thread of its own, the
+	// frames then wait for the GPU and the input latency runs to the finished frame
+	InputStats inputReport = input.stats();
+	std::atomic<bool> injecting(injectRate > 0.0);
+	std::thread injector;
+	if (injecting)
+		injector = std::thread(injectInput, std::ref(input), injectRate, std::cref(injecting));
 
 	while (!glfwWindowShouldClose(window))
 	{
-		processInput(window, &SquareShader);
-
-
+		frameArena.beginFrame();
+		profiler.beginFrame();
+		unsigned int framePass = profiler.begin("frame");
+		shaderWatcher.update();
+		// the one clock sample of the frame
+		const double now = glfwGetTime();
+		deltaTime = (float)(now - lastFrame);
+		lastFrame = now;
+		processInput(window, input);
+		unsigned int pass = profiler.begin("simulation", false);
+		simulation.advance(now);
+		const SimulationState& scene = simulation.state();
+		profiler.end(pass);
+
+
+		pass = profiler.begin("triangles and square");
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	
 		TriShader.use();
-		glBindVertexArray(VAOs[0]);
+		glBindVertexArray(VAOs[0].get());
 		glDrawArrays(GL_TRIANGLES, 0, 3);
 
-		timeValue = glfwGetTime();
+		timeValue = (float)scene.time;
 		greenValue = (sin(timeValue) / 2.0f) + 0.5f;
 
 		ourShader.use();
 		ourShader.setColor("ourColor", 0.0f, greenValue, 0.0f);
 
-		glBindVertexArray(VAOs[1]);
+		trojkat_2.bind();
 		glDrawArrays(GL_TRIANGLES, 0, 3);
 
 		SquareShader.use();
 		SquareShader.setColor("ourColor", 1.0f, 0.0f, 0.0f);
+		if (squareMixer != mixerValue) {
+			SquareShader.setFloat("mixer", mixerValue);
+			squareMixer = mixerValue;
+		}
 
 
 		glm::mat4 trans2 = glm::mat4(1.0f);
 		trans2 = glm::translate(trans2, glm::vec3(0.5f, -0.5f, 0.0f));
-		trans2 = glm::rotate(trans2, (float)glfwGetTime(), glm::vec3(0.0, 0.0, 1.0));
+		trans2 = glm::rotate(trans2, scene.spin, glm::vec3(0.0, 0.0, 1.0));
 
-		transformLoc = glGetUniformLocation(SquareShader.ID, "transform");
+		transformLoc = SquareShader.location("transform");
 		//glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(trans2));
 		
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture[0]);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, texture[1]);
-
-		glBindVertexArray(VAOs[2]); // kwadrat
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+		glBindVertexArray(VAOs[1].get()); // kwadrat
+		glBindBuffer(GL_ARRAY_BUFFER, squareInstanceBuffer.get());
+		for (const SquareBatch& batch : squareBatches) {
+			materials.bind(SquareShader, 0, batch.batch);
+			if (squareBatches.size() > 1)
+				pointSquareInstances(batch.first);
+			glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, batch.count);
+		}
 		glBindVertexArray(0);
-
-		LightShader.use();
+		profiler.end(pass);
+
+		// forward shades the cubes and spheres directly, deferred writes them to the G-buffer.
+		// The depth pre-pass variant has no lighting and the cube one no LOD dither, so
+		// neither discards and both keep early-z.
+		bool shadowsActive = lightingTerms[0] && lightingTerms[4];
+		unsigned int lightingMask = 0, deferredMask = 0;
+		for (int k = 0; k < lightingTermCount; k++) {
+			if (!lightingTerms[k] || (k == 4 && !shadowsActive))
+				continue;
+			lightingMask |= sceneShaders.keyword(lightingKeywords[k]);
+			deferredMask |= deferredShaders.keyword(lightingKeywords[k]);
+		}
+		Shader& depthShader = sceneShaders.get(sceneBase);
+		Shader& cubeShader = sceneShaders.get(sceneBase | (deferredShading ? gbufferKeyword : lightingMask));
+		Shader& fadeShader = sceneShaders.get(sceneBase | lodFadeKeyword | (deferredShading ? gbufferKeyword : lightingMask));
 		//CubeShader.use();
-		glBindVertexArray(VAOs[3]); // szescian
+		geometry.bind(cubeGeometry); // szescian
 		glm::mat4 view;
 		//view = glm::lookAt(glm::vec3(camX, 0.0f, camZ), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 		CubeShader.setMat4("view", view);
-		LightShader.setMat4("view", view);
-		LightShader.setVec3("eyePos", cameraPos);
 
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		pass = profiler.begin("lights", false);
+		for (unsigned int i = 0; i < lightCount; i++) {
+			lights[i] = lightBase[i];
+			lights[i].position += scene.lights[i];
+		}
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		clusteredLights.assign(lights, view);
+		clusteredLights.upload(lights);
+		profiler.end(pass);
+		// the G-buffer only exists while the deferred path is on
+		if (deferredShading)
+			gbuffer.resize(framebufferWidth, framebufferHeight);
+		else
+			gbuffer.releaseTargets();
+
+		// the ground with the pages resident now, then the pages it wants for a
+		// later frame into the feedback target
+		pass = profiler.begin("virtual texture");
+		groundTexture.update();
+		geometry.bind(groundGeometry);
+		groundShader.use();
+		groundShader.setMat4("model", glm::mat4(1.0f));
+		groundShader.setMat4("view", view);
+		groundShader.setMat4("projection", projection_matrix);
+		groundTexture.bind(groundShader, 9, false);
+		geometry.draw(groundGeometry, groundLod);
+		groundTexture.beginFeedback(framebufferWidth, framebufferHeight);
+		groundFeedbackShader.use();
+		groundFeedbackShader.setMat4("model", glm::mat4(1.0f));
+		groundFeedbackShader.setMat4("view", view);
+		groundFeedbackShader.setMat4("projection", projection_matrix);
+		groundTexture.bind(groundFeedbackShader, 9, true);
+		geometry.draw(groundGeometry, groundLod);
+		groundTexture.endFeedback();
+		glViewport(0, 0, framebufferWidth, framebufferHeight);
+		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		geometry.bind(cubeGeometry);
+		profiler.end(pass);
 		
-		for (int i = 0; i < 10; i++) {
-			glm::mat4 model_matrix = glm::mat4(1.0f);
-			model_matrix = glm::translate(model_matrix, cubePositions[i]);
-			float angle = 20.0f * i;
-			model_matrix = glm::rotate(model_matrix, (float)glfwGetTime() * 0.1f * glm::radians(angle),
-				glm::vec3(0.5f, 1.0f, 0.0f));
-			//glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model_matrix));
-			LightShader.setMat4("model", model_matrix);
-
-			glDrawArrays(GL_TRIANGLES, 0, 36);
+		pass = profiler.begin("culling", false);
+		culler.beginFrame(projection_matrix * view);
+		ArenaArray<unsigned int> occluders = frameArena.array<unsigned int>(maxOccluders);
+		{
+			INSTRUMENT_SCOPE("cube matrices");
+			for (size_t i = 0; i < cubePositions.size(); i++) {
+				glm::mat4 model_matrix = glm::mat4(1.0f);
+				model_matrix = glm::translate(model_matrix, cubePositions[i]);
+				float angle = 20.0f * (i % 10);
+				model_matrix = glm::rotate(model_matrix, scene.spin * 0.1f * glm::radians(angle),
+					glm::vec3(0.5f, 1.0f, 0.0f));
+				cubeModels[i] = model_matrix;
+				OcclusionCuller::transformAabb(model_matrix, glm::vec3(-0.5f), glm::vec3(0.5f), cubeBoundsMin[i], cubeBoundsMax[i]);
+
+				if (occluders.size() < maxOccluders && culler.screenCoverage(cubeBoundsMin[i], cubeBoundsMax[i]) >= occluderCoverage) {
+					culler.addOccluder(Cube::positions, Cube::vertexCount, 3, model_matrix);
+					occluders.push_back((unsigned int)i);
+				}
+			}
+		}
+		culler.buildHiZ();
+		computeNormalMatrices(cubeModels.data(), cubeNormals.data(), cubeModels.size());
+
+		// render queue of what survived culling, spheres in the middle of a LOD crossfade separately
+		ArenaArray<DrawItem> cubeQueue = frameArena.array<DrawItem>(cubePositions.size());
+		ArenaArray<DrawItem> sphereQueue = frameArena.array<DrawItem>(spherePositions.size());
+		ArenaArray<DrawItem> fadingQueue = frameArena.array<DrawItem>(spherePositions.size());
+		lodTriangles = fullTriangles = 0;
+		{
+			INSTRUMENT_SCOPE("render queue");
+			for (size_t i = 0; i < cubePositions.size(); i++) {
+				if (!culler.isVisible(cubeBoundsMin[i], cubeBoundsMax[i]))
+					continue;
+				DrawItem item = { cubeModels[i], cubeNormals[i], 0, 0, 1.0f };
+				cubeQueue.push_back(item);
+			}
+			for (size_t i = 0; i < spherePositions.size(); i++) {
+				LodState& lod = sphereLods[i];
+				lodSelector.update(lod, sphere.lods, glm::length(spherePositions[i] - cameraPos), deltaTime);
+				if (!culler.isVisible(spherePositions[i] + sphere.boundsMin, spherePositions[i] + sphere.boundsMax))
+					continue;
+
+				fullTriangles += sphere.lods[0].indexCount / 3;
+				lodTriangles += sphere.lods[lod.lod].indexCount / 3;
+				// translation only, the normal matrix is the identity
+				DrawItem item = { glm::translate(glm::mat4(1.0f), spherePositions[i]), glm::mat3(1.0f), lod.lod, lod.previousLod, lod.fade };
+				if (lod.fade < 1.0f) {
+					fadingQueue.push_back(item);
+					lodTriangles += sphere.lods[lod.previousLod].indexCount / 3;
+				}
+				else
+					sphereQueue.push_back(item);
+			}
+		}
+		profiler.end(pass);
+
+		// shadow pass, a cascade renders its static casters only when it moved
+		if (shadowsActive) {
+			pass = profiler.begin("shadows");
+			shadows.update(view, glm::radians(45.0f), 800.0f / 600.0f, 0.1f, lightDir);
+			depthShader.use();
+			depthShader.setMat4("view", shadows.getLightView());
+			for (int c = 0; c < shadows.getCascadeCount(); c++) {
+				unsigned int drawCalls = 0;
+				depthShader.setMat4("projection", shadows.getProjection(c));
+				shadows.beginCascade(c);
+				if (shadows.beginStatic(c)) {
+					geometry.bind(sphereGeometry);
+					for (size_t i = 0; i < spherePositions.size(); i++) {
+						if (!shadows.casterVisible(c, spherePositions[i] + sphere.boundsMin, spherePositions[i] + sphere.boundsMax))
+							continue;
+						depthShader.setMat4(modelUniform, glm::translate(glm::mat4(1.0f), spherePositions[i]));
+						geometry.draw(sphereGeometry, sphere.lods[shadowLod]);
+						drawCalls++;
+					}
+				}
+				ArenaArray<unsigned int> dynamicCasters = frameArena.array<unsigned int>(cubePositions.size());
+				for (size_t i = 0; i < cubePositions.size(); i++)
+					if (shadows.casterVisible(c, cubeBoundsMin[i], cubeBoundsMax[i]))
+						dynamicCasters.push_back((unsigned int)i);
+				if (shadows.beginDynamic(c, !dynamicCasters.empty())) {
+					geometry.bind(cubeGeometry);
+					for (unsigned int i : dynamicCasters) {
+						depthShader.setMat4(modelUniform, cubeModels[i]);
+						geometry.draw(cubeGeometry, cubeMesh.lods[0]);
+						drawCalls++;
+					}
+				}
+				shadows.endCascade(c, drawCalls);
+			}
+			shadows.endShadowPass();
+			geometry.bind(cubeGeometry);
+			profiler.end(pass);
+		}
+		glViewport(0, 0, framebufferWidth, framebufferHeight);
+		if (deferredShading) {
+			gbuffer.bindForWriting();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
+
+		// every variant is its own program with its own uniforms, a freshly compiled
+		// one only has the defaults
+		Shader* sceneVariants[3] = { &depthShader, &cubeShader, &fadeShader };
+		for (Shader* shader : sceneVariants) {
+			shader->use();
+			shader->setMat4("projection", projection_matrix);
+			shader->setMat4("view", view);
+			shader->setVec3("eyePos", cameraPos);
+			shader->setVec3("lightDir", lightDir);
+			if (!deferredShading)
+				clusteredLights.bind(*shader, 2, framebufferWidth, framebufferHeight);
+			if (shadowsActive && !deferredShading)
+				shadows.bind(*shader, 8);
 		}
 
-		glfwSwapBuffers(window);
+		// depth pre-pass of the occluders, whatever they hide fails early-z in the shaded pass
+		pass = profiler.begin("depth pre-pass");
+		depthShader.use();
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		for (unsigned int i : occluders) {
+			depthShader.setMat4(modelUniform, cubeModels[i]);
+			geometry.draw(cubeGeometry, cubeMesh.lods[0]);
+		}
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthFunc(GL_LEQUAL);
+		profiler.end(pass);
+
+		// the pre-pass samples write no colour, only the shaded ones count
+		gbuffer.beginQuery();
+		pass = profiler.begin(deferredShading ? "G-buffer cubes" : "cubes");
+		cubeShader.use();
+		{
+			INSTRUMENT_SCOPE("cube draws");
+			for (const DrawItem& item : cubeQueue) {
+				cubeShader.setMat4(modelUniform, item.model);
+				cubeShader.setMat3(normalMatrixUniform, item.normalMatrix);
+				geometry.draw(cubeGeometry, cubeMesh.lods[0]);
+			}
+		}
+		glDepthFunc(GL_LESS);
+		profiler.end(pass);
+
+		// spheres in the middle of a crossfade go last, with the dithering variant
+		pass = profiler.begin(deferredShading ? "G-buffer spheres" : "spheres");
+		geometry.bind(sphereGeometry); // kule
+		cubeShader.setMat3("normalMatrix", glm::mat3(1.0f)); // translation only
+		{
+			INSTRUMENT_SCOPE("sphere draws");
+			for (const DrawItem& item : sphereQueue) {
+				cubeShader.setMat4(modelUniform, item.model);
+				geometry.draw(sphereGeometry, sphere.lods[item.lod]);
+			}
+		}
+		if (!fadingQueue.empty()) {
+			fadeShader.use();
+			fadeShader.setMat3("normalMatrix", glm::mat3(1.0f));
+		}
+		for (const DrawItem& item : fadingQueue) {
+			fadeShader.setMat4(modelUniform, item.model);
+			// both levels with complementary dither patterns
+			fadeShader.setFloat(lodFadeUniform, item.fade);
+			fadeShader.setBool(lodFadeOutUniform, false);
+			geometry.draw(sphereGeometry, sphere.lods[item.lod]);
+			fadeShader.setBool(lodFadeOutUniform, true);
+			geometry.draw(sphereGeometry, sphere.lods[item.previousLod]);
+		}
+		glBindVertexArray(0);
+		gbuffer.endQuery();
+		profiler.end(pass);
+
+		if (deferredShading) {
+			// lighting pass, depth tested against the forward drawn triangles and square
+			pass = profiler.begin("deferred lighting");
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, framebufferWidth, framebufferHeight);
+			Shader& lightingShader = deferredShaders.get(deferredMask);
+			lightingShader.use();
+			lightingShader.setMat4("inverseProjection", glm::inverse(projection_matrix));
+			lightingShader.setMat4("inverseView", glm::inverse(view));
+			lightingShader.setVec3("eyePos", cameraPos);
+			lightingShader.setVec3("lightDir", lightDir);
+			lightingShader.setInt("gAlbedo", 5);
+			lightingShader.setInt("gNormal", 6);
+			lightingShader.setInt("gDepth", 7);
+			clusteredLights.bind(lightingShader, 2, framebufferWidth, framebufferHeight);
+			if (shadowsActive)
+				shadows.bind(lightingShader, 8);
+			gbuffer.bindTextures(5);
+			glBindVertexArray(fullscreenVAO.get());
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			glBindVertexArray(0);
+			profiler.end(pass);
+		}
+
+		if (now - lastStatsTime >= 1.0) {
+			const OcclusionStats& stats = culler.stats();
+			LOG_INFO("occlusion: " << stats.occluded << "/" << stats.tested << " occluded, " << stats.outsideView
+				<< " outside view, " << stats.occluders << " occluders, ~" << (long)stats.fragmentsSaved << " fragments saved");
+			LOG_INFO("lod: " << lodTriangles << " sphere triangles submitted, " << fullTriangles << " without LOD");
+			const ClusterStats& lightStats = clusteredLights.stats();
+			LOG_INFO("lights: " << lightStats.lights << "/" << lightCount << " in view, " << lightStats.indices << " cluster entries, "
+				<< lightStats.averagePerCluster << " avg / " << lightStats.maxPerCluster << " max per cluster, "
+				<< deltaTime * 1000.0f << " ms frame");
+			unsigned int samples = gbuffer.writtenSamples();
+			if (deferredShading) {
+				// every sample writes all targets, the lighting pass reads all of them once per pixel
+				double written = samples * (double)GBuffer::bytesPerPixel / 1e6;
+				double read = gbuffer.getWidth() * gbuffer.getHeight() * (double)GBuffer::bytesPerPixel / 1e6;
+				LOG_INFO("deferred: " << samples << " G-buffer samples, " << written << " MB written + " << read << " MB read, "
+					<< (written + read) / deltaTime / 1000.0 << " GB/s");
+			}
+			else
+				LOG_INFO("forward: " << samples << " fragments shaded");
+			if (shadowsActive && LOG_ENABLED(LogInfo)) {
+				LogMessage line(LogInfo);
+				line.stream() << "shadows:";
+				for (int c = 0; c < shadows.getCascadeCount(); c++) {
+					const CascadeStats& cascade = shadows.stats(c);
+					line.stream() << " [" << c << "] " << cascade.drawCalls << " draws " << cascade.gpuMilliseconds << " ms"
+						<< (cascade.skipped ? " cached" : cascade.staticCached ? " static cached" : "");
+				}
+			}
+			const VirtualTextureStats& groundStats = groundTexture.stats();
+			LOG_INFO("virtual texture: " << groundStats.requested << " pages wanted, " << groundStats.hitRate * 100.0f << "% resident, "
+				<< groundStats.resident << " in the cache, " << groundStats.pending << " loading, " << groundStats.dropped << " dropped");
+			LOG_INFO("shader variants: " << sceneShaders.compiledCount() + deferredShaders.compiledCount() << " compiled");
+			// averages of the frames read back since the last report, a few frames behind
+			profiler.takeTimings(timings);
+			if (!timings.empty() && LOG_ENABLED(LogInfo)) {
+				LogMessage line(LogInfo);
+				line.stream() << "passes (cpu/gpu ms):";
+				for (const PassTiming& timing : timings)
+					line.stream() << (timing.depth ? ", " : " ") << timing.name << " " << timing.cpuMilliseconds << "/" << timing.gpuMilliseconds;
+				line.stream() << "; " << profiler.droppedFrames() << " frames without GPU times";
+			}
+			inputReport = input.stats();
+			if (inputReport.latencySamples)
+				LOG_INFO("input: " << inputReport.latencySamples << " events, " << inputReport.latencyMilliseconds << " ms mean / "
+					<< inputReport.maxLatencyMilliseconds << " ms max to the end of the frame, " << inputReport.dropped << " dropped");
+			input.resetLatency();
+			if (instrumentCollector.droppedEvents())
+				LOG_INFO("instrumentation: " << instrumentCollector.droppedEvents() << " events dropped");
+			metricsReport = frameMetrics.report();
+			if (metricsExporter)
+				metricsExporter->push(metricsReport);
+			lastStatsTime = now;
+		}
+
+		{
+			INSTRUMENT_SCOPE("overlay");
+			overlay.clear();
+			overlay.print(frameArena.format("frame %.2f ms  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f", metricsReport.frameMilliseconds,
+				metricsReport.p50, metricsReport.p95, metricsReport.p99, metricsReport.maxMilliseconds));
+			overlay.print(frameArena.format("draws %.0f  triangles %.0f  state changes %.0f", metricsReport.drawCalls,
+				metricsReport.triangles, metricsReport.stateChanges));
+			overlay.print(frameArena.format("uploaded %.1f kb/frame  textures %.1f mb", metricsReport.uploadedBytes / 1024.0,
+				metricsReport.textureBytes / (1024.0 * 1024.0)));
+			overlay.print(frameArena.format("heap allocations %.1f/frame  frame arena %.1f/%.0f kb", metricsReport.heapAllocations,
+				frameArena.peak() / 1024.0, frameArena.capacity() / 1024.0));
+			GpuResourceStats gpuStats = gpuResources().stats();
+			unsigned int gpuObjects = 0;
+			for (unsigned int live : gpuStats.live)
+				gpuObjects += live;
+			overlay.print(frameArena.format("gpu objects %u  buffers %.1f kb  textures %.1f mb  pending deletes %u", gpuObjects,
+				gpuStats.bytes[GpuBuffer] / 1024.0, gpuStats.bytes[GpuTexture] / (1024.0 * 1024.0), gpuStats.pendingDeletes));
+			GeometryPoolStats geometryStats = geometry.stats();
+			overlay.print(frameArena.format("geometry %u meshes in %u buffers (%u one per mesh)  fragmentation %.0f%%",
+				geometryStats.meshes, geometryStats.buffers, geometryStats.buffersPerMesh, geometryStats.fragmentation * 100.0f));
+			AtlasStats glyphStats = overlay.atlasStats();
+			overlay.print(frameArena.format("glyph atlas %u images %.0f%% full  pack %.1f us", glyphStats.images,
+				glyphStats.occupancy * 100.0f, glyphStats.packMicroseconds));
+			const VirtualTextureStats& groundStats = groundTexture.stats();
+			overlay.print(frameArena.format("virtual texture %u pages  hit %.0f%%  streamed %u/frame  resident %.1f/%.1f mb of %.0f mb",
+				groundStats.requested, groundStats.hitRate * 100.0f, groundStats.streamed, groundStats.residentBytes / (1024.0 * 1024.0),
+				groundStats.cacheBytes / (1024.0 * 1024.0), groundStats.virtualBytes / (1024.0 * 1024.0)));
+			const SimulationStats& simulationStats = simulation.stats();
+			overlay.print(frameArena.format("simulation %.0f Hz%s  %u steps  alpha %.2f  %.1f us/step  %u dropped", 1.0 / simulation.getStep(),
+				simulationStats.threaded ? " threaded" : "", simulationStats.steps, simulationStats.alpha, simulationStats.stepMicroseconds,
+				simulationStats.dropped));
+			overlay.print(frameArena.format("input %u events/s  latency %.1f ms  max %.1f  %llu dropped%s", inputReport.latencySamples,
+				inputReport.latencyMilliseconds, inputReport.maxLatencyMilliseconds, inputReport.dropped, injecting ? "  injected" : ""));
+			overlay.print(frameArena.format("camera %.2f, %.2f, %.2f  mixer %.3f", cameraPos.x, cameraPos.y, cameraPos.z, mixerValue),
+				glm::vec4(1.0f, 0.9f, 0.5f, 1.0f));
+			overlay.draw(framebufferWidth, framebufferHeight);
+		}
+
+		pass = profiler.begin("swap", false);
+		{
+			INSTRUMENT_SCOPE("swap");
+			glfwSwapBuffers(window);
+			if (injecting)
+				glFinish();
+		}
+		profiler.end(pass);
+		input.framePresented();
 		glfwPollEvents();
+		profiler.end(framePass);
+		profiler.endFrame();
+		gpuResources().endFrame();
+		// holes left by removed meshes close a bounded amount per frame
+		geometry.defragment(256 * 1024);
+		instrumentCollector.collectFrame();
+		frameMetrics.endFrame();
+		const FrameCounters& frameCounters = frameMetrics.lastFrame();
+		if (zeroAllocations && ++frameCount > Profiler::MaxHistory && (frameCounters.heapAllocations || frameArena.overflows()))
+			LOG_ERROR("ERROR::FRAME::HEAP_ALLOCATIONS " << frameCounters.heapAllocations << " heap allocations, "
+				<< frameArena.overflows() << " frame arena overflows");
 	}
 
-	glDeleteVertexArrays(2, VAOs);
-	glDeleteBuffers(2, VBOs);
+	injecting = false;
+	if (injector.joinable())
+		injector.join();
+	if (!tracePath.empty() && profiler.writeChromeTrace(tracePath, &instrumentCollector))
+		LOG_INFO("trace written to " << tracePath);
+
+	clusteredLights.deleteBuffers();
+	gbuffer.release();
+	shadows.release();
+	profiler.release();
+	overlay.release();
+	materials.release();
+	groundTexture.release();
+	// the handles still in scope and every program go with the context
+	gpuResources().shutdown();
 
 	glfwTerminate();
 	return 0;
@@ -434,40 +1018,67 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
-void processInput(GLFWwindow* window, Shader* shader) 
+void processInput(GLFWwindow* window, Input& input)
 {
-	const float cameraSpeed = 8.0f * deltaTime;
-	float current_val;
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) 
+	INSTRUMENT_SCOPE("input");
+	input.update();
+	// every action on its own, any number of keys at once. Toggles flip once per press, a
+	// tap within a frame still counts and two cancel out.
+	if (input.pressed(ActionQuit))
 		glfwSetWindowShouldClose(window, true);
-	else if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-		glGetUniformfv(shader->ID, glGetUniformLocation(shader->ID, "mixer"), &current_val);
-		shader->setFloat("mixer", current_val + 0.001f);
-		if (current_val >= 1.0f)
-			shader->setFloat("mixer", 1.0f);
-		cout << current_val << endl;
+	if (input.pressed(ActionDeferred) % 2) {
+		deferredShading = !deferredShading;
+		LOG_INFO((deferredShading ? "deferred shading" : "forward shading"));
 	}
-	else if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-		glGetUniformfv(shader->ID, glGetUniformLocation(shader->ID, "mixer"), &current_val);
-		shader->setFloat("mixer", current_val - 0.001f);
-		if (current_val <= 0.0f)
-			shader->setFloat("mixer", 0.0f);
-		cout << current_val << endl;
+	for (int k = 0; k < lightingTermCount; k++) {
+		if (input.pressed(ActionLightingTerm + k) % 2) {
+			lightingTerms[k] = !lightingTerms[k];
+			LOG_INFO(lightingKeywords[k] << (lightingTerms[k] ? " on" : " off"));
+		}
 	}
-	else if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-		cameraPos += cameraSpeed * cameraFront;
-		cout << cameraPos.x << ", " << cameraPos.y << ", " << cameraPos.z << endl;
+	if (input.held(ActionMixerUp) || input.pressed(ActionMixerUp))
+		mixerValue = std::min(mixerValue + 0.001f, 1.0f);
+	if (input.held(ActionMixerDown) || input.pressed(ActionMixerDown))
+		mixerValue = std::max(mixerValue - 0.001f, 0.0f);
+
+	if (input.held(ActionLook)) {
+		glm::vec2 turn = input.cursorDelta() * 0.1f;
+		cameraYaw += turn.x;
+		cameraPitch = glm::clamp(cameraPitch - turn.y, -89.0f, 89.0f);
+		cameraFront = glm::vec3(cos(glm::radians(cameraYaw)) * cos(glm::radians(cameraPitch)), sin(glm::radians(cameraPitch)),
+			sin(glm::radians(cameraYaw)) * cos(glm::radians(cameraPitch)));
 	}
-	else if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-		cameraPos -= cameraSpeed * cameraFront;
-		cout << cameraPos.x << ", " << cameraPos.y << ", " << cameraPos.z << endl;
+	// diagonals as fast as straight on
+	glm::vec3 cameraRight = glm::normalize(glm::cross(cameraFront, cameraUp));
+	glm::vec3 move(0.0f);
+	if (input.held(ActionForward))
+		move += cameraFront;
+	if (input.held(ActionBack))
+		move -= cameraFront;
+	if (input.held(ActionLeft))
+		move -= cameraRight;
+	if (input.held(ActionRight))
+		move += cameraRight;
+	if (glm::dot(move, move) > 0.0f)
+		cameraPos += glm::normalize(move) * 8.0f * deltaTime;
+}
+
+// the mixer keys pressed and released rate times a second, the latency measurement of --inject-input
+void injectInput(Input& input, double rate, const std::atomic<bool>& running)
+{
+	INSTRUMENT_THREAD("input injector");
+	const std::chrono::duration<double> half(0.5 / rate);
+	for (unsigned int n = 0; running; n++) {
+		// up and down by turns, the mixer stays in range
+		InputEvent event = { InputKey, (n / 100) % 2 ? GLFW_KEY_DOWN : GLFW_KEY_UP, GLFW_PRESS, 0.0, 0.0, Input::now() };
+		input.push(event);
+		std::this_thread::sleep_for(half);
+		event.action = GLFW_RELEASE;
+		event.time = Input::now();
+		input.push(event);
+		std::this_thread::sleep_for(half);
 	}
-	else if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-		cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
-	}else if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
 }
-		
 
 void ProgramErrorHandling(PFNGLGETPROGRAMIVPROC GetProgramParameter, GLuint program, int prog_param) {
 	int success;
@@ -476,7 +1087,7 @@ void ProgramErrorHandling(PFNGLGETPROGRAMIVPROC GetProgramParameter, GLuint prog
 	char infoLog[512];
 	if (!success) {
 		glGetProgramInfoLog(program, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::LINKING::COMPILATION_FAILED\n" << infoLog << std::endl;
+		LOG_ERROR("ERROR::SHADER::LINKING::COMPILATION_FAILED\n" << infoLog);
 	}
 }
 
@@ -490,10 +1101,10 @@ void ShaderErrorHandling(PFNGLGETSHADERIVPROC GetShaderParameter, GLuint shader,
 		glGetShaderInfoLog(shader, 512, NULL, infoLog);
 		glGetShaderiv(shader, GL_SHADER_TYPE, &shader_type);
 		if (shader_type == GL_VERTEX_SHADER) {
-			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+			LOG_ERROR("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog);
 		}
 		else if (shader_type == GL_FRAGMENT_SHADER) {
-			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+			LOG_ERROR("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog);
 		}
 	}
 }
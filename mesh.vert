@@ -0,0 +1,79 @@
+#version 330 core
+// Vertex shader of every mesh in the scene.
+// VERTEX_COLOR: position, color, texture coords layout of the triangles and the square
+// TRANSFORM: model, view and projection matrices, otherwise the position is already in clip space
+// NORMALS: position, texture coords, normal layout of Mesh, outputs for the lighting shaders
+// MATERIALS: per instance offset and material index, see MaterialLibrary
+#pragma keywords VERTEX_COLOR TRANSFORM NORMALS MATERIALS
+layout (location = 0) in vec3 aPos;
+#ifdef VERTEX_COLOR
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in vec2 aTexCoord;
+
+out vec3 TriColor;
+out vec4 vertexColor;
+uniform float offset;
+out vec3 verPos;
+#else
+layout (location = 1) in vec2 aTexCoord;
+#endif
+#ifdef NORMALS
+layout (location = 2) in vec3 aNormal;
+
+// transpose(inverse(mat3(model))), computed on the CPU
+uniform mat3 normalMatrix;
+
+out vec3 normal;
+out vec3 position;
+out float viewDepth;
+#endif
+
+out vec2 TexCoord;
+
+#ifdef MATERIALS
+layout (location = 3) in vec3 aOffset;
+layout (location = 4) in int aMaterial;
+
+flat out int materialIndex;
+#endif
+
+#ifdef TRANSFORM
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+#endif
+
+void main()
+{
+#ifdef VERTEX_COLOR
+    vec3 localPosition = vec3(aPos.x + offset, aPos.y, aPos.z);
+    vertexColor = vec4(0.5, 0.0, 0.0, 1.0);
+    TriColor = aColor;
+    verPos = aPos;
+#else
+    vec3 localPosition = aPos;
+#endif
+#ifdef MATERIALS
+    localPosition += aOffset;
+    materialIndex = aMaterial;
+#endif
+
+#ifdef TRANSFORM
+    vec4 worldPosition = model * vec4(localPosition, 1.0);
+    vec4 viewPosition = view * worldPosition;
+    gl_Position = projection * viewPosition;
+#else
+    vec4 worldPosition = vec4(localPosition, 1.0);
+    vec4 viewPosition = worldPosition;
+    gl_Position = worldPosition;
+#endif
+
+#ifdef NORMALS
+    TexCoord = vec2(0.0, 0.0);
+    normal = normalMatrix * aNormal;
+    position = vec3(worldPosition);
+    viewDepth = -viewPosition.z;
+#else
+    TexCoord = aTexCoord;
+#endif
+};
@@ -0,0 +1,16 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+in vec4 Color;
+
+// one bit per texel, the panel behind the text samples a solid glyph
+uniform sampler2D glyphs;
+
+void main()
+{
+    float coverage = texture(glyphs, TexCoord).r;
+    if (coverage < 0.5)
+        discard;
+    FragColor = Color;
+}
@@ -1,15 +1,46 @@
 #version 330 core
+// MATERIALS: two texture layers and a tint per instance from the material buffer, see MaterialLibrary
+// BINDLESS: the material buffer has the texture arrays' ARB_bindless_texture handles, with
+// MATERIALS. The handle differs per instance, which is only defined with NV_gpu_shader5, so
+// MaterialLibrary::loadBindless requires both extensions.
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+#extension GL_NV_gpu_shader5 : require
+#endif
 out vec4 FragColor;
 
 uniform vec4 ourColor;
 in vec2 TexCoord;
 
+#ifdef MATERIALS
+flat in int materialIndex;
+// two texels per material: layers and packed tint, then the handles
+uniform usamplerBuffer materials;
+#ifndef BINDLESS
+uniform sampler2DArray materialArray;
+#endif
+#else
 uniform sampler2D texture1;
 uniform sampler2D texture2;
+#endif
 uniform float mixer;
 
 void main()
 {
+#ifdef MATERIALS
+	uvec4 material = texelFetch(materials, materialIndex * 2);
+	vec4 tint = vec4((material.zzzz >> uvec4(0u, 8u, 16u, 24u)) & 0xffu) / 255.0;
+#ifdef BINDLESS
+	uvec4 handles = texelFetch(materials, materialIndex * 2 + 1);
+	vec4 first = texture(sampler2DArray(handles.xy), vec3(TexCoord, material.x));
+	vec4 second = texture(sampler2DArray(handles.zw), vec3(TexCoord, material.y));
+#else
+	vec4 first = texture(materialArray, vec3(TexCoord, material.x));
+	vec4 second = texture(materialArray, vec3(TexCoord, material.y));
+#endif
+	FragColor = mix(first, second, mixer) * tint;
+#else
 	FragColor = mix(texture(texture1, TexCoord), 
 					texture(texture2, vec2(TexCoord.x, TexCoord.y)), mixer);
+#endif
 };
\ No newline at end of file
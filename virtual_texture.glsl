@@ -0,0 +1,41 @@
+// Virtual texture lookups for ground.frag, see VirtualTexture.h. Pulled in
+// with #include by the Shader loader.
+
+uniform sampler2D vtCache;          // cacheSlots x cacheSlots pages with their borders
+uniform sampler2D vtIndirection;    // texel per page, level per mip: slot x, slot y, resident mip
+uniform float vtPages;              // pages across mip 0
+uniform float vtPageSize;
+uniform float vtBorder;
+uniform float vtSlots;
+uniform float vtMaxMip;
+uniform float vtMipBias;
+
+float vtMip(vec2 uv) {
+    vec2 texels = uv * vtPages * vtPageSize;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + vtMipBias;
+    return clamp(floor(lod), 0.0, vtMaxMip);
+}
+
+ivec2 vtPage(vec2 uv, float mip) {
+    float across = max(vtPages / exp2(mip), 1.0);
+    return ivec2(min(floor(clamp(uv, 0.0, 1.0) * across), vec2(across - 1.0)));
+}
+
+// written by the FEEDBACK pass, read back by VirtualTexture::update
+vec4 vtFeedback(vec2 uv) {
+    float mip = vtMip(uv);
+    return vec4(vec2(vtPage(uv, mip)), mip, 255.0) / 255.0;
+}
+
+vec4 vtSample(vec2 uv) {
+    float mip = vtMip(uv);
+    vec3 entry = floor(texelFetch(vtIndirection, vtPage(uv, mip), int(mip)).rgb * 255.0 + 0.5);
+    // the entry may be a coarser page standing in for the one asked for
+    float across = max(vtPages / exp2(entry.b), 1.0);
+    vec2 local = fract(clamp(uv, 0.0, 0.9999) * across);
+    float tile = vtPageSize + 2.0 * vtBorder;
+    vec2 texel = entry.xy * tile + vtBorder + local * vtPageSize;
+    return textureLod(vtCache, texel / (vtSlots * tile), 0.0);
+}
\ No newline at end of file